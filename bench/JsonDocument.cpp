@@ -0,0 +1,725 @@
+//
+// Created by 78472 on 2022/7/11.
+//
+
+#include "JsonDocument.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#if defined(__SSE2__) && !defined(QLIBC_JSON_DISABLE_SIMD)
+#include <emmintrin.h>
+#define QLIBC_JSON_SSE2 1
+#endif
+
+namespace qlibc{
+
+    static const size_t ArenaBlockSize = 4096;
+    //输入缓冲区末尾的填充，第一阶段按64字节整块读取
+    static const size_t BufferPadding = 64;
+
+    JsonArena::JsonArena(JsonArena&& other) noexcept
+        : blocks_(std::move(other.blocks_)), cur_(other.cur_), end_(other.end_){
+        other.blocks_.clear();
+        other.cur_ = nullptr;
+        other.end_ = nullptr;
+    }
+
+    JsonArena& JsonArena::operator=(JsonArena&& other) noexcept {
+        if(this == &other)  return *this;
+        blocks_ = std::move(other.blocks_);
+        cur_ = other.cur_;
+        end_ = other.end_;
+        other.blocks_.clear();
+        other.cur_ = nullptr;
+        other.end_ = nullptr;
+        return *this;
+    }
+
+    void* JsonArena::allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+        if(cur_ == nullptr || p + size > reinterpret_cast<uintptr_t>(end_)){
+            addBlock(size + align);
+            p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur_ = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    void JsonArena::reset() {
+        if(blocks_.size() > 1){
+            size_t total = capacity();
+            blocks_.clear();
+            addBlock(total);
+        }
+        if(!blocks_.empty()){
+            cur_ = blocks_.front().data.get();
+            end_ = cur_ + blocks_.front().size;
+        }
+    }
+
+    size_t JsonArena::capacity() const {
+        size_t total = 0;
+        for(const Block& block : blocks_){
+            total += block.size;
+        }
+        return total;
+    }
+
+    void JsonArena::addBlock(size_t minSize) {
+        size_t size = std::max(minSize, std::max(ArenaBlockSize, capacity()));
+        Block block{std::unique_ptr<char[]>(new char[size]), size};
+        cur_ = block.data.get();
+        end_ = cur_ + size;
+        blocks_.push_back(std::move(block));
+    }
+
+    /*
+     * 第一阶段：字符分类
+     */
+    enum : uint8_t {
+        ClassQuote = 1,
+        ClassBackslash = 2,
+        ClassOperator = 4,
+        ClassSpace = 8,
+    };
+
+    struct CharClassTable{
+        uint8_t classes[256];
+        CharClassTable() : classes(){
+            classes[static_cast<uint8_t>('"')] = ClassQuote;
+            classes[static_cast<uint8_t>('\\')] = ClassBackslash;
+            for(char c : {'{', '}', '[', ']', ':', ','}){
+                classes[static_cast<uint8_t>(c)] = ClassOperator;
+            }
+            for(char c : {' ', '\t', '\n', '\r'}){
+                classes[static_cast<uint8_t>(c)] = ClassSpace;
+            }
+        }
+    };
+    static const CharClassTable charClass;
+
+    struct BlockMasks{
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t op;
+        uint64_t space;
+    };
+
+#ifdef QLIBC_JSON_SSE2
+    static inline uint64_t compareMask(const __m128i chunks[4], char c){
+        __m128i target = _mm_set1_epi8(c);
+        uint64_t mask = 0;
+        for(int i = 0; i < 4; ++i){
+            uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[i], target)));
+            mask |= static_cast<uint64_t>(bits) << (16 * i);
+        }
+        return mask;
+    }
+
+    static inline void classifyBlock(const char* p, BlockMasks& masks){
+        __m128i chunks[4];
+        __m128i lower[4];
+        __m128i caseBit = _mm_set1_epi8(0x20);
+        for(int i = 0; i < 4; ++i){
+            chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            //'['|0x20 == '{'，']'|0x20 == '}'，两次比较覆盖四个括号
+            lower[i] = _mm_or_si128(chunks[i], caseBit);
+        }
+        masks.quote = compareMask(chunks, '"');
+        masks.backslash = compareMask(chunks, '\\');
+        masks.op = compareMask(lower, '{') | compareMask(lower, '}') | compareMask(chunks, ':') | compareMask(chunks, ',');
+        masks.space = compareMask(chunks, ' ') | compareMask(chunks, '\t') | compareMask(chunks, '\n') | compareMask(chunks, '\r');
+    }
+#else
+    static inline void classifyBlock(const char* p, BlockMasks& masks){
+        masks = BlockMasks{0, 0, 0, 0};
+        for(int i = 0; i < 64; ++i){
+            uint8_t c = charClass.classes[static_cast<uint8_t>(p[i])];
+            uint64_t bit = uint64_t(1) << i;
+            if(c & ClassQuote)      masks.quote |= bit;
+            if(c & ClassBackslash)  masks.backslash |= bit;
+            if(c & ClassOperator)   masks.op |= bit;
+            if(c & ClassSpace)      masks.space |= bit;
+        }
+    }
+#endif
+
+    //前缀异或：结果的第i位为输入第0..i位的异或，引号位图经过前缀异或即得到字符串内部区域
+    static inline uint64_t prefixXor(uint64_t bits){
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    //被转义的字符：紧跟在奇数个连续反斜杠之后的字符；prevOdd记录上一块是否以奇数个反斜杠结尾
+    static inline uint64_t escapedMask(uint64_t backslash, uint64_t& prevOdd){
+        const uint64_t evenBits = 0x5555555555555555ULL;
+        const uint64_t oddBits = ~evenBits;
+        uint64_t startEdges = backslash & ~(backslash << 1);
+        uint64_t evenStartMask = evenBits ^ prevOdd;
+        uint64_t evenStarts = startEdges & evenStartMask;
+        uint64_t oddStarts = startEdges & ~evenStartMask;
+        uint64_t evenCarries = backslash + evenStarts;
+        uint64_t oddCarries = backslash + oddStarts;
+        bool endsOdd = oddCarries < backslash;
+        oddCarries |= prevOdd;
+        prevOdd = endsOdd ? 1 : 0;
+        uint64_t evenCarryEnds = evenCarries & ~backslash;
+        uint64_t oddCarryEnds = oddCarries & ~backslash;
+        return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+    }
+
+    bool JsonDocument::buildIndex() {
+        index_.clear();
+        index_.reserve(length_ / 4 + 64);
+
+        uint64_t prevOdd = 0;
+        uint64_t prevInString = 0;
+        uint64_t prevScalar = 0;
+        for(size_t base = 0; base < length_; base += 64){
+            BlockMasks masks;
+            classifyBlock(buffer_ + base, masks);
+
+            uint64_t quote = masks.quote & ~escapedMask(masks.backslash, prevOdd);
+            //字符串内部区域，包含开引号，不包含闭引号
+            uint64_t inString = prefixXor(quote) ^ prevInString;
+            prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+            uint64_t scalar = ~(masks.op | masks.space | quote | inString);
+            uint64_t scalarStart = scalar & ~((scalar << 1) | prevScalar);
+            prevScalar = scalar >> 63;
+
+            uint64_t structurals = (masks.op & ~inString) | (quote & inString) | scalarStart;
+            if(base + 64 > length_){
+                structurals &= (uint64_t(1) << (length_ - base)) - 1;
+            }
+
+            size_t count = index_.size();
+            index_.resize(count + static_cast<size_t>(__builtin_popcountll(structurals)));
+            uint32_t* out = index_.data() + count;
+            while(structurals != 0){
+                *out++ = static_cast<uint32_t>(base + static_cast<size_t>(__builtin_ctzll(structurals)));
+                structurals &= structurals - 1;
+            }
+        }
+
+        //字符串未闭合
+        if(prevInString != 0){
+            return fail(length_);
+        }
+        return true;
+    }
+
+    /*
+     * 第二阶段：按下标建树
+     */
+    static inline bool isScalarChar(char c){
+        return c != '\0' && charClass.classes[static_cast<uint8_t>(c)] == 0;
+    }
+
+    static inline int hexValue(char c){
+        if(c >= '0' && c <= '9')    return c - '0';
+        if(c >= 'a' && c <= 'f')    return c - 'a' + 10;
+        if(c >= 'A' && c <= 'F')    return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool readHex4(const char* p, unsigned& value){
+        value = 0;
+        for(int i = 0; i < 4; ++i){
+            int h = hexValue(p[i]);
+            if(h < 0)   return false;
+            value = (value << 4) | static_cast<unsigned>(h);
+        }
+        return true;
+    }
+
+    static char* writeUtf8(unsigned cp, char* out){
+        if(cp < 0x80){
+            *out++ = static_cast<char>(cp);
+        }else if(cp < 0x800){
+            *out++ = static_cast<char>(0xC0 | (cp >> 6));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        }else if(cp < 0x10000){
+            *out++ = static_cast<char>(0xE0 | (cp >> 12));
+            *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        }else{
+            *out++ = static_cast<char>(0xF0 | (cp >> 18));
+            *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        return out;
+    }
+
+    //pos为开引号位置；反转义后的内容不会比原文长，直接写回原位置并以'\0'结尾
+    bool JsonDocument::parseString(uint32_t pos, const char *&str, uint32_t &length) {
+        char* begin = buffer_ + pos + 1;
+        char* p = begin;
+        while(*p != '"' && *p != '\\'){
+            ++p;
+        }
+        if(*p == '"'){
+            *p = '\0';
+            str = begin;
+            length = static_cast<uint32_t>(p - begin);
+            return true;
+        }
+
+        char* out = p;
+        while(true){
+            char c = *p;
+            if(c == '"'){
+                break;
+            }
+            if(c != '\\'){
+                *out++ = c;
+                ++p;
+                continue;
+            }
+            char e = p[1];
+            p += 2;
+            switch(e){
+                case '"':   *out++ = '"'; break;
+                case '\\':  *out++ = '\\'; break;
+                case '/':   *out++ = '/'; break;
+                case 'b':   *out++ = '\b'; break;
+                case 'f':   *out++ = '\f'; break;
+                case 'n':   *out++ = '\n'; break;
+                case 'r':   *out++ = '\r'; break;
+                case 't':   *out++ = '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if(!readHex4(p, cp))    return fail(static_cast<size_t>(p - buffer_));
+                    p += 4;
+                    if(cp >= 0xD800 && cp <= 0xDBFF){
+                        unsigned low;
+                        if(p[0] != '\\' || p[1] != 'u' || !readHex4(p + 2, low) || low < 0xDC00 || low > 0xDFFF){
+                            return fail(static_cast<size_t>(p - buffer_));
+                        }
+                        p += 6;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    out = writeUtf8(cp, out);
+                    break;
+                }
+                default:
+                    return fail(static_cast<size_t>(p - buffer_));
+            }
+        }
+        *out = '\0';
+        str = begin;
+        length = static_cast<uint32_t>(out - begin);
+        return true;
+    }
+
+    bool JsonDocument::parseAtom(uint32_t pos, JsonNode &node) {
+        const char* p = buffer_ + pos;
+        const char* end;
+        node = JsonNode();
+        switch(*p){
+            case 't':
+                if(memcmp(p, "true", 4) != 0)   return fail(pos);
+                node.type_ = Json::booleanValue;
+                node.v_.b = true;
+                end = p + 4;
+                break;
+            case 'f':
+                if(memcmp(p, "false", 5) != 0)  return fail(pos);
+                node.type_ = Json::booleanValue;
+                node.v_.b = false;
+                end = p + 5;
+                break;
+            case 'n':
+                if(memcmp(p, "null", 4) != 0)   return fail(pos);
+                end = p + 4;
+                break;
+            default: {
+                const char* q = p;
+                bool negative = *q == '-';
+                if(negative)    ++q;
+                if(*q < '0' || *q > '9')    return fail(pos);
+                if(*q == '0' && q[1] >= '0' && q[1] <= '9')     return fail(pos);
+
+                uint64_t value = 0;
+                bool overflow = false;
+                while(*q >= '0' && *q <= '9'){
+                    unsigned d = static_cast<unsigned>(*q - '0');
+                    if(value > (UINT64_MAX - d) / 10)   overflow = true;
+                    value = value * 10 + d;
+                    ++q;
+                }
+                if(*q == '.' || *q == 'e' || *q == 'E' || overflow){
+                    //小数、指数和超出64位的整数按double解析，先检查格式再交给strtod
+                    if(*q == '.'){
+                        ++q;
+                        if(*q < '0' || *q > '9')    return fail(pos);
+                        while(*q >= '0' && *q <= '9')   ++q;
+                    }
+                    if(*q == 'e' || *q == 'E'){
+                        ++q;
+                        if(*q == '+' || *q == '-')  ++q;
+                        if(*q < '0' || *q > '9')    return fail(pos);
+                        while(*q >= '0' && *q <= '9')   ++q;
+                    }
+                    node.type_ = Json::realValue;
+                    node.v_.d = strtod(p, nullptr);
+                }else if(negative){
+                    if(value > uint64_t(INT64_MAX) + 1){
+                        node.type_ = Json::realValue;
+                        node.v_.d = -static_cast<double>(value);
+                    }else{
+                        node.type_ = Json::intValue;
+                        node.v_.i = static_cast<int64_t>(0 - value);
+                    }
+                }else if(value > uint64_t(INT64_MAX)){
+                    node.type_ = Json::uintValue;
+                    node.v_.u = value;
+                }else{
+                    node.type_ = Json::intValue;
+                    node.v_.i = static_cast<int64_t>(value);
+                }
+                end = q;
+                break;
+            }
+        }
+        //标量之后只能是空白、结构字符或结尾
+        if(isScalarChar(*end)){
+            return fail(static_cast<size_t>(end - buffer_));
+        }
+        return true;
+    }
+
+    bool JsonDocument::parseKey(size_t &i) {
+        if(i + 1 >= index_.size() || buffer_[index_[i]] != '"' || buffer_[index_[i + 1]] != ':'){
+            return fail(i < index_.size() ? index_[i] : length_);
+        }
+        JsonMember member;
+        member.value = JsonNode();
+        if(!parseString(index_[i], member.key, member.keyLength)){
+            return false;
+        }
+        members_.push_back(member);
+        i += 2;
+        return true;
+    }
+
+    static inline bool keyLess(const JsonMember& a, const JsonMember& b){
+        int r = memcmp(a.key, b.key, std::min(a.keyLength, b.keyLength));
+        return r != 0 ? r < 0 : a.keyLength < b.keyLength;
+    }
+
+    static inline bool keyEqual(const JsonMember& a, const JsonMember& b){
+        return a.keyLength == b.keyLength && memcmp(a.key, b.key, a.keyLength) == 0;
+    }
+
+    void JsonDocument::closeContainer(JsonNode &node) {
+        Frame frame = frames_.back();
+        frames_.pop_back();
+        node = JsonNode();
+        if(frame.isObject){
+            auto first = members_.begin() + static_cast<ptrdiff_t>(frame.start);
+            std::stable_sort(first, members_.end(), keyLess);
+            //key重复时保留最后出现的值
+            auto out = first;
+            for(auto it = first; it != members_.end(); ++it){
+                if(it + 1 != members_.end() && keyEqual(*it, *(it + 1))){
+                    continue;
+                }
+                *out++ = *it;
+            }
+            size_t count = static_cast<size_t>(out - first);
+            JsonMember* members = static_cast<JsonMember*>(arena_.allocate(sizeof(JsonMember) * count, alignof(JsonMember)));
+            std::uninitialized_copy(first, out, members);
+            members_.resize(frame.start);
+            node.type_ = Json::objectValue;
+            node.size_ = static_cast<uint32_t>(count);
+            node.v_.members = members;
+        }else{
+            size_t count = elements_.size() - frame.start;
+            JsonNode* elements = static_cast<JsonNode*>(arena_.allocate(sizeof(JsonNode) * count, alignof(JsonNode)));
+            std::uninitialized_copy(elements_.begin() + static_cast<ptrdiff_t>(frame.start), elements_.end(), elements);
+            elements_.resize(frame.start);
+            node.type_ = Json::arrayValue;
+            node.size_ = static_cast<uint32_t>(count);
+            node.v_.elements = elements;
+        }
+    }
+
+    bool JsonDocument::buildTree() {
+        frames_.clear();
+        elements_.clear();
+        members_.clear();
+
+        size_t n = index_.size();
+        size_t i = 0;
+        JsonNode node;
+        while(true){
+            //解析一个值
+            if(i >= n)  return fail(length_);
+            uint32_t pos = index_[i++];
+            char c = buffer_[pos];
+            if(c == '{' || c == '['){
+                if(frames_.size() >= MaxDepth)  return fail(pos);
+                bool isObject = c == '{';
+                frames_.push_back(Frame{isObject, isObject ? members_.size() : elements_.size()});
+                if(i < n && buffer_[index_[i]] == (isObject ? '}' : ']')){
+                    ++i;
+                    closeContainer(node);
+                }else if(isObject){
+                    if(!parseKey(i))    return false;
+                    continue;
+                }else{
+                    continue;
+                }
+            }else if(c == '"'){
+                node = JsonNode();
+                node.type_ = Json::stringValue;
+                if(!parseString(pos, node.v_.str, node.size_))  return false;
+            }else if(c == '}' || c == ']' || c == ':' || c == ','){
+                return fail(pos);
+            }else{
+                if(!parseAtom(pos, node))   return false;
+            }
+
+            //值已完成，放入所在的容器；容器结束时继续向上一层
+            while(true){
+                if(frames_.empty()){
+                    root_ = node;
+                    return i == n || fail(index_[i]);
+                }
+                Frame& frame = frames_.back();
+                if(frame.isObject){
+                    members_.back().value = node;
+                }else{
+                    elements_.push_back(node);
+                }
+                if(i >= n)  return fail(length_);
+                char d = buffer_[index_[i++]];
+                if(d == ','){
+                    if(frame.isObject && !parseKey(i))  return false;
+                    break;
+                }
+                if(d != (frame.isObject ? '}' : ']')){
+                    return fail(index_[i - 1]);
+                }
+                closeContainer(node);
+            }
+        }
+    }
+
+    JsonDocument::JsonDocument(JsonDocument&& other) noexcept
+        : arena_(std::move(other.arena_)), buffer_(other.buffer_), length_(other.length_),
+          index_(std::move(other.index_)), elements_(std::move(other.elements_)),
+          members_(std::move(other.members_)), frames_(std::move(other.frames_)),
+          root_(other.root_), errorOffset_(other.errorOffset_){
+        other.buffer_ = nullptr;
+        other.length_ = 0;
+        other.root_ = JsonNode();
+        other.errorOffset_ = 0;
+    }
+
+    JsonDocument& JsonDocument::operator=(JsonDocument&& other) noexcept {
+        if(this == &other)  return *this;
+        arena_ = std::move(other.arena_);
+        buffer_ = other.buffer_;
+        length_ = other.length_;
+        index_ = std::move(other.index_);
+        elements_ = std::move(other.elements_);
+        members_ = std::move(other.members_);
+        frames_ = std::move(other.frames_);
+        root_ = other.root_;
+        errorOffset_ = other.errorOffset_;
+        other.buffer_ = nullptr;
+        other.length_ = 0;
+        other.root_ = JsonNode();
+        other.errorOffset_ = 0;
+        return *this;
+    }
+
+    bool JsonDocument::parse(const char *data, size_t length) {
+        clear();
+        if(length >= UINT32_MAX - BufferPadding){
+            return fail(0);
+        }
+        buffer_ = static_cast<char*>(arena_.allocate(length + BufferPadding + 1, 64));
+        memcpy(buffer_, data, length);
+        memset(buffer_ + length, ' ', BufferPadding);
+        buffer_[length + BufferPadding] = '\0';
+        //标量解析以'\0'判断结尾
+        buffer_[length] = '\0';
+        length_ = length;
+
+        if(!buildIndex() || !buildTree()){
+            root_ = JsonNode();
+            return false;
+        }
+        return true;
+    }
+
+    bool JsonDocument::parse(const std::string &str) {
+        return parse(str.data(), str.size());
+    }
+
+    size_t JsonDocument::memoryUsage() const {
+        return arena_.capacity();
+    }
+
+    void JsonDocument::clear() {
+        arena_.reset();
+        buffer_ = nullptr;
+        length_ = 0;
+        root_ = JsonNode();
+        errorOffset_ = 0;
+    }
+
+    bool JsonDocument::fail(size_t offset) {
+        errorOffset_ = offset;
+        return false;
+    }
+
+    /*
+     * JsonNode
+     */
+    const JsonNode& JsonNode::nullNode() {
+        static const JsonNode null;
+        return null;
+    }
+
+    bool JsonNode::asBool(bool defValue) const {
+        return type_ == Json::booleanValue ? v_.b : defValue;
+    }
+
+    int JsonNode::asInt(int defValue) const {
+        if(!isNumeric())    return defValue;
+        int64_t v = asInt64(defValue);
+        if(v < INT_MIN || v > INT_MAX)  return defValue;
+        return static_cast<int>(v);
+    }
+
+    int64_t JsonNode::asInt64(int64_t defValue) const {
+        switch(type_){
+            case Json::intValue:    return v_.i;
+            case Json::uintValue:   return v_.u <= uint64_t(INT64_MAX) ? static_cast<int64_t>(v_.u) : defValue;
+            case Json::realValue:
+                if(v_.d >= -9223372036854775808.0 && v_.d < 9223372036854775808.0)  return static_cast<int64_t>(v_.d);
+                return defValue;
+            default:    return defValue;
+        }
+    }
+
+    uint64_t JsonNode::asUInt64(uint64_t defValue) const {
+        switch(type_){
+            case Json::intValue:    return v_.i >= 0 ? static_cast<uint64_t>(v_.i) : defValue;
+            case Json::uintValue:   return v_.u;
+            case Json::realValue:
+                if(v_.d >= 0 && v_.d < 18446744073709551616.0)  return static_cast<uint64_t>(v_.d);
+                return defValue;
+            default:    return defValue;
+        }
+    }
+
+    double JsonNode::asDouble(double defValue) const {
+        switch(type_){
+            case Json::intValue:    return static_cast<double>(v_.i);
+            case Json::uintValue:   return static_cast<double>(v_.u);
+            case Json::realValue:   return v_.d;
+            default:    return defValue;
+        }
+    }
+
+    const char* JsonNode::c_str() const {
+        return type_ == Json::stringValue ? v_.str : "";
+    }
+
+    uint32_t JsonNode::length() const {
+        return type_ == Json::stringValue ? size_ : 0;
+    }
+
+    std::string JsonNode::asString() const {
+        return type_ == Json::stringValue ? std::string(v_.str, size_) : std::string();
+    }
+
+    uint32_t JsonNode::size() const {
+        return (type_ == Json::arrayValue || type_ == Json::objectValue) ? size_ : 0;
+    }
+
+    const JsonNode& JsonNode::operator[](uint32_t index) const {
+        if(type_ != Json::arrayValue || index >= size_)     return nullNode();
+        return v_.elements[index];
+    }
+
+    const JsonNode& JsonNode::operator[](int index) const {
+        if(index < 0)   return nullNode();
+        return (*this)[static_cast<uint32_t>(index)];
+    }
+
+    const JsonNode& JsonNode::operator[](const char *key) const {
+        const JsonNode* node = find(key, strlen(key));
+        return node != nullptr ? *node : nullNode();
+    }
+
+    const JsonNode& JsonNode::operator[](const std::string &key) const {
+        const JsonNode* node = find(key.data(), key.size());
+        return node != nullptr ? *node : nullNode();
+    }
+
+    const JsonNode* JsonNode::find(const char *key, size_t keyLength) const {
+        if(type_ != Json::objectValue)  return nullptr;
+        JsonMember target;
+        target.key = key;
+        target.keyLength = static_cast<uint32_t>(keyLength);
+        const JsonMember* end = v_.members + size_;
+        const JsonMember* it = std::lower_bound(v_.members, end, target, keyLess);
+        if(it != end && keyEqual(*it, target)){
+            return &it->value;
+        }
+        return nullptr;
+    }
+
+    const JsonMember& JsonNode::member(uint32_t index) const {
+        return v_.members[index];
+    }
+
+    void JsonNode::toValue(Json::Value &value) const {
+        switch(type_){
+            case Json::nullValue:       value = Json::Value(); break;
+            case Json::intValue:        value = Json::Value(static_cast<Json::Int64>(v_.i)); break;
+            case Json::uintValue:       value = Json::Value(static_cast<Json::UInt64>(v_.u)); break;
+            case Json::realValue:       value = Json::Value(v_.d); break;
+            case Json::booleanValue:    value = Json::Value(v_.b); break;
+            case Json::stringValue:     value = Json::Value(v_.str, v_.str + size_); break;
+            case Json::arrayValue:
+                value = Json::Value(Json::arrayValue);
+                if(size_ > 0){
+                    value.resize(size_);
+                }
+                for(uint32_t i = 0; i < size_; ++i){
+                    v_.elements[i].toValue(value[i]);
+                }
+                break;
+            case Json::objectValue:
+                value = Json::Value(Json::objectValue);
+                for(uint32_t i = 0; i < size_; ++i){
+                    //key以'\0'结尾，只有包含\u0000时才需要构造std::string
+                    const JsonMember& m = v_.members[i];
+                    if(strlen(m.key) == m.keyLength){
+                        m.value.toValue(value[m.key]);
+                    }else{
+                        m.value.toValue(value[std::string(m.key, m.keyLength)]);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
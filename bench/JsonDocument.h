@@ -0,0 +1,189 @@
+//
+// Created by 78472 on 2022/7/11.
+//
+
+#ifndef EXHIBITION_JSONDOCUMENT_H
+#define EXHIBITION_JSONDOCUMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "qlibc/jsoncpp/json.h"
+
+namespace qlibc{
+
+    /*
+     * 按块分配的内存池，只分配不单独释放，reset后整体复用
+     */
+    class JsonArena{
+    private:
+        struct Block{
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+        std::vector<Block> blocks_;
+        char* cur_ = nullptr;
+        char* end_ = nullptr;
+
+    public:
+        JsonArena() = default;
+        JsonArena(const JsonArena&) = delete;
+        JsonArena& operator=(const JsonArena&) = delete;
+        //被移动的对象不再持有块，cur_/end_置空，之后的allocate重新申请
+        JsonArena(JsonArena&& other) noexcept;
+        JsonArena& operator=(JsonArena&& other) noexcept;
+
+        void* allocate(size_t size, size_t align = 8);
+
+        //释放所有分配；上一轮用了多个块时合并为一个足够大的块，稳定后不再向系统申请内存
+        void reset();
+
+        size_t capacity() const;
+
+    private:
+        void addBlock(size_t minSize);
+    };
+
+    struct JsonMember;
+
+    /*
+     * 只读JSON节点，16字节，类型沿用Json::ValueType
+     *      1. 字符串原地存放在文档自己的输入缓冲区中，以'\0'结尾，不单独分配
+     *      2. 数组元素、对象成员在内存池中连续存放；对象成员按key排序，查找为二分查找，重复的key保留最后一个
+     *      3. 类型不匹配的访问返回默认值，不抛异常
+     */
+    class JsonNode{
+    private:
+        friend class JsonDocument;
+
+        uint8_t type_ = Json::nullValue;
+        uint32_t size_ = 0;                 //字符串长度 / 数组元素个数 / 对象成员个数
+        union{
+            bool b;
+            int64_t i;
+            uint64_t u;
+            double d;
+            const char* str;
+            const JsonNode* elements;
+            const JsonMember* members;
+        } v_{};
+
+    public:
+        Json::ValueType type() const { return static_cast<Json::ValueType>(type_); }
+        bool isNull() const { return type_ == Json::nullValue; }
+        bool isBool() const { return type_ == Json::booleanValue; }
+        bool isInt() const { return type_ == Json::intValue || type_ == Json::uintValue; }
+        bool isNumeric() const { return isInt() || type_ == Json::realValue; }
+        bool isString() const { return type_ == Json::stringValue; }
+        bool isArray() const { return type_ == Json::arrayValue; }
+        bool isObject() const { return type_ == Json::objectValue; }
+
+        bool asBool(bool defValue = false) const;
+        int asInt(int defValue = 0) const;
+        int64_t asInt64(int64_t defValue = 0) const;
+        uint64_t asUInt64(uint64_t defValue = 0) const;
+        double asDouble(double defValue = 0.0) const;
+
+        //字符串内容，非字符串返回""
+        const char* c_str() const;
+        //字符串长度，非字符串返回0
+        uint32_t length() const;
+        std::string asString() const;
+
+        //数组元素个数或对象成员个数，其他类型返回0
+        uint32_t size() const;
+
+        //数组元素，越界或不是数组返回null节点
+        const JsonNode& operator[](uint32_t index) const;
+        const JsonNode& operator[](int index) const;
+
+        //对象成员，不存在或不是对象返回null节点
+        const JsonNode& operator[](const char* key) const;
+        const JsonNode& operator[](const std::string& key) const;
+
+        //对象成员，不存在或不是对象返回nullptr
+        const JsonNode* find(const char* key, size_t keyLength) const;
+
+        //按key顺序遍历对象成员
+        const JsonMember& member(uint32_t index) const;
+
+        //转换为Json::Value，用于交给QData等已有接口
+        void toValue(Json::Value& value) const;
+
+        static const JsonNode& nullNode();
+    };
+
+    struct JsonMember{
+        const char* key;        //以'\0'结尾
+        uint32_t keyLength;
+        JsonNode value;
+    };
+
+    /*
+     * 基于内存池的JSON文档，按simdjson的两阶段方式解析：
+     *      1. 第一阶段每次处理64字节，用SSE2（不可用时用查表）得到引号、反斜杠、结构字符、空白的位图，
+     *         去掉被转义的引号后用前缀异或得到字符串内部区域，输出所有结构字符和标量起始位置的下标
+     *      2. 第二阶段按下标顺序校验语法并建树，字符串在缓冲区内原地反转义
+     * 文档持有输入的副本，节点在文档下次parse或析构之前有效；同一个文档重复parse时复用内存池和下标数组
+     * 不是线程安全的，解析完成后的只读访问可以多线程并发
+     * 不校验UTF-8，字符串中的非法字节原样保留（jsoncpp同样不校验）
+     *
+     * 目前只用于json_bench与jsoncpp对比，还没有读路径使用，所以放在bench目录而不是qlibc
+     */
+    class JsonDocument{
+    public:
+        static const size_t MaxDepth = 1000;
+
+    private:
+        struct Frame{
+            bool isObject;
+            size_t start;       //在elements_/members_中的起始位置
+        };
+
+        JsonArena arena_;
+        char* buffer_ = nullptr;
+        size_t length_ = 0;
+        std::vector<uint32_t> index_;
+        std::vector<JsonNode> elements_;
+        std::vector<JsonMember> members_;
+        std::vector<Frame> frames_;
+        JsonNode root_;
+        size_t errorOffset_ = 0;
+
+    public:
+        JsonDocument() = default;
+        JsonDocument(const JsonDocument&) = delete;
+        JsonDocument& operator=(const JsonDocument&) = delete;
+        //被移动的文档变为空文档
+        JsonDocument(JsonDocument&& other) noexcept;
+        JsonDocument& operator=(JsonDocument&& other) noexcept;
+
+        //成功返回true；失败返回false，root为null节点
+        bool parse(const char* data, size_t length);
+        bool parse(const std::string& str);
+
+        const JsonNode& root() const { return root_; }
+
+        //解析失败的大致位置
+        size_t errorOffset() const { return errorOffset_; }
+
+        //内存池当前占用的容量
+        size_t memoryUsage() const;
+
+        void clear();
+
+    private:
+        bool buildIndex();
+        bool buildTree();
+        bool parseString(uint32_t pos, const char*& str, uint32_t& length);
+        bool parseAtom(uint32_t pos, JsonNode& node);
+        bool parseKey(size_t& i);
+        void closeContainer(JsonNode& node);
+        bool fail(size_t offset);
+    };
+}
+
+
+#endif //EXHIBITION_JSONDOCUMENT_H
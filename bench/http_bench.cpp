@@ -0,0 +1,108 @@
+//
+// Created by 78472 on 2022/7/22.
+//
+// 服务端请求处理路径上的微基准，不经过网络
+//      Http/ParseHeaders       典型站点请求的头部解析
+//      Http/Process/routes:N   请求行+头部+请求体解析、N个路由的匹配、处理函数、写响应
+//      Log/*                   LOG_INFO写日志文件（关闭控制台输出），单线程与多线程
+//
+
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+#include <string>
+#include "http/httplib.h"
+#include "log/Logging.h"
+
+static const std::string RequestBody = R"({"service_id":"testService","request":{"site_id":"testSite","port":9001}})";
+
+static std::string requestHead(){
+    return "POST / HTTP/1.1\r\n"
+           "Host: 127.0.0.1:9000\r\n"
+           "Accept: application/cbor, application/json\r\n"
+           "Content-Type: text/plain\r\n"
+           "User-Agent: cpp-httplib/0.10.8\r\n"
+           "Connection: keep-alive\r\n"
+           "Content-Length: " + std::to_string(RequestBody.size()) + "\r\n"
+           "\r\n";
+}
+
+static void BM_ParseHeaders(benchmark::State& state){
+    //跳过请求行，从第一个头部开始
+    std::string head = requestHead();
+    head.erase(0, head.find("\r\n") + 2);
+    for(auto _ : state){
+        httplib::detail::BufferStream strm;
+        strm.write(head.data(), head.size());
+        httplib::Headers headers;
+        bool ok = httplib::detail::read_headers(strm, headers);
+        benchmark::DoNotOptimize(ok);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseHeaders)->Name("Http/ParseHeaders");
+
+//process_request为protected，通过子类处理内存中的请求
+class BenchServer : public httplib::Server{
+public:
+    bool process(httplib::Stream& strm){
+        bool connection_closed = false;
+        return process_request(strm, false, connection_closed, nullptr);
+    }
+};
+
+static void BM_Process(benchmark::State& state){
+    BenchServer server;
+    //与站点一致，路由按注册顺序匹配，"/"注册在最后
+    for(int i = 1; i < state.range(0); ++i){
+        server.Post("/api/v1/route_" + std::to_string(i), [](const httplib::Request&, httplib::Response& response){
+            response.status = 404;
+        });
+    }
+    server.Post("/", [](const httplib::Request&, httplib::Response& response){
+        response.set_content(R"({"code":0,"error":"ok","response":{}})", "text/plain");
+    });
+
+    std::string request = requestHead() + RequestBody;
+    for(auto _ : state){
+        httplib::detail::BufferStream strm;
+        strm.write(request.data(), request.size());
+        bool ok = server.process(strm);
+        benchmark::DoNotOptimize(ok);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Process)->Name("Http/Process")->ArgName("routes")->Arg(1)->Arg(16)->Arg(64);
+
+//日志写到临时目录，只初始化一次
+static void initLogger(){
+    static bool initialized = [](){
+        char dir[] = "/tmp/http_bench_log_XXXXXX";
+        std::string path = mkdtemp(dir) != nullptr ? std::string(dir) + "/bench" : std::string("/tmp/http_bench");
+        muduo::logInitLogger(path);
+        muduo::logSetConsoleOutput(false);
+        return true;
+    }();
+    (void)initialized;
+}
+
+static void BM_LogStream(benchmark::State& state){
+    initLogger();
+    int64_t i = 0;
+    for(auto _ : state){
+        LOG_INFO << "received request: service_id = " << "testService" << ", port = " << 9001 << ", seq = " << i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogStream)->Name("Log/stream")->Threads(1)->Threads(4)->UseRealTime();
+
+static void BM_LogFormat(benchmark::State& state){
+    initLogger();
+    int64_t i = 0;
+    for(auto _ : state){
+        LOG_INFO.format("received request: service_id = {}, port = {}, seq = {}", "testService", 9001, i++);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogFormat)->Name("Log/format")->Threads(1)->Threads(4)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,246 @@
+//
+// Created by 78472 on 2022/7/11.
+//
+// JSON解析对比：jsoncpp（QData使用）、nlohmann（原siteService使用，保留作对比）、qlibc::JsonDocument（bench/JsonDocument.h）
+// 以及同一报文CBOR编码后的大小和编解码耗时
+// 语料为bench/corpus下按实际请求/响应格式整理的报文
+//
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "nlohmann/json.hpp"
+#include "JsonDocument.h"
+#include "qlibc/JsonCbor.h"
+#include "qlibc/QData.h"
+#include "siteService/service_protocol.h"
+
+static std::string readFile(const std::string& path){
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    std::ostringstream os;
+    os << in.rdbuf();
+    return os.str();
+}
+
+static std::vector<std::string> corpusFiles(){
+    std::vector<std::string> files;
+    DIR* dp = opendir(BENCH_CORPUS_DIR);
+    if(dp == nullptr){
+        return files;
+    }
+    while(struct dirent* entry = readdir(dp)){
+        std::string name = entry->d_name;
+        if(name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0){
+            files.push_back(name);
+        }
+    }
+    closedir(dp);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static void BM_Jsoncpp(benchmark::State& state, const std::string& body){
+    Json::Value value;
+    for(auto _ : state){
+        qlibc::QData::parseJson(body, value);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+
+static void BM_Nlohmann(benchmark::State& state, const std::string& body){
+    for(auto _ : state){
+        nlohmann::json value = nlohmann::json::parse(body, nullptr, false);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+
+//同一个文档重复解析，复用内存池
+static void BM_JsonDocument(benchmark::State& state, const std::string& body){
+    qlibc::JsonDocument doc;
+    for(auto _ : state){
+        doc.parse(body);
+        benchmark::DoNotOptimize(doc.root());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+
+//同一报文的CBOR编码解码为Json::Value，与BM_Jsoncpp对比；wire_bytes为编码后的大小
+static void BM_CborDecode(benchmark::State& state, const std::string& body){
+    std::string cbor;
+    qlibc::valueToCbor(qlibc::QData::parseJson(body), cbor);
+    Json::Value value;
+    for(auto _ : state){
+        qlibc::parseCbor(cbor, value);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * cbor.size()));
+    state.counters["wire_bytes"] = static_cast<double>(cbor.size());
+}
+
+static void BM_CborEncode(benchmark::State& state, const std::string& body){
+    Json::Value value = qlibc::QData::parseJson(body);
+    std::string cbor;
+    for(auto _ : state){
+        qlibc::valueToCbor(value, cbor);
+        benchmark::DoNotOptimize(cbor);
+    }
+    state.counters["wire_bytes"] = static_cast<double>(cbor.size());
+}
+
+static void BM_JsonEncode(benchmark::State& state, const std::string& body){
+    Json::Value value = qlibc::QData::parseJson(body);
+    std::string json;
+    for(auto _ : state){
+        qlibc::QData::valueToJsonString(value, json);
+        benchmark::DoNotOptimize(json);
+    }
+    state.counters["wire_bytes"] = static_cast<double>(json.size());
+}
+
+/*
+ * 解析站点列表响应并读取每个站点的字段，对应ServiceSiteManager处理site_query响应的过程
+ */
+static void BM_ReadSiteList_Jsoncpp(benchmark::State& state, const std::string& body){
+    for(auto _ : state){
+        qlibc::QData data(body);
+        qlibc::QData list = data.getData("response").getData("site_list");
+        int sum = 0;
+        for(Json::ArrayIndex i = 0; i < list.size(); ++i){
+            qlibc::QData item = list.getArrayElement(i);
+            sum += item.getInt("port") + static_cast<int>(item.getString("site_id").size() + item.getString("ip").size());
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+
+//解析后按ServiceSiteManager的报文结构一次解码（含全部字段的类型检查）
+static void BM_ReadSiteList_Schema(benchmark::State& state, const std::string& body){
+    Json::Value value;
+    servicesite::ServiceResponse<servicesite::SiteListResponse> result;
+    for(auto _ : state){
+        qlibc::QData::parseJson(body, value);
+        qlibc::decodeJson(value, result);
+        int sum = 0;
+        for(const auto& item : result.response.value.site_list){
+            sum += item.port + static_cast<int>(item.site_id.size() + item.ip.size());
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+
+static void BM_ReadSiteList_Nlohmann(benchmark::State& state, const std::string& body){
+    for(auto _ : state){
+        nlohmann::json data = nlohmann::json::parse(body, nullptr, false);
+        int sum = 0;
+        for(auto& item : data["response"]["site_list"]){
+            int port = item["port"];
+            std::string siteId = item["site_id"];
+            std::string ip = item["ip"];
+            sum += port + static_cast<int>(siteId.size() + ip.size());
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+
+static void BM_ReadSiteList_JsonDocument(benchmark::State& state, const std::string& body){
+    qlibc::JsonDocument doc;
+    for(auto _ : state){
+        doc.parse(body);
+        const qlibc::JsonNode& list = doc.root()["response"]["site_list"];
+        int sum = 0;
+        for(uint32_t i = 0; i < list.size(); ++i){
+            const qlibc::JsonNode& item = list[i];
+            sum += item["port"].asInt() + static_cast<int>(item["site_id"].length() + item["ip"].length());
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+
+//生成一个数MB的配置文件：开头是少量配置项，后面是大的设备列表
+static std::string makeConfigFile(){
+    Json::Value config;
+    config["site_id"] = "config";
+    config["port"] = 9006;
+    Json::Value& list = config["device_list"];
+    for(int i = 0; i < 20000; ++i){
+        Json::Value item;
+        item["device_id"] = "device_" + std::to_string(i);
+        item["device_type"] = "light";
+        item["online"] = (i % 3) != 0;
+        item["luminance"] = i % 255;
+        item["color_temperature"] = 2700 + i % 3800;
+        list.append(item);
+    }
+    char path[] = "/tmp/json_bench_config_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd >= 0){
+        close(fd);
+    }
+    qlibc::QData::writeToFile(path, config, false);
+    return path;
+}
+
+//原先的读取方式：ifstream + parseFromStream
+static void BM_LoadFile_Stream(benchmark::State& state, const std::string& path){
+    Json::CharReaderBuilder builder;
+    for(auto _ : state){
+        Json::Value value;
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        Json::parseFromStream(builder, in, &value, nullptr);
+        benchmark::DoNotOptimize(value);
+    }
+}
+
+static void BM_LoadFile_Mmap(benchmark::State& state, const std::string& path){
+    for(auto _ : state){
+        Json::Value value;
+        qlibc::QData::parseFromFile(path, value);
+        benchmark::DoNotOptimize(value);
+    }
+}
+
+static void BM_LoadFile_Subset(benchmark::State& state, const std::string& path){
+    std::vector<std::string> keys{"/site_id", "/port"};
+    for(auto _ : state){
+        Json::Value value;
+        qlibc::QData::parseFromFile(path, keys, value);
+        benchmark::DoNotOptimize(value);
+    }
+}
+
+int main(int argc, char** argv){
+    for(const std::string& name : corpusFiles()){
+        std::string body = readFile(std::string(BENCH_CORPUS_DIR) + "/" + name);
+        std::string label = name.substr(0, name.size() - 5);
+        benchmark::RegisterBenchmark(("Parse/jsoncpp/" + label).c_str(), BM_Jsoncpp, body);
+        benchmark::RegisterBenchmark(("Parse/nlohmann/" + label).c_str(), BM_Nlohmann, body);
+        benchmark::RegisterBenchmark(("Parse/JsonDocument/" + label).c_str(), BM_JsonDocument, body);
+        benchmark::RegisterBenchmark(("Parse/cbor/" + label).c_str(), BM_CborDecode, body);
+        benchmark::RegisterBenchmark(("Encode/json/" + label).c_str(), BM_JsonEncode, body);
+        benchmark::RegisterBenchmark(("Encode/cbor/" + label).c_str(), BM_CborEncode, body);
+        if(label == "site_query_response"){
+            benchmark::RegisterBenchmark("ReadSiteList/jsoncpp", BM_ReadSiteList_Jsoncpp, body);
+            benchmark::RegisterBenchmark("ReadSiteList/schema", BM_ReadSiteList_Schema, body);
+            benchmark::RegisterBenchmark("ReadSiteList/nlohmann", BM_ReadSiteList_Nlohmann, body);
+            benchmark::RegisterBenchmark("ReadSiteList/JsonDocument", BM_ReadSiteList_JsonDocument, body);
+        }
+    }
+
+    std::string configFile = makeConfigFile();
+    benchmark::RegisterBenchmark("LoadFile/stream", BM_LoadFile_Stream, configFile);
+    benchmark::RegisterBenchmark("LoadFile/mmap", BM_LoadFile_Mmap, configFile);
+    benchmark::RegisterBenchmark("LoadFile/subset", BM_LoadFile_Subset, configFile);
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    unlink(configFile.c_str());
+    return 0;
+}
@@ -0,0 +1,186 @@
+//
+// Created by 78472 on 2022/7/9.
+//
+// QData典型用法的基准测试：构造请求、解析并读取响应、拷贝与传递
+//
+
+#include <benchmark/benchmark.h>
+#include "qlibc/QData.h"
+#include "qlibc/QDataSnapshot.h"
+
+//数组元素个数为count的响应：{"code":0,"error":"ok","response":{"list":[{...},...]}}
+static qlibc::QData makeResponse(int count){
+    qlibc::QData list;
+    for(int i = 0; i < count; ++i){
+        qlibc::QData item;
+        item.setString("site_id", "site_" + std::to_string(i));
+        item.setString("ip", "192.168.1." + std::to_string(i % 255));
+        item.setInt("port", 9000 + i);
+        item.setBool("online", i % 2 == 0);
+        list.append(std::move(item));
+    }
+    qlibc::QData response;
+    response.putData("list", std::move(list));
+
+    qlibc::QData data;
+    data.setInt("code", 0);
+    data.setString("error", "ok");
+    data.putData("response", std::move(response));
+    return data;
+}
+
+static void BM_BuildRequest(benchmark::State& state){
+    for(auto _ : state){
+        qlibc::QData request;
+        request.setString("site_id", "testSite");
+        request.setString("ip", "127.0.0.1");
+        request.setInt("port", 9000);
+
+        qlibc::QData data;
+        data.setString("service_id", "register2QuerySite");
+        data.putData("request", std::move(request));
+        benchmark::DoNotOptimize(data.toJsonString());
+    }
+}
+BENCHMARK(BM_BuildRequest);
+
+static void BM_ParseAndReadResponse(benchmark::State& state){
+    string body = makeResponse(static_cast<int>(state.range(0))).toJsonString();
+    for(auto _ : state){
+        qlibc::QData data(body);
+        benchmark::DoNotOptimize(data.getInt("code"));
+        benchmark::DoNotOptimize(data.getString("error"));
+        qlibc::QData list = data.getData("response").getData("list");
+        for(Json::ArrayIndex i = 0; i < list.size(); ++i){
+            benchmark::DoNotOptimize(list.getArrayElement(i).getInt("port"));
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_ParseAndReadResponse)->Arg(1)->Arg(16)->Arg(256);
+
+//通过getData/getArrayElement逐层复制读取
+static void BM_ReadByCopy(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    for(auto _ : state){
+        qlibc::QData list = data.getData("response").getData("list");
+        int sum = 0;
+        for(Json::ArrayIndex i = 0; i < list.size(); ++i){
+            sum += list.getArrayElement(i).getInt("port");
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BENCHMARK(BM_ReadByCopy)->Arg(16)->Arg(256);
+
+//通过只读视图读取，不复制
+static void BM_ReadByView(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    for(auto _ : state){
+        const Json::Value& list = data.viewValue("response")["list"];
+        int sum = 0;
+        for(const Json::Value& item : list){
+            sum += item["port"].asInt();
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BENCHMARK(BM_ReadByView)->Arg(16)->Arg(256);
+
+//拷贝只增加引用计数
+static void BM_Copy(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    for(auto _ : state){
+        qlibc::QData copy(data);
+        benchmark::DoNotOptimize(copy.getInt("code"));
+    }
+}
+BENCHMARK(BM_Copy)->Arg(16)->Arg(256);
+
+//拷贝后修改，触发一次完整复制
+static void BM_CopyAndModify(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    for(auto _ : state){
+        qlibc::QData copy(data);
+        copy.setInt("code", 1);
+        benchmark::DoNotOptimize(copy.getInt("code"));
+    }
+}
+BENCHMARK(BM_CopyAndModify)->Arg(16)->Arg(256);
+
+//响应在多层之间按值传递、赋值
+static void BM_PassThrough(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    for(auto _ : state){
+        qlibc::QData response;
+        response.setInitData(data);
+        qlibc::QData forwarded;
+        forwarded = response;
+        qlibc::QData moved(std::move(forwarded));
+        benchmark::DoNotOptimize(moved.getString("error"));
+    }
+}
+BENCHMARK(BM_PassThrough)->Arg(16)->Arg(256);
+
+//序列化、解析往返，序列化缓冲区在迭代之间复用
+static void BM_SerializeParseRoundTrip(benchmark::State& state){
+    qlibc::QData data = makeResponse(static_cast<int>(state.range(0)));
+    string body;
+    Json::Value value;
+    for(auto _ : state){
+        data.toJsonString(body);
+        qlibc::QData::parseJson(body, value);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * body.size()));
+}
+BENCHMARK(BM_SerializeParseRoundTrip)->Arg(1)->Arg(16)->Arg(256);
+
+/*
+ * 并发读取共享配置：带锁的QData与QDataSnapshot
+ */
+static qlibc::QData makeConfig(){
+    qlibc::QData config;
+    config.setString("site_id", "testSite");
+    config.setString("query_site_ip", "127.0.0.1");
+    config.setInt("query_site_port", 9000);
+    config.setInt("ping_per_seconds", 10);
+    config.setBool("enable_access_log", true);
+    return config;
+}
+
+static void BM_ConcurrentRead_QData(benchmark::State& state){
+    static qlibc::QData config = makeConfig();
+    for(auto _ : state){
+        benchmark::DoNotOptimize(config.getInt("query_site_port"));
+        benchmark::DoNotOptimize(config.getBool("enable_access_log"));
+    }
+}
+BENCHMARK(BM_ConcurrentRead_QData)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_ConcurrentRead_Snapshot(benchmark::State& state){
+    static qlibc::QDataSnapshot config(makeConfig());
+    for(auto _ : state){
+        qlibc::QDataSnapshot::ReadView view = config.read();
+        benchmark::DoNotOptimize(view.getInt("query_site_port"));
+        benchmark::DoNotOptimize(view.getBool("enable_access_log"));
+    }
+}
+BENCHMARK(BM_ConcurrentRead_Snapshot)->ThreadRange(1, 8)->UseRealTime();
+
+//0号线程每1000次读取发布一次新版本
+static void BM_ConcurrentRead_SnapshotWithWriter(benchmark::State& state){
+    static qlibc::QDataSnapshot config(makeConfig());
+    int n = 0;
+    for(auto _ : state){
+        if(state.thread_index() == 0 && ++n % 1000 == 0){
+            config.update([n](qlibc::QData& data){ data.setInt("ping_per_seconds", n); });
+        }
+        qlibc::QDataSnapshot::ReadView view = config.read();
+        benchmark::DoNotOptimize(view.getInt("query_site_port"));
+        benchmark::DoNotOptimize(view.getBool("enable_access_log"));
+    }
+}
+BENCHMARK(BM_ConcurrentRead_SnapshotWithWriter)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,151 @@
+//
+// Created by 78472 on 2022/7/16.
+//
+// 消息发布时的订阅者查找：10k个消息ID × 每个100个订阅站点
+//      Publish/registry    SubscriptionRegistry，无锁查找、直接遍历不可变数组
+//      Publish/linear      原实现：加锁线性扫描消息列表，复制订阅者vector后遍历
+// 以及站点发现缓存按site_id查找（1000个站点）
+//
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "siteService/site_discovery.h"
+#include "siteService/subscription_registry.h"
+
+static const int TopicCount = 10000;
+static const int SubscriberCount = 100;
+
+struct BenchSite{
+    std::string ip;
+    int port;
+    std::atomic<uint64_t> received{0};
+
+    BenchSite(const std::string& pIp, int pPort) : ip(pIp), port(pPort){}
+};
+
+static std::string topicName(int i){
+    return "message_" + std::to_string(i);
+}
+
+//原实现的数据结构
+struct LinearSubscriber{
+    std::string messageId;
+    std::vector<BenchSite*> sites;
+    std::vector<BenchSite*> getSites(){ return sites; }
+};
+
+struct Fixture{
+    std::vector<BenchSite*> sites;
+    servicesite::SubscriptionRegistry<BenchSite> registry;
+    std::vector<LinearSubscriber> linear;
+    std::mutex linearMutex;
+
+    Fixture() : registry([](const std::string& ip, int port){ return new BenchSite(ip, port); }){
+        for(int i = 0; i < TopicCount; ++i){
+            registry.addTopic(topicName(i));
+        }
+        for(int j = 0; j < SubscriberCount; ++j){
+            sites.push_back(registry.site("10.0.0." + std::to_string(j), 9000 + j, true));
+        }
+        linear.resize(TopicCount);
+        for(int i = 0; i < TopicCount; ++i){
+            linear[i].messageId = topicName(i);
+            for(BenchSite* site : sites){
+                registry.subscribe(linear[i].messageId, site);
+                linear[i].sites.push_back(site);
+            }
+        }
+    }
+
+    ~Fixture(){
+        for(BenchSite* site : sites){
+            delete site;
+        }
+    }
+};
+
+static Fixture& fixture(){
+    static Fixture f;
+    return f;
+}
+
+//按固定步长轮流发布到不同的消息ID
+static std::vector<std::string> publishOrder(){
+    std::vector<std::string> order;
+    for(int i = 0; i < 1024; ++i){
+        order.push_back(topicName((i * 7919) % TopicCount));
+    }
+    return order;
+}
+
+static void BM_PublishRegistry(benchmark::State& state){
+    Fixture& f = fixture();
+    std::vector<std::string> order = publishOrder();
+    size_t index = 0;
+    for(auto _ : state){
+        size_t n = f.registry.forEachSubscriber(order[index++ & 1023], [](BenchSite* site){
+            site->received.fetch_add(1, std::memory_order_relaxed);
+        });
+        benchmark::DoNotOptimize(n);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PublishRegistry)->Name("Publish/registry")->Threads(1)->Threads(4);
+
+static void BM_PublishLinear(benchmark::State& state){
+    Fixture& f = fixture();
+    std::vector<std::string> order = publishOrder();
+    size_t index = 0;
+    for(auto _ : state){
+        const std::string& messageId = order[index++ & 1023];
+        std::lock_guard<std::mutex> lg(f.linearMutex);
+        for(auto& item : f.linear){
+            if(messageId != item.messageId)     continue;
+            for(BenchSite* site : item.getSites()){
+                site->received.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PublishLinear)->Name("Publish/linear")->Threads(1)->Threads(4);
+
+//订阅表变化时的开销：退订后重新订阅，每次复制一个100项的数组
+static void BM_Resubscribe(benchmark::State& state){
+    Fixture& f = fixture();
+    std::vector<std::string> order = publishOrder();
+    size_t index = 0;
+    for(auto _ : state){
+        const std::string& messageId = order[index & 1023];
+        BenchSite* site = f.sites[index++ % SubscriberCount];
+        f.registry.unsubscribe(messageId, site);
+        f.registry.subscribe(messageId, site);
+    }
+}
+BENCHMARK(BM_Resubscribe)->Name("Resubscribe/registry");
+
+static void BM_SiteLookup(benchmark::State& state){
+    static servicesite::SiteDiscoveryCache cache([](std::vector<servicesite::SiteHandle>& siteList){
+        for(int i = 0; i < 1000; ++i){
+            siteList.push_back(servicesite::SiteHandle("site_" + std::to_string(i), "summary", "127.0.0.1", 9001 + i));
+        }
+        return servicesite::ServiceSiteManager::RET_CODE_OK;
+    }, 3600);
+    std::vector<std::string> order;
+    for(int i = 0; i < 1024; ++i){
+        order.push_back("site_" + std::to_string((i * 7919) % 1000));
+    }
+    std::vector<servicesite::SiteHandle> result;
+    size_t index = 0;
+    for(auto _ : state){
+        result.clear();
+        cache.lookup(order[index++ & 1023], result);
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_SiteLookup)->Name("SiteLookup/discovery")->Threads(1)->Threads(4);
+
+BENCHMARK_MAIN();
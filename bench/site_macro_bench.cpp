@@ -0,0 +1,216 @@
+//
+// Created by 78472 on 2022/7/22.
+//
+// 站点库端到端基准：进程内启动一个站点（内核分配的临时端口），经本机回环网络访问
+//      Site/RequestResponse        长连接发送服务请求并读取响应
+//      Site/PublishFanout/subs:N   发布一条消息，等待N个订阅站点都收到
+//      Site/SubscribeChurn         经HTTP订阅再退订一个消息（含订阅日志追加）
+//
+
+#include <benchmark/benchmark.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "siteService/service_site_manager.h"
+
+using namespace servicesite;
+
+static const char* EchoServiceId = "bench_echo";
+static const char* FanoutMessageId = "bench_fanout";
+static const char* ChurnMessageId = "bench_churn";
+
+static int sitePort = -1;
+
+//内核分配的空闲端口
+static int ephemeralPort(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    int port = -1;
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && getsockname(fd, (struct sockaddr*)&addr, &len) == 0){
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+static bool postToSite(httplib::Client& client, const std::string& body){
+    auto res = client.Post("/", body, "text/plain");
+    return res && res->status == 200;
+}
+
+static std::string subscribeBody(const char* serviceId, const char* messageId, int port){
+    return std::string(R"({"service_id":")") + serviceId + R"(","request":{"message_list":[")" + messageId +
+           R"("],"port":)" + std::to_string(port) + "}}";
+}
+
+//订阅站点收到的消息数
+struct Delivery{
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint64_t count = 0;
+};
+
+//订阅站点：只计数收到的消息
+class Receiver{
+    httplib::Server server;
+    std::thread thread;
+    int port;
+
+public:
+    explicit Receiver(Delivery& delivery){
+        server.new_task_queue = [](){ return new httplib::ThreadPool(2); };
+        server.Post("/", [&delivery](const httplib::Request&, httplib::Response& response){
+            {
+                std::lock_guard<std::mutex> lg(delivery.mutex);
+                ++delivery.count;
+            }
+            delivery.cond.notify_all();
+            response.set_content("{}", "text/plain");
+        });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this](){ server.listen_after_bind(); });
+    }
+
+    ~Receiver(){
+        server.stop();
+        thread.join();
+    }
+
+    int getPort() const{
+        return port;
+    }
+};
+
+static void BM_RequestResponse(benchmark::State& state){
+    httplib::Client client("127.0.0.1", sitePort);
+    client.set_keep_alive(true);
+    std::string body = std::string(R"({"service_id":")") + EchoServiceId + R"(","request":{"site_id":"bench","seq":1}})";
+    for(auto _ : state){
+        if(!postToSite(client, body)){
+            state.SkipWithError("request failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RequestResponse)->Name("Site/RequestResponse")->Threads(1)->Threads(4)->UseRealTime();
+
+static void BM_PublishFanout(benchmark::State& state){
+    Delivery delivery;
+    std::vector<std::unique_ptr<Receiver>> receivers;
+    httplib::Client client("127.0.0.1", sitePort);
+    for(int i = 0; i < state.range(0); ++i){
+        receivers.emplace_back(new Receiver(delivery));
+        if(!postToSite(client, subscribeBody("subscribe_message", FanoutMessageId, receivers.back()->getPort()))){
+            state.SkipWithError("subscribe failed");
+            return;
+        }
+    }
+
+    ServiceSiteManager* manager = ServiceSiteManager::getInstance();
+    std::string message = std::string(R"({"message_id":")") + FanoutMessageId + R"(","content":{"device_id":"bench","status":1}})";
+    uint64_t expected = 0;
+    for(auto _ : state){
+        expected += receivers.size();
+        manager->publishMessage(FanoutMessageId, message);
+
+        std::unique_lock<std::mutex> lock(delivery.mutex);
+        if(!delivery.cond.wait_for(lock, std::chrono::seconds(5), [&](){ return delivery.count >= expected; })){
+            state.SkipWithError("message not delivered");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * receivers.size());
+
+    for(auto& receiver : receivers){
+        postToSite(client, subscribeBody("unsubscribe_message", FanoutMessageId, receiver->getPort()));
+    }
+}
+BENCHMARK(BM_PublishFanout)->Name("Site/PublishFanout")->ArgName("subs")->Arg(1)->Arg(8)->Arg(32)->UseRealTime();
+
+static void BM_SubscribeChurn(benchmark::State& state){
+    httplib::Client client("127.0.0.1", sitePort);
+    client.set_keep_alive(true);
+    //订阅站点不需要存在，只在发布时才连接
+    int port = ephemeralPort();
+    std::string subscribe = subscribeBody("subscribe_message", ChurnMessageId, port);
+    std::string unsubscribe = subscribeBody("unsubscribe_message", ChurnMessageId, port);
+    for(auto _ : state){
+        if(!postToSite(client, subscribe) || !postToSite(client, unsubscribe)){
+            state.SkipWithError("request failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_SubscribeChurn)->Name("Site/SubscribeChurn")->UseRealTime();
+
+//站点可以处理请求时返回true
+static bool waitSiteReady(){
+    httplib::Client client("127.0.0.1", sitePort);
+    std::string body = R"({"service_id":"get_service_list"})";
+    for(int i = 0; i < 500; ++i){
+        if(postToSite(client, body)){
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+int main(int argc, char** argv){
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)){
+        return 1;
+    }
+
+    //日志、订阅记录写到临时目录
+    char dir[] = "/tmp/site_macro_bench_XXXXXX";
+    if(mkdtemp(dir) == nullptr){
+        fprintf(stderr, "mkdtemp failed\n");
+        return 1;
+    }
+    std::string logPath = std::string(dir) + "/bench";
+    muduo::logInitLogger(logPath);
+    muduo::logSetConsoleOutput(false);
+    ServiceSiteManager::setMessageSubscriberConfigPath(std::string(dir) + "/");
+
+    ServiceSiteManager* manager = ServiceSiteManager::getInstance();
+    ServiceSiteManager::setSiteIdSummary("bench_site", "benchmark site");
+    sitePort = ephemeralPort();
+    manager->setServerPort(sitePort);
+    manager->registerServiceRequestHandler(EchoServiceId, [](const httplib::Request&, httplib::Response& response){
+        response.set_content(R"({"code":0,"error":"ok","response":{}})", "text/plain");
+        return 0;
+    });
+    manager->registerMessageId(FanoutMessageId);
+    manager->registerMessageId(ChurnMessageId);
+
+    std::thread siteThread([manager](){ manager->start(); });
+    if(!waitSiteReady()){
+        fprintf(stderr, "site not ready on port %d\n", sitePort);
+        ServiceSiteManager::shutdown();
+        siteThread.join();
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    ServiceSiteManager::shutdown();
+    siteThread.join();
+    muduo::logShutdown();
+    return 0;
+}
@@ -2,141 +2,407 @@
 // Created by 78472 on 2022/5/18.
 //
 
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
 #include "httpUtil.h"
 #include "log/Logging.h"
+#include "qlibc/JsonCbor.h"
+#include "qlibc/Epoch.h"
 
-bool httpUtil::sitePostRequest(const string& ip, int port, qlibc::QData& request, qlibc::QData& response){
-    httplib::Client client(ip, port);
-    client.set_connection_timeout(1, 0);
-    client.set_read_timeout(2, 0);
-    httplib::Result result =  client.Post("/", request.toJsonString(), "text/json");
+static const httplib::Headers& siteRequestHeaders(){
+    static const httplib::Headers headers = {{"Accept", string(qlibc::CborContentType) + ", application/json"}};
+    return headers;
+}
+
+static void encodeSiteRequest(qlibc::QData& request, bool cborRequest, string& body){
+    if(cborRequest){
+        qlibc::valueToCbor(request.value(), body);
+    }else{
+        request.toJsonString(body);
+    }
+}
+
+static void decodeSiteResponse(const httplib::Response& result, qlibc::QData& response){
+    Json::Value value;
+    qlibc::parseBody(result.body, result.get_header_value("Content-Type"), value);
+    response.setInitValue(std::move(value));
+}
+
+//请求体默认为JSON，cborRequest为true时按CBOR编码（对方需支持）；声明可接收CBOR响应，按响应的Content-Type解码
+static bool postToSite(httplib::Client& client, qlibc::QData& request, qlibc::QData& response, bool cborRequest){
+    //每个线程复用同一个序列化缓冲区
+    thread_local string body;
+    encodeSiteRequest(request, cborRequest, body);
+    httplib::Result result =  client.Post("/", siteRequestHeaders(), body, cborRequest ? qlibc::CborContentType : "text/json");
     if(result != nullptr){
-        response.setInitData(qlibc::QData(result.value().body));
+        decodeSiteResponse(result.value(), response);
         return true;
     }
-    LOG_RED << "-->http Error: " << to_string(result.error());
+    LOG_RED_RATE(10) << "-->http Error: " << to_string(result.error());
     return false;
 }
 
+static AsyncRequest makeSiteAsyncRequest(const string& ip, int port, bool cborRequest, int timeoutMs){
+    AsyncRequest asyncRequest;
+    asyncRequest.host = ip;
+    asyncRequest.port = port;
+    asyncRequest.headers = siteRequestHeaders();
+    asyncRequest.content_type = cborRequest ? qlibc::CborContentType : "text/json";
+    asyncRequest.timeout_msec = timeoutMs;
+    return asyncRequest;
+}
+
+//异步版本，编码方式同postToSite
+static AsyncClient::RequestId postToSiteAsync(const string& ip, int port, qlibc::QData& request, bool cborRequest,
+                                              SiteResponseCallback callback, int timeoutMs){
+    AsyncRequest asyncRequest = makeSiteAsyncRequest(ip, port, cborRequest, timeoutMs);
+    encodeSiteRequest(request, cborRequest, asyncRequest.body);
+
+    return AsyncClient::shared().send(std::move(asyncRequest), [callback](AsyncResult& result){
+        qlibc::QData response;
+        if(result){
+            decodeSiteResponse(result.response, response);
+        }else{
+            LOG_RED_RATE(10) << "-->http Error: " << to_string(result.error);
+        }
+        if(callback){
+            callback(static_cast<bool>(result), response);
+        }
+    });
+}
+
+bool httpUtil::sitePostRequest(const string& ip, int port, qlibc::QData& request, qlibc::QData& response){
+    httplib::Client client(ip, port);
+    client.set_connection_timeout(1, 0);
+    client.set_read_timeout(2, 0);
+    return postToSite(client, request, response, false);
+}
+
+AsyncClient::RequestId httpUtil::sitePostRequestAsync(const string& ip, int port, qlibc::QData& request,
+                                                      SiteResponseCallback callback, int timeoutMs){
+    return postToSiteAsync(ip, port, request, false, std::move(callback), timeoutMs);
+}
 
-SingleSite::SingleSite(string ip, int port) {
+
+SingleSite::SingleSite(string ip, int port, bool cbor) {
     siteIp = std::move(ip);
     sitePort = port;
+    cborRequest = cbor;
 }
 
 bool SingleSite::send(qlibc::QData &request, qlibc::QData &response) {
     httplib::Client cli(siteIp, sitePort);
     cli.set_connection_timeout(1, 0);
     cli.set_read_timeout(2, 0);
-    httplib::Result result =  cli.Post("/", request.toJsonString(), "text/json");
-    if(result != nullptr){
-       response.setInitData(qlibc::QData(result.value().body));
-       return true;
-    }
-    LOG_RED << "-->http Error: " << to_string(result.error());
-    return false;
+    return postToSite(cli, request, response, cborRequest);
+}
+
+AsyncClient::RequestId SingleSite::sendAsync(qlibc::QData& request, SiteResponseCallback callback, int timeoutMs){
+    return postToSiteAsync(siteIp, sitePort, request, cborRequest, std::move(callback), timeoutMs);
 }
 
 void SingleSite::deleteClient(){
 }
 
-string SingleSite::getSiteIp(){
+string SingleSite::getSiteIp() const{
     return siteIp;
 }
 
-int SingleSite::getSitePort(){
+int SingleSite::getSitePort() const{
     return sitePort;
 }
 
-SiteRecord* SiteRecord::instance = nullptr;
+bool SingleSite::getCborRequest() const{
+    return cborRequest;
+}
+
+const SingleSite* SiteTable::find(const string& siteName) const{
+    if(slots.empty()){
+        return nullptr;
+    }
+    size_t hash = std::hash<string>()(siteName);
+    for(size_t i = hash & mask; ; i = (i + 1) & mask){
+        uint32_t slot = slots[i];
+        if(slot == 0){
+            return nullptr;
+        }
+        const Entry& entry = entries[slot - 1];
+        if(entry.hash == hash && *entry.name == siteName){
+            return &entry.site;
+        }
+    }
+}
+
+//站点名数量有限，驻留后不释放
+const string* SiteRecord::internSiteName(const string& siteName){
+    static std::mutex internMutex;
+    static std::unordered_set<string> names;
+    std::lock_guard<std::mutex> lg(internMutex);
+    return &*names.insert(siteName).first;
+}
+
+SiteRecord::SiteRecord() : table(nullptr){
+    SiteTable* emptyTable = new SiteTable();
+    emptyTable->names = std::make_shared<const std::vector<string>>();
+    table.store(emptyTable);
+}
 
- SiteRecord *SiteRecord::getInstance() {
-    if(instance == nullptr){
-        instance = new SiteRecord();
+SiteRecord::~SiteRecord(){
+    delete table.load();
+    for(auto& item : retiredList){
+        delete item.first;
     }
+}
+
+SiteRecord *SiteRecord::getInstance() {
+    //局部静态变量的初始化是线程安全的；不析构，进程退出时其它线程可能仍在使用
+    static SiteRecord* instance = new SiteRecord();
     return instance;
 }
 
-void SiteRecord::addSite(string siteName, string siteIp, int sitePort) {
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
-    auto pos = sites.find(siteName);
-    if(pos != sites.end()){
-        if(pos->second.getSiteIp() == siteIp && pos->second.getSitePort() == sitePort){
-            return;
+void SiteRecord::updateTable(const std::function<bool(std::vector<SiteTable::Entry>& entries)>& modify){
+    std::lock_guard<std::mutex> lg(writeMutex);
+
+    std::unique_ptr<SiteTable> newTable(new SiteTable());
+    newTable->entries = table.load()->entries;
+    if(!modify(newTable->entries)){
+        return;
+    }
+
+    std::sort(newTable->entries.begin(), newTable->entries.end(),
+              [](const SiteTable::Entry& a, const SiteTable::Entry& b){ return *a.name < *b.name; });
+
+    std::shared_ptr<std::vector<string>> names = std::make_shared<std::vector<string>>();
+    names->reserve(newTable->entries.size());
+    for(auto& entry : newTable->entries){
+        names->push_back(*entry.name);
+    }
+    newTable->names = std::move(names);
+
+    size_t capacity = 8;
+    while(capacity < newTable->entries.size() * 2){
+        capacity *= 2;
+    }
+    newTable->slots.assign(capacity, 0);
+    newTable->mask = capacity - 1;
+    for(size_t i = 0; i < newTable->entries.size(); ++i){
+        size_t pos = newTable->entries[i].hash & newTable->mask;
+        while(newTable->slots[pos] != 0){
+            pos = (pos + 1) & newTable->mask;
+        }
+        newTable->slots[pos] = static_cast<uint32_t>(i + 1);
+    }
+
+    const SiteTable* oldTable = table.exchange(newTable.release());
+    retiredList.emplace_back(oldTable, qlibc::epochRetire());
+
+    uint64_t minActive = qlibc::epochMinActive();
+    size_t kept = 0;
+    for(auto& item : retiredList){
+        if(item.second <= minActive){
+            delete item.first;
         }else{
-            pos->second.deleteClient();
-            sites.erase(siteName);
-            sites.emplace(siteName, SingleSite(siteIp, sitePort));
+            retiredList[kept++] = item;
         }
-    }else{
-        sites.emplace(siteName, SingleSite(siteIp, sitePort));
     }
+    retiredList.resize(kept);
 }
 
-void SiteRecord::removeSite(string siteName) {
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
-    auto pos = sites.find(siteName);
-    if(pos != sites.end()){
-        pos->second.deleteClient();
-        sites.erase(pos);
+void SiteRecord::upsertEntry(std::vector<SiteTable::Entry>& entries, const SiteAddress& address, bool& changed){
+    for(auto& entry : entries){
+        if(*entry.name == address.siteName){
+            if(entry.site.getSiteIp() != address.siteIp || entry.site.getSitePort() != address.sitePort ||
+               entry.site.getCborRequest() != address.cborRequest){
+                entry.site = SingleSite(address.siteIp, address.sitePort, address.cborRequest);
+                changed = true;
+            }
+            return;
+        }
     }
+    entries.push_back(SiteTable::Entry{internSiteName(address.siteName), std::hash<string>()(address.siteName),
+                                       SingleSite(address.siteIp, address.sitePort, address.cborRequest)});
+    changed = true;
 }
 
-void SiteRecord::removeSitesNonExist(std::map<string, Json::Value>& sitesMap){
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
-    for(auto pos = sites.begin(); pos != sites.end();){
-        if(sitesMap.find(pos->first) == sitesMap.end()){
-            pos->second.deleteClient();
-            pos = sites.erase(pos);
-        }else{
-            pos++;
+void SiteRecord::addSite(string siteName, string siteIp, int sitePort, bool cborRequest) {
+    SiteAddress address;
+    address.siteName = std::move(siteName);
+    address.siteIp = std::move(siteIp);
+    address.sitePort = sitePort;
+    address.cborRequest = cborRequest;
+
+    //没有变化时不复制快照
+    {
+        qlibc::EpochReadGuard guard;
+        const SingleSite* site = table.load()->find(address.siteName);
+        if(site != nullptr && site->getCborRequest() == cborRequest &&
+           site->getSitePort() == sitePort && site->getSiteIp() == address.siteIp){
+            return;
         }
     }
+
+    updateTable([&](std::vector<SiteTable::Entry>& entries){
+        bool changed = false;
+        upsertEntry(entries, address, changed);
+        return changed;
+    });
+}
+
+void SiteRecord::addSites(const std::vector<SiteAddress>& siteList) {
+    updateTable([&](std::vector<SiteTable::Entry>& entries){
+        bool changed = false;
+        for(auto& address : siteList){
+            upsertEntry(entries, address, changed);
+        }
+        return changed;
+    });
+}
+
+void SiteRecord::removeSite(string siteName) {
+    updateTable([&](std::vector<SiteTable::Entry>& entries){
+        for(auto pos = entries.begin(); pos != entries.end(); ++pos){
+            if(*pos->name == siteName){
+                entries.erase(pos);
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+void SiteRecord::removeSitesNonExist(std::map<string, Json::Value>& sitesMap){
+    updateTable([&](std::vector<SiteTable::Entry>& entries){
+        size_t kept = 0;
+        for(size_t i = 0; i < entries.size(); ++i){
+            if(sitesMap.find(*entries[i].name) != sitesMap.end()){
+                if(kept != i){
+                    entries[kept] = std::move(entries[i]);
+                }
+                ++kept;
+            }
+        }
+        bool changed = kept != entries.size();
+        entries.erase(entries.begin() + kept, entries.end());
+        return changed;
+    });
  }
 
 
 bool SiteRecord::sendRequest2Site(string siteName, qlibc::QData &request, qlibc::QData &response) {
-    bool canSend{false};
     SingleSite site;
     {
-        std::lock_guard<std::recursive_mutex> lg(rMutex);
-        auto pos = sites.find(siteName);
-        if(pos != sites.end()){
-            site = pos->second;
-            canSend = true;
+        qlibc::EpochReadGuard guard;
+        const SingleSite* found = table.load()->find(siteName);
+        if(found == nullptr){
+            return false;
         }
+        site = *found;
     }
-    if(canSend){
-        return site.send(request, response);
+    return site.send(request, response);
+}
+
+bool SiteRecord::sendRequest2SiteAsync(const string& siteName, qlibc::QData& request, SiteResponseCallback callback,
+                                       int timeoutMs) {
+    SingleSite site;
+    {
+        qlibc::EpochReadGuard guard;
+        const SingleSite* found = table.load()->find(siteName);
+        if(found == nullptr){
+            return false;
+        }
+        site = *found;
     }
-    return false;
+    site.sendAsync(request, std::move(callback), timeoutMs);
+    return true;
+}
+
+std::vector<SiteResult> SiteRecord::scatterGather(const std::vector<string>& siteNames, qlibc::QData& request,
+                                                  int deadlineMs, const SiteResultCallback& onResult) {
+    std::vector<SiteResult> results(siteNames.size());
+    std::vector<AsyncRequest> asyncRequests;
+    std::vector<size_t> resultIndex;        //asyncRequests[i]的结果在results[resultIndex[i]]
+    asyncRequests.reserve(siteNames.size());
+    resultIndex.reserve(siteNames.size());
+
+    string body[2];                         //[0] JSON, [1] CBOR，用到时才编码
+    bool encoded[2] = {false, false};
+    {
+        qlibc::EpochReadGuard guard;
+        const SiteTable* current = table.load();
+        for(size_t i = 0; i < siteNames.size(); ++i){
+            results[i].siteName = siteNames[i];
+            const SingleSite* site = current->find(siteNames[i]);
+            if(site == nullptr){
+                continue;
+            }
+
+            bool cbor = site->getCborRequest();
+            if(!encoded[cbor]){
+                encodeSiteRequest(request, cbor, body[cbor]);
+                encoded[cbor] = true;
+            }
+            asyncRequests.push_back(makeSiteAsyncRequest(site->getSiteIp(), site->getSitePort(), cbor, deadlineMs));
+            asyncRequests.back().body = body[cbor];
+            resultIndex.push_back(i);
+        }
+    }
+
+    //每个结果只由事件线程写一次，send_all返回前所有回调都已结束
+    AsyncClient::shared().send_all(std::move(asyncRequests), deadlineMs, [&](size_t i, const AsyncResult& asyncResult){
+        SiteResult& result = results[resultIndex[i]];
+        result.error = asyncResult.error;
+        result.latencyUs = asyncResult.latency_usec;
+        if(asyncResult){
+            decodeSiteResponse(asyncResult.response, result.response);
+        }
+        if(onResult){
+            onResult(result);
+        }
+    });
+
+    return results;
+}
+
+std::vector<SiteResult> SiteRecord::broadcast(qlibc::QData& request, int deadlineMs, const SiteResultCallback& onResult) {
+    std::vector<string> siteNames;
+    {
+        qlibc::EpochReadGuard guard;
+        const SiteTable* current = table.load();
+        siteNames.reserve(current->entries.size());
+        for(auto& entry : current->entries){
+            siteNames.push_back(*entry.name);
+        }
+    }
+    return scatterGather(siteNames, request, deadlineMs, onResult);
 }
 
 void SiteRecord::printMap() {
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
+    qlibc::EpochReadGuard guard;
     LOG_INFO << "sites:";
-    for(auto& elem :sites){
-        LOG_INFO << elem.first << ": <" << elem.second.getSiteIp() << ", " << elem.second.getSitePort() << ">";
+    for(auto& entry : table.load()->entries){
+        LOG_INFO << *entry.name << ": <" << entry.site.getSiteIp() << ", " << entry.site.getSitePort() << ">";
     }
 }
 
+std::shared_ptr<const std::vector<string>> SiteRecord::getSiteNameList() {
+    qlibc::EpochReadGuard guard;
+    return table.load()->names;
+}
+
 std::set<string> SiteRecord::getSiteName() {
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
-    std::set<string> siteNameSet;
-    for(auto& elem : sites){
-       siteNameSet.insert(elem.first);
-    }
-    return siteNameSet;
+    std::shared_ptr<const std::vector<string>> names = getSiteNameList();
+    //已排序，逐个插入到末尾
+    return std::set<string>(names->begin(), names->end());
 }
 
 bool SiteRecord::getSiteInfo(const string& siteName, string& ip, int& port){
-    std::lock_guard<std::recursive_mutex> lg(rMutex);
-    auto pos = sites.find(siteName);
-    if(pos != sites.end()){
-        ip = pos->second.getSiteIp();
-        port = pos->second.getSitePort();
+    qlibc::EpochReadGuard guard;
+    const SingleSite* site = table.load()->find(siteName);
+    if(site != nullptr){
+        ip = site->getSiteIp();
+        port = site->getSitePort();
         return true;
     }
     return false;
  }
-
@@ -5,18 +5,34 @@
 #ifndef EXHIBITION_HTTPUTIL_H
 #define EXHIBITION_HTTPUTIL_H
 
+#include <atomic>
 #include <string>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "http/httplib.h"
+#include "http/async_client.h"
 #include "qlibc/QData.h"
 #include <vector>
 
 using namespace httplib;
 using namespace std;
 
+//异步请求完成时的回调，在异步客户端的事件线程中执行，不能阻塞；ok为false时response为空
+using SiteResponseCallback = std::function<void(bool ok, qlibc::QData& response)>;
+
 class httpUtil {
 public:
+    //同步请求的连接超时1秒、读超时2秒，异步请求的默认总时限与之相同
+    static const int SITE_REQUEST_TIMEOUT_MS = 3000;
+
     static bool sitePostRequest(const string& ip, int port, qlibc::QData& request, qlibc::QData& response);
 
+    //异步请求，不阻塞调用线程；请求体在调用线程中序列化，返回后request可以释放
+    static AsyncClient::RequestId sitePostRequestAsync(const string& ip, int port, qlibc::QData& request,
+                                                       SiteResponseCallback callback,
+                                                       int timeoutMs = SITE_REQUEST_TIMEOUT_MS);
+
 };
 
 
@@ -24,35 +40,102 @@ class SingleSite{
 private:
     string siteIp;
     int    sitePort{};
+    bool   cborRequest{};       //请求体用CBOR编码，只对支持CBOR的站点开启
 public:
     SingleSite() = default;
 
-    explicit SingleSite(string ip, int port);
+    explicit SingleSite(string ip, int port, bool cbor = false);
 
     SingleSite& operator= (const SingleSite& other)= default;
 
-    //向站点发送请求
+    //向站点发送请求，站点返回CBOR时按CBOR解码
     bool send(qlibc::QData& request, qlibc::QData& response);
 
+    //异步发送，同send
+    AsyncClient::RequestId sendAsync(qlibc::QData& request, SiteResponseCallback callback,
+                                     int timeoutMs = httpUtil::SITE_REQUEST_TIMEOUT_MS);
+
     //释放客户端
     void deleteClient();
 
-    string getSiteIp();
+    string getSiteIp() const;
+
+    int getSitePort() const;
+
+    bool getCborRequest() const;
+};
+
+
+//scatterGather中单个站点的结果
+struct SiteResult{
+    string siteName;
+    //Success表示收到响应；Unknown表示站点未登记；其余同AsyncResult（超时为ConnectionTimeout或Read）
+    httplib::Error error = httplib::Error::Unknown;
+    int64_t latencyUs = 0;          //发出到收到响应（或失败）的时间
+    qlibc::QData response;
 
-    int getSitePort();
+    bool ok() const{
+        return error == httplib::Error::Success;
+    }
 };
 
+//结果到达时的回调，在异步客户端的事件线程中执行，不能阻塞
+using SiteResultCallback = std::function<void(const SiteResult& result)>;
+
+//批量登记时的一个站点
+struct SiteAddress{
+    string siteName;
+    string siteIp;
+    int    sitePort = 0;
+    bool   cborRequest = false;
+};
 
-using SingleSiteVec = std::map<string, SingleSite>;
+//站点表快照，发布后只读
+struct SiteTable{
+    struct Entry{
+        const string* name;         //驻留的站点名，所有快照共用
+        size_t hash;
+        SingleSite site;
+    };
+    std::vector<Entry> entries;     //按站点名排序
+    std::vector<uint32_t> slots;    //开放寻址索引，存entries下标+1，0为空；容量为2的幂，负载不超过1/2
+    size_t mask = 0;
+    std::shared_ptr<const std::vector<string>> names;   //排序的站点名，随快照生成，快照释放后持有者仍可使用
+
+    const SingleSite* find(const string& siteName) const;
+};
+
+/*
+ * 站点表
+ *      查找（请求路由）不加锁：站点表是不可变快照，通过原子指针发布，读者在epoch保护下读取（qlibc/Epoch.h）
+ *      增删复制当前快照修改后整体替换，写者之间串行；批量接口只生成一次新快照
+ *      旧快照在没有读者后释放
+ */
 class SiteRecord{
 private:
-    SingleSiteVec sites;
-    std::recursive_mutex rMutex;
-    static SiteRecord* instance;
+    std::atomic<const SiteTable*> table;
+    std::mutex writeMutex;      //保护 快照替换、retiredList
+    std::vector<std::pair<const SiteTable*, uint64_t>> retiredList;
+
+    SiteRecord();
+
+    //复制当前快照交给modify修改，modify返回true时发布新快照
+    void updateTable(const std::function<bool(std::vector<SiteTable::Entry>& entries)>& modify);
+    static void upsertEntry(std::vector<SiteTable::Entry>& entries, const SiteAddress& address, bool& changed);
+    static const string* internSiteName(const string& siteName);
 public:
+    ~SiteRecord();
+
+    SiteRecord(const SiteRecord&) = delete;
+    SiteRecord& operator=(const SiteRecord&) = delete;
+
     static SiteRecord* getInstance();
 
-    void addSite(string siteName, string siteIp, int sitePort);
+    //cborRequest：该站点支持CBOR请求时，请求体用CBOR编码
+    void addSite(string siteName, string siteIp, int sitePort, bool cborRequest = false);
+
+    //批量登记
+    void addSites(const std::vector<SiteAddress>& siteList);
 
     void removeSite(string siteName);
 
@@ -61,8 +144,29 @@ public:
 
     bool sendRequest2Site(string siteName, qlibc::QData& request, qlibc::QData& response);
 
+    //异步发送，站点不存在时返回false且不回调
+    bool sendRequest2SiteAsync(const string& siteName, qlibc::QData& request, SiteResponseCallback callback,
+                               int timeoutMs = httpUtil::SITE_REQUEST_TIMEOUT_MS);
+
+    /*
+     * 同一请求并发发给siteNames中的站点（复用连接池），最多等待deadlineMs后返回
+     * 结果与siteNames一一对应，截止时未响应的站点为超时；onResult在每个结果到达时回调，可用于提前处理部分结果
+     * 请求体按JSON、CBOR各最多编码一次
+     */
+    std::vector<SiteResult> scatterGather(const std::vector<string>& siteNames, qlibc::QData& request,
+                                          int deadlineMs = httpUtil::SITE_REQUEST_TIMEOUT_MS,
+                                          const SiteResultCallback& onResult = nullptr);
+
+    //发给所有已登记的站点，同scatterGather
+    std::vector<SiteResult> broadcast(qlibc::QData& request, int deadlineMs = httpUtil::SITE_REQUEST_TIMEOUT_MS,
+                                      const SiteResultCallback& onResult = nullptr);
+
     void printMap();
 
+    //已登记站点名（排序），返回当前快照生成时的列表，不复制
+    std::shared_ptr<const std::vector<string>> getSiteNameList();
+
+    //同getSiteNameList，每次复制为set
     std::set<string> getSiteName();
 
     bool getSiteInfo(const string& siteName, string& ip, int& port);
@@ -0,0 +1,674 @@
+#include "async_client.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+
+namespace httplib {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const uint64_t WAKE_EVENT = 0; // epoll data of the eventfd; request ids start at 1
+
+bool resolve(const std::string &host, int port, sockaddr_storage &addr,
+             socklen_t &addr_len) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+  auto service = std::to_string(port);
+  struct addrinfo *result = nullptr;
+  // Site addresses are numeric; only other names go through DNS
+  if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+    hints.ai_flags = AI_NUMERICSERV;
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0) {
+      return false;
+    }
+  }
+
+  memcpy(&addr, result->ai_addr, result->ai_addrlen);
+  addr_len = result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+bool header_has_token(const Headers &headers, const char *key,
+                      const char *token) {
+  auto it = headers.find(key);
+  if (it == headers.end()) { return false; }
+  std::string value = it->second;
+  for (auto &c : value) {
+    c = static_cast<char>(::tolower(c));
+  }
+  return value.find(token) != std::string::npos;
+}
+
+// A pooled connection is usable when nothing, not even EOF, is readable
+bool is_idle_connection_alive(int fd) {
+  char c;
+  auto n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+} // namespace
+
+struct AsyncClient::Pending {
+  enum class BodyMode { None, Length, Chunked, UntilClose };
+
+  RequestId id = 0;
+  Callback callback;
+  std::string key; // host:port, connection pool key
+  sockaddr_storage addr;
+  socklen_t addr_len = 0;
+  std::string output;
+  size_t output_off = 0;
+  bool head = false;
+  Clock::time_point start;
+  Clock::time_point deadline;
+
+  int fd = -1;
+  bool connecting = false;
+  bool reused = false;
+  bool retried = false;
+
+  std::string input;
+  bool headers_done = false;
+  size_t body_start = 0;
+  BodyMode body_mode = BodyMode::None;
+  size_t content_length = 0;
+  size_t chunk_off = 0; // next chunk-size line in input
+  bool keep_alive = true;
+  Response response;
+};
+
+struct AsyncClient::Loop {
+  std::unordered_map<RequestId, std::unique_ptr<Pending>> active;
+  std::set<std::pair<Clock::time_point, RequestId>> deadlines;
+  std::unordered_map<std::string, std::vector<int>> idle;
+};
+
+AsyncClient::AsyncClient(size_t max_idle_connections_per_host)
+    : max_idle_per_host_(max_idle_connections_per_host), loop_(new Loop) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (epoll_fd_ < 0 || event_fd_ < 0) {
+    stopped_ = true;
+    return;
+  }
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = WAKE_EVENT;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev);
+
+  thread_ = std::thread(&AsyncClient::run, this);
+}
+
+AsyncClient::~AsyncClient() {
+  stop();
+  if (event_fd_ >= 0) { close(event_fd_); }
+  if (epoll_fd_ >= 0) { close(epoll_fd_); }
+}
+
+AsyncClient &AsyncClient::shared() {
+  // Never destroyed: callbacks may still be running while statics go away
+  static AsyncClient *client = new AsyncClient();
+  return *client;
+}
+
+AsyncClient::RequestId AsyncClient::send(AsyncRequest req,
+                                         Callback callback) {
+  std::unique_ptr<Pending> p(new Pending);
+  p->start = Clock::now();
+  p->deadline = p->start + std::chrono::milliseconds(req.timeout_msec);
+  p->callback = std::move(callback);
+  p->key = req.host + ":" + std::to_string(req.port);
+  p->head = req.method == "HEAD";
+
+  AsyncResult failed;
+  if (!resolve(req.host, req.port, p->addr, p->addr_len)) {
+    failed.error = Error::Connection;
+    if (p->callback) { p->callback(failed); }
+    return 0;
+  }
+
+  auto &out = p->output;
+  out.reserve(req.body.size() + 256);
+  out += req.method;
+  out += ' ';
+  out += req.path.empty() ? "/" : req.path;
+  out += " HTTP/1.1\r\nHost: ";
+  out += p->key;
+  out += "\r\n";
+  for (const auto &header : req.headers) {
+    out += header.first;
+    out += ": ";
+    out += header.second;
+    out += "\r\n";
+  }
+  if (!req.content_type.empty() &&
+      req.headers.find("Content-Type") == req.headers.end()) {
+    out += "Content-Type: ";
+    out += req.content_type;
+    out += "\r\n";
+  }
+  if (!req.body.empty() || req.method == "POST" || req.method == "PUT" ||
+      req.method == "PATCH") {
+    out += "Content-Length: ";
+    out += std::to_string(req.body.size());
+    out += "\r\n";
+  }
+  out += "\r\n";
+  out += req.body;
+
+  RequestId id;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (stopped_) {
+      id = 0;
+    } else {
+      id = next_id_++;
+      p->id = id;
+      outstanding_.insert(id);
+      Command command;
+      command.pending = std::move(p);
+      commands_.push_back(std::move(command));
+    }
+  }
+
+  if (id == 0) {
+    failed.error = Error::Canceled;
+    if (p->callback) { p->callback(failed); }
+    return 0;
+  }
+
+  wake();
+  return id;
+}
+
+std::future<AsyncResult> AsyncClient::send(AsyncRequest req) {
+  auto promise = std::make_shared<std::promise<AsyncResult>>();
+  auto future = promise->get_future();
+  send(std::move(req), [promise](AsyncResult &result) {
+    promise->set_value(std::move(result));
+  });
+  return future;
+}
+
+bool AsyncClient::cancel(RequestId id) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (outstanding_.find(id) == outstanding_.end()) { return false; }
+    Command command;
+    command.cancel_id = id;
+    commands_.push_back(std::move(command));
+  }
+  wake();
+  return true;
+}
+
+std::vector<AsyncResult> AsyncClient::send_all(std::vector<AsyncRequest> reqs,
+                                               time_t deadline_msec,
+                                               ResultHandler on_result) {
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t remaining;
+    std::vector<AsyncResult> results;
+  };
+  auto state = std::make_shared<State>();
+  state->remaining = reqs.size();
+  state->results.resize(reqs.size());
+
+  auto deadline = Clock::now() + std::chrono::milliseconds(deadline_msec);
+  std::vector<RequestId> ids;
+  ids.reserve(reqs.size());
+
+  for (size_t i = 0; i < reqs.size(); i++) {
+    reqs[i].timeout_msec = (std::min)(reqs[i].timeout_msec, deadline_msec);
+    ids.push_back(
+        send(std::move(reqs[i]), [state, i, on_result](AsyncResult &result) {
+          if (on_result) { on_result(i, result); }
+          std::lock_guard<std::mutex> guard(state->mutex);
+          state->results[i] = std::move(result);
+          if (--state->remaining == 0) { state->cond.notify_all(); }
+        }));
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  // Every request times out by the deadline; the margin only covers timer
+  // granularity. Whatever is still running after it is canceled.
+  if (!state->cond.wait_until(lock, deadline + std::chrono::milliseconds(100),
+                              [&] { return state->remaining == 0; })) {
+    lock.unlock();
+    for (auto id : ids) {
+      if (id != 0) { cancel(id); }
+    }
+    lock.lock();
+    state->cond.wait(lock, [&] { return state->remaining == 0; });
+  }
+
+  return std::move(state->results);
+}
+
+void AsyncClient::stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopped_ = true;
+  }
+  wake();
+
+  if (thread_.joinable()) {
+    if (thread_.get_id() == std::this_thread::get_id()) {
+      thread_.detach();
+    } else {
+      thread_.join();
+    }
+  }
+}
+
+size_t AsyncClient::in_flight() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return outstanding_.size();
+}
+
+void AsyncClient::wake() {
+  if (event_fd_ < 0) { return; }
+  uint64_t one = 1;
+  auto n = write(event_fd_, &one, sizeof(one));
+  (void)n;
+}
+
+void AsyncClient::run() {
+  std::vector<epoll_event> events(256);
+  auto &loop = *loop_;
+
+  while (true) {
+    std::deque<Command> commands;
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      commands.swap(commands_);
+      stopping = stopped_;
+    }
+
+    for (auto &command : commands) {
+      if (command.pending) {
+        start_pending(std::move(command.pending));
+      } else {
+        complete(command.cancel_id, Error::Canceled);
+      }
+    }
+
+    if (stopping) {
+      std::vector<RequestId> ids;
+      for (const auto &x : loop.active) {
+        ids.push_back(x.first);
+      }
+      for (auto id : ids) {
+        complete(id, Error::Canceled);
+      }
+      for (auto &x : loop.idle) {
+        for (auto fd : x.second) {
+          close(fd);
+        }
+      }
+      loop.idle.clear();
+      break;
+    }
+
+    auto now = Clock::now();
+    while (!loop.deadlines.empty() && loop.deadlines.begin()->first <= now) {
+      auto id = loop.deadlines.begin()->second;
+      const auto &p = *loop.active[id];
+      complete(id, p.fd < 0 || p.connecting ? Error::ConnectionTimeout
+                                            : Error::Read);
+    }
+
+    int timeout = -1;
+    if (!loop.deadlines.empty()) {
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+          loop.deadlines.begin()->first - now);
+      timeout = static_cast<int>(wait.count()) + 1;
+    }
+
+    auto n = epoll_wait(epoll_fd_, events.data(),
+                        static_cast<int>(events.size()), timeout);
+    for (int i = 0; i < n; i++) {
+      auto id = events[i].data.u64;
+      if (id == WAKE_EVENT) {
+        uint64_t count;
+        auto r = read(event_fd_, &count, sizeof(count));
+        (void)r;
+        continue;
+      }
+      // Completed earlier in this batch
+      auto it = loop.active.find(id);
+      if (it == loop.active.end()) { continue; }
+      on_event(*it->second, events[i].events);
+    }
+  }
+}
+
+void AsyncClient::start_pending(std::unique_ptr<Pending> pending) {
+  auto &p = *pending;
+  auto id = p.id;
+  loop_->deadlines.emplace(p.deadline, id);
+  loop_->active.emplace(id, std::move(pending));
+
+  if (!open_connection(p)) { complete(id, Error::Connection); }
+}
+
+// Registers for EPOLLOUT; the first event finishes the connect (if any) and
+// starts writing the request
+bool AsyncClient::open_connection(Pending &p) {
+  p.fd = -1;
+
+  if (!p.retried) {
+    auto it = loop_->idle.find(p.key);
+    while (it != loop_->idle.end() && !it->second.empty()) {
+      auto fd = it->second.back();
+      it->second.pop_back();
+      if (is_idle_connection_alive(fd)) {
+        p.fd = fd;
+        p.reused = true;
+        p.connecting = false;
+        break;
+      }
+      close(fd);
+    }
+  }
+
+  if (p.fd < 0) {
+    auto fd = socket(p.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                     0);
+    if (fd < 0) { return false; }
+
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    auto ret = connect(fd, reinterpret_cast<sockaddr *>(&p.addr), p.addr_len);
+    if (ret < 0 && errno != EINPROGRESS) {
+      close(fd);
+      return false;
+    }
+    p.fd = fd;
+    p.reused = false;
+    p.connecting = ret < 0;
+  }
+
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLOUT;
+  ev.data.u64 = p.id;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, p.fd, &ev) != 0) {
+    close(p.fd);
+    p.fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void AsyncClient::on_event(Pending &p, uint32_t events) {
+  auto id = p.id;
+  auto error = Error::Success;
+
+  if (p.connecting) {
+    if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) { return; }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      complete(id, Error::Connection);
+      return;
+    }
+    p.connecting = false;
+  }
+
+  if (p.output_off < p.output.size()) {
+    if (!flush_output(p)) {
+      error = Error::Write;
+    } else if (p.output_off == p.output.size()) {
+      epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.u64 = id;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, p.fd, &ev);
+    }
+  } else if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    auto eof = false;
+    if (!read_input(p, eof)) {
+      error = Error::Read;
+    } else {
+      auto ret = parse_response(p, eof);
+      if (ret > 0) {
+        complete(id, Error::Success);
+      } else if (ret < 0) {
+        error = Error::Read;
+      }
+    }
+  }
+
+  if (error == Error::Success) { return; }
+
+  // The server may have closed a pooled connection just before it was used
+  if (p.reused && !p.retried && p.input.empty() &&
+      Clock::now() < p.deadline) {
+    release_connection(p, false);
+    p.retried = true;
+    p.output_off = 0;
+    if (open_connection(p)) { return; }
+    error = Error::Connection;
+  }
+  complete(id, error);
+}
+
+bool AsyncClient::flush_output(Pending &p) {
+  while (p.output_off < p.output.size()) {
+    auto n = ::send(p.fd, p.output.data() + p.output_off,
+                    p.output.size() - p.output_off, MSG_NOSIGNAL);
+    if (n > 0) {
+      p.output_off += static_cast<size_t>(n);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AsyncClient::read_input(Pending &p, bool &eof) {
+  char buf[16 * 1024];
+  while (true) {
+    auto n = recv(p.fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      p.input.append(buf, static_cast<size_t>(n));
+    } else if (n == 0) {
+      eof = true;
+      return true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+
+// Returns 1 when the response is complete, 0 when more input is needed and
+// -1 on malformed or truncated input
+int AsyncClient::parse_response(Pending &p, bool eof) {
+  using BodyMode = Pending::BodyMode;
+  auto &in = p.input;
+  auto &res = p.response;
+
+  if (!p.headers_done) {
+    auto end = in.find("\r\n\r\n");
+    if (end == std::string::npos) { return eof ? -1 : 0; }
+
+    auto line_end = in.find("\r\n");
+    auto sp1 = in.find(' ');
+    if (in.compare(0, 5, "HTTP/") != 0 || sp1 == std::string::npos ||
+        sp1 > line_end) {
+      return -1;
+    }
+    res.version = in.substr(0, sp1);
+    res.status = atoi(in.c_str() + sp1 + 1);
+    auto sp2 = in.find(' ', sp1 + 1);
+    if (sp2 != std::string::npos && sp2 < line_end) {
+      res.reason = in.substr(sp2 + 1, line_end - sp2 - 1);
+    }
+
+    auto pos = line_end + 2;
+    while (pos < end) {
+      auto eol = in.find("\r\n", pos);
+      auto colon = in.find(':', pos);
+      if (colon != std::string::npos && colon < eol) {
+        auto value_begin = colon + 1;
+        while (value_begin < eol &&
+               (in[value_begin] == ' ' || in[value_begin] == '\t')) {
+          value_begin++;
+        }
+        auto value_end = eol;
+        while (value_end > value_begin &&
+               (in[value_end - 1] == ' ' || in[value_end - 1] == '\t')) {
+          value_end--;
+        }
+        res.headers.emplace(in.substr(pos, colon - pos),
+                            in.substr(value_begin, value_end - value_begin));
+      }
+      pos = eol + 2;
+    }
+
+    p.headers_done = true;
+    p.body_start = end + 4;
+
+    p.keep_alive = res.version == "HTTP/1.1";
+    if (header_has_token(res.headers, "Connection", "close")) {
+      p.keep_alive = false;
+    } else if (header_has_token(res.headers, "Connection", "keep-alive")) {
+      p.keep_alive = true;
+    }
+
+    if (p.head || res.status / 100 == 1 || res.status == 204 ||
+        res.status == 304) {
+      p.body_mode = BodyMode::None;
+    } else if (header_has_token(res.headers, "Transfer-Encoding",
+                                "chunked")) {
+      p.body_mode = BodyMode::Chunked;
+      p.chunk_off = p.body_start;
+    } else if (res.has_header("Content-Length")) {
+      p.body_mode = BodyMode::Length;
+      p.content_length = static_cast<size_t>(
+          strtoull(res.get_header_value("Content-Length").c_str(), nullptr, 10));
+    } else {
+      p.body_mode = BodyMode::UntilClose;
+      p.keep_alive = false;
+    }
+  }
+
+  switch (p.body_mode) {
+  case BodyMode::None:
+    if (in.size() > p.body_start) { p.keep_alive = false; }
+    return 1;
+
+  case BodyMode::Length:
+    if (in.size() - p.body_start < p.content_length) { return eof ? -1 : 0; }
+    res.body.assign(in, p.body_start, p.content_length);
+    if (in.size() - p.body_start > p.content_length) { p.keep_alive = false; }
+    return 1;
+
+  case BodyMode::UntilClose:
+    if (!eof) { return 0; }
+    res.body.assign(in, p.body_start, std::string::npos);
+    return 1;
+
+  case BodyMode::Chunked:
+    while (true) {
+      auto line_end = in.find("\r\n", p.chunk_off);
+      if (line_end == std::string::npos) { return eof ? -1 : 0; }
+
+      char *size_end = nullptr;
+      auto size = strtoull(in.c_str() + p.chunk_off, &size_end, 16);
+      if (size_end == in.c_str() + p.chunk_off) { return -1; }
+
+      if (size == 0) {
+        // Last chunk, optional trailers, then an empty line
+        if (in.find("\r\n\r\n", p.chunk_off) == std::string::npos) {
+          return eof ? -1 : 0;
+        }
+        return 1;
+      }
+
+      auto data = line_end + 2;
+      if (in.size() < data + size + 2) { return eof ? -1 : 0; }
+      res.body.append(in, data, size);
+      p.chunk_off = data + size + 2;
+    }
+  }
+  return -1;
+}
+
+void AsyncClient::complete(RequestId id, Error error) {
+  auto it = loop_->active.find(id);
+  if (it == loop_->active.end()) { return; }
+  std::unique_ptr<Pending> p = std::move(it->second);
+  loop_->active.erase(it);
+  loop_->deadlines.erase(std::make_pair(p->deadline, id));
+
+  if (p->fd >= 0) { release_connection(*p, error == Error::Success && p->keep_alive); }
+
+  AsyncResult result;
+  result.error = error;
+  if (error == Error::Success) { result.response = std::move(p->response); }
+  result.latency_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                            Clock::now() - p->start)
+                            .count();
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    outstanding_.erase(id);
+  }
+
+  if (p->callback) { p->callback(result); }
+}
+
+void AsyncClient::release_connection(Pending &p, bool reusable) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p.fd, nullptr);
+
+  if (reusable) {
+    auto &idle = loop_->idle[p.key];
+    if (idle.size() < max_idle_per_host_) {
+      idle.push_back(p.fd);
+      p.fd = -1;
+      return;
+    }
+  }
+
+  close(p.fd);
+  p.fd = -1;
+}
+
+} // namespace httplib
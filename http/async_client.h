@@ -0,0 +1,135 @@
+//
+//  async_client.h
+//
+//  Non-blocking HTTP/1.1 client driven by one epoll thread (Linux only)
+//
+
+#ifndef CPPHTTPLIB_ASYNC_CLIENT_H
+#define CPPHTTPLIB_ASYNC_CLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "httplib.h"
+
+namespace httplib {
+
+struct AsyncRequest {
+  std::string host;
+  int port = 80;
+  std::string method = "POST";
+  std::string path = "/";
+  Headers headers;
+  std::string body;
+  std::string content_type;
+  // Deadline for the whole exchange, connecting included
+  time_t timeout_msec = 3000;
+};
+
+struct AsyncResult {
+  // Success, Connection, ConnectionTimeout (deadline passed before the
+  // connection was up), Read, Write or Canceled
+  Error error = Error::Unknown;
+  Response response;
+  // From send() to completion
+  int64_t latency_usec = 0;
+
+  explicit operator bool() const { return error == Error::Success; }
+};
+
+/*
+ * Requests are handed to a single event-loop thread that connects, writes
+ * and parses responses with non-blocking sockets, so one thread keeps any
+ * number of requests in flight. Keep-alive connections are pooled per
+ * host:port; a request that fails on a reused connection before any byte
+ * of the response arrived is retried once on a new connection.
+ *
+ * Callbacks run on the loop thread and must not block; in particular they
+ * must not wait for another request of the same client.
+ *
+ * Host names other than numeric addresses are resolved in send(), on the
+ * calling thread.
+ */
+class AsyncClient {
+public:
+  using RequestId = uint64_t;
+  using Callback = std::function<void(AsyncResult &result)>;
+  using ResultHandler =
+      std::function<void(size_t index, const AsyncResult &result)>;
+
+  explicit AsyncClient(size_t max_idle_connections_per_host = 8);
+  ~AsyncClient();
+
+  AsyncClient(const AsyncClient &) = delete;
+  AsyncClient &operator=(const AsyncClient &) = delete;
+
+  // The callback is called exactly once. Returns 0 if the client is stopped
+  // or the host cannot be resolved; the callback has then already run.
+  RequestId send(AsyncRequest req, Callback callback);
+  std::future<AsyncResult> send(AsyncRequest req);
+
+  // Completes the request with Error::Canceled if it has not completed yet
+  bool cancel(RequestId id);
+
+  // Sends all requests at once and waits until every one has completed or
+  // deadline_msec has passed (each request's own timeout still applies).
+  // on_result is called on the loop thread as results arrive. Not to be
+  // called from a callback.
+  std::vector<AsyncResult> send_all(std::vector<AsyncRequest> reqs,
+                                    time_t deadline_msec,
+                                    ResultHandler on_result = nullptr);
+
+  // Cancels everything in flight and joins the loop thread
+  void stop();
+
+  size_t in_flight() const;
+
+  // Process-wide client, started on first use and never destroyed
+  static AsyncClient &shared();
+
+private:
+  struct Pending;
+  struct Command {
+    std::unique_ptr<Pending> pending; // new request when set
+    RequestId cancel_id = 0;
+  };
+
+  void run();
+  void start_pending(std::unique_ptr<Pending> pending);
+  bool open_connection(Pending &p);
+  void on_event(Pending &p, uint32_t events);
+  bool flush_output(Pending &p);
+  bool read_input(Pending &p, bool &eof);
+  int parse_response(Pending &p, bool eof);
+  void complete(RequestId id, Error error);
+  void release_connection(Pending &p, bool reusable);
+  void wake();
+
+  const size_t max_idle_per_host_;
+
+  int epoll_fd_ = -1;
+  int event_fd_ = -1;
+  std::thread thread_;
+
+  mutable std::mutex mutex_; // guards the members below
+  std::deque<Command> commands_;
+  std::unordered_set<RequestId> outstanding_;
+  RequestId next_id_ = 1;
+  bool stopped_ = false;
+
+  struct Loop;
+  std::unique_ptr<Loop> loop_; // only used on the loop thread
+};
+
+} // namespace httplib
+
+#endif // CPPHTTPLIB_ASYNC_CLIENT_H
@@ -1,4 +1,5 @@
 #include "httplib.h"
+#include "metrics/Metrics.h"
 namespace httplib {
 
 /*
@@ -7,6 +8,82 @@ namespace httplib {
 
 namespace detail {
 
+// Process-wide metrics shared by every Server, ClientImpl and ThreadPool,
+// rendered through metrics::Registry::global(). Updates are relaxed atomic
+// adds on per-thread shards, so the hot path never takes a lock.
+struct HttpMetrics {
+  static const int ErrorCount = static_cast<int>(Error::ConnectionTimeout) + 1;
+
+  metrics::Counter &server_connections;
+  metrics::Gauge &server_active_connections;
+  metrics::Histogram &server_connection_requests;
+  metrics::Counter *server_responses[6];
+  metrics::Gauge &pool_queued;
+  metrics::Gauge &pool_busy;
+  metrics::Histogram &pool_wait;
+  metrics::Counter &client_connections;
+  metrics::Histogram &client_duration;
+  metrics::Counter *client_requests[ErrorCount];
+
+  HttpMetrics()
+      : server_connections(metrics::Registry::global().counter(
+            "httplib_server_connections_total",
+            "Connections accepted by httplib servers")),
+        server_active_connections(metrics::Registry::global().gauge(
+            "httplib_server_active_connections",
+            "Connections currently open on httplib servers")),
+        server_connection_requests(metrics::Registry::global().histogram(
+            "httplib_server_connection_requests",
+            "Requests served per connection (keep-alive reuse)", "",
+            {1, 2, 5, 10, 20, 50, 100, 1000})),
+        pool_queued(metrics::Registry::global().gauge(
+            "httplib_threadpool_queued_jobs",
+            "Jobs waiting in httplib thread pools")),
+        pool_busy(metrics::Registry::global().gauge(
+            "httplib_threadpool_busy_workers",
+            "Thread pool workers running a job")),
+        pool_wait(metrics::Registry::global().histogram(
+            "httplib_threadpool_queue_wait_microseconds",
+            "Time a job waited in the thread pool queue")),
+        client_connections(metrics::Registry::global().counter(
+            "httplib_client_connections_total",
+            "Connections opened by httplib clients")),
+        client_duration(metrics::Registry::global().histogram(
+            "httplib_client_request_duration_microseconds",
+            "Client request duration, including connect")) {
+    static const char *classes[] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+    for (int i = 0; i < 6; i++) {
+      server_responses[i] = &metrics::Registry::global().counter(
+          "httplib_server_responses_total", "Responses written by status class",
+          metrics::Registry::label("code", classes[i]));
+    }
+    for (int i = 0; i < ErrorCount; i++) {
+      client_requests[i] = &metrics::Registry::global().counter(
+          "httplib_client_requests_total", "Client requests by result",
+          metrics::Registry::label("error", to_string(static_cast<Error>(i))));
+    }
+  }
+};
+
+HttpMetrics &http_metrics() {
+  static HttpMetrics *m = new HttpMetrics();
+  return *m;
+}
+
+void thread_pool_job_queued() { http_metrics().pool_queued.add(1); }
+
+void thread_pool_job_started(std::chrono::steady_clock::time_point queued_at) {
+  auto &m = http_metrics();
+  m.pool_queued.sub(1);
+  m.pool_busy.add(1);
+  m.pool_wait.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - queued_at)
+          .count()));
+}
+
+void thread_pool_job_finished() { http_metrics().pool_busy.sub(1); }
+
 bool is_hex(char c, int &v) {
   if (0x20 <= c && isdigit(c)) {
     v = c - '0';
@@ -550,6 +627,12 @@ public:
   void get_remote_ip_and_port(std::string &ip, int &port) const override;
   socket_t socket() const override;
 
+  // Bytes already read from the socket but not consumed, e.g. the next
+  // pipelined request
+  bool has_buffered_data() const {
+    return read_buff_off_ < read_buff_content_size_;
+  }
+
 private:
   socket_t sock_;
   time_t read_timeout_sec_;
@@ -589,10 +672,13 @@ private:
 };
 #endif
 
-bool keep_alive(socket_t sock, time_t keep_alive_timeout_sec) {
+bool keep_alive(const std::atomic<socket_t> &svr_sock, socket_t sock,
+                time_t keep_alive_timeout_sec) {
   using namespace std::chrono;
   auto start = steady_clock::now();
   while (true) {
+    // Idle keep-alive connections end as soon as the server stops
+    if (svr_sock == INVALID_SOCKET) { return false; }
     auto val = select_read(sock, 0, 10000);
     if (val < 0) {
       return false;
@@ -608,16 +694,18 @@ bool keep_alive(socket_t sock, time_t keep_alive_timeout_sec) {
   }
 }
 
-template <typename T>
+template <typename T, typename U>
 bool
 process_server_socket_core(const std::atomic<socket_t> &svr_sock, socket_t sock,
                            size_t keep_alive_max_count,
-                           time_t keep_alive_timeout_sec, T callback) {
+                           time_t keep_alive_timeout_sec, T callback,
+                           U has_buffered_data) {
   assert(keep_alive_max_count > 0);
   auto ret = false;
   auto count = keep_alive_max_count;
   while (svr_sock != INVALID_SOCKET && count > 0 &&
-         keep_alive(sock, keep_alive_timeout_sec)) {
+         (has_buffered_data() ||
+          keep_alive(svr_sock, sock, keep_alive_timeout_sec))) {
     auto close_connection = count == 1;
     auto connection_closed = false;
     ret = callback(close_connection, connection_closed);
@@ -634,13 +722,16 @@ process_server_socket(const std::atomic<socket_t> &svr_sock, socket_t sock,
                       time_t keep_alive_timeout_sec, time_t read_timeout_sec,
                       time_t read_timeout_usec, time_t write_timeout_sec,
                       time_t write_timeout_usec, T callback) {
+  // One stream per connection, so pipelined requests that were read ahead
+  // into its buffer are served instead of dropped
+  SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
+                    write_timeout_sec, write_timeout_usec);
   return process_server_socket_core(
       svr_sock, sock, keep_alive_max_count, keep_alive_timeout_sec,
       [&](bool close_connection, bool &connection_closed) {
-        SocketStream strm(sock, read_timeout_sec, read_timeout_usec,
-                          write_timeout_sec, write_timeout_usec);
         return callback(strm, close_connection, connection_closed);
-      });
+      },
+      [&]() { return strm.has_buffered_data(); });
 }
 
 bool process_client_socket(socket_t sock, time_t read_timeout_sec,
@@ -2839,7 +2930,23 @@ ssize_t SocketStream::write(const char *ptr, size_t size) {
       (std::min)(size, static_cast<size_t>((std::numeric_limits<int>::max)()));
 #endif
 
-  return send_socket(sock_, ptr, size, CPPHTTPLIB_SEND_FLAGS);
+  auto n = send_socket(sock_, ptr, size, CPPHTTPLIB_SEND_FLAGS);
+
+#ifndef _WIN32
+  // A non-blocking socket (Server::set_nonblocking_accept) takes only what
+  // fits in the send buffer; callers such as Stream::write(std::string)
+  // expect the whole buffer to be written, as on a blocking socket
+  size_t written = n > 0 ? static_cast<size_t>(n) : 0;
+  while ((n > 0 || errno == EAGAIN || errno == EWOULDBLOCK) && written < size) {
+    if (!is_writable()) { return -1; }
+    n = send_socket(sock_, ptr + written, size - written,
+                    CPPHTTPLIB_SEND_FLAGS);
+    if (n > 0) { written += static_cast<size_t>(n); }
+  }
+  if (written > 0) { return static_cast<ssize_t>(written); }
+#endif
+
+  return n;
 }
 
 void SocketStream::get_remote_ip_and_port(std::string &ip,
@@ -3048,6 +3155,31 @@ Server &Server::set_socket_options(SocketOptions socket_options) {
   return *this;
 }
 
+Server &Server::set_reuse_port(bool on) {
+  reuse_port_ = on;
+  return *this;
+}
+
+Server &Server::set_listen_backlog(int backlog) {
+  listen_backlog_ = backlog;
+  return *this;
+}
+
+Server &Server::set_acceptor_count(size_t count) {
+  acceptor_count_ = count;
+  return *this;
+}
+
+Server &Server::set_acceptor_cpu_affinity(bool on) {
+  acceptor_cpu_affinity_ = on;
+  return *this;
+}
+
+Server &Server::set_nonblocking_accept(bool on) {
+  nonblocking_accept_ = on;
+  return *this;
+}
+
 Server &Server::set_default_headers(Headers headers) {
   default_headers_ = std::move(headers);
   return *this;
@@ -3081,6 +3213,12 @@ Server &Server::set_idle_interval(time_t sec, time_t usec) {
   return *this;
 }
 
+Server &Server::set_drain_timeout(time_t sec, time_t usec) {
+  drain_timeout_sec_ = sec;
+  drain_timeout_usec_ = usec;
+  return *this;
+}
+
 Server &Server::set_payload_max_length(size_t length) {
   payload_max_length_ = length;
   return *this;
@@ -3102,13 +3240,20 @@ bool Server::listen(const char *host, int port, int socket_flags) {
 
 bool Server::is_running() const { return is_running_; }
 
+// Stops accepting; requests already being processed are finished by
+// listen() before it returns (see drain_connections). Safe to call twice.
 void Server::stop() {
-  if (is_running_) {
-    assert(svr_sock_ != INVALID_SOCKET);
-    std::atomic<socket_t> sock(svr_sock_.exchange(INVALID_SOCKET));
+  std::atomic<socket_t> sock(svr_sock_.exchange(INVALID_SOCKET));
+  if (sock != INVALID_SOCKET) {
     detail::shutdown_socket(sock);
     detail::close_socket(sock);
   }
+
+  // Extra acceptors are woken up here and close their own sockets
+  std::lock_guard<std::mutex> guard(acceptor_socks_mutex_);
+  for (auto acceptor_sock : acceptor_socks_) {
+    detail::shutdown_socket(acceptor_sock);
+  }
 }
 
 bool Server::parse_request_line(const char *s, Request &req) {
@@ -3444,14 +3589,25 @@ bool Server::handle_file_request(const Request &req, Response &res,
 socket_t
 Server::create_server_socket(const char *host, int port, int socket_flags,
                              SocketOptions socket_options) const {
+  if (reuse_port_ || acceptor_count_ > 1) {
+    socket_options = [socket_options](socket_t sock) {
+      if (socket_options) { socket_options(sock); }
+#ifdef SO_REUSEPORT
+      int yes = 1;
+      setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char *>(&yes),
+                 sizeof(yes));
+#endif
+    };
+  }
+
   return detail::create_socket(
       host, "", port, address_family_, socket_flags, tcp_nodelay_,
       std::move(socket_options),
-      [](socket_t sock, struct addrinfo &ai) -> bool {
+      [&](socket_t sock, struct addrinfo &ai) -> bool {
         if (::bind(sock, ai.ai_addr, static_cast<socklen_t>(ai.ai_addrlen))) {
           return false;
         }
-        if (::listen(sock, CPPHTTPLIB_LISTEN_BACKLOG)) { return false; }
+        if (::listen(sock, listen_backlog_)) { return false; }
         return true;
       });
 }
@@ -3462,6 +3618,11 @@ int Server::bind_internal(const char *host, int port, int socket_flags) {
   svr_sock_ = create_server_socket(host, port, socket_flags, socket_options_);
   if (svr_sock_ == INVALID_SOCKET) { return -1; }
 
+  // Extra acceptors bind the same address, on the port actually chosen
+  bind_host_ = host ? host : "";
+  bind_socket_flags_ = socket_flags;
+  bind_port_ = port;
+
   if (port == 0) {
     struct sockaddr_storage addr;
     socklen_t addr_len = sizeof(addr);
@@ -3470,12 +3631,15 @@ int Server::bind_internal(const char *host, int port, int socket_flags) {
       return -1;
     }
     if (addr.ss_family == AF_INET) {
-      return ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port);
+      bind_port_ =
+          ntohs(reinterpret_cast<struct sockaddr_in *>(&addr)->sin_port);
     } else if (addr.ss_family == AF_INET6) {
-      return ntohs(reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_port);
+      bind_port_ =
+          ntohs(reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_port);
     } else {
       return -1;
     }
+    return bind_port_;
   } else {
     return port;
   }
@@ -3485,6 +3649,80 @@ bool Server::listen_internal() {
   auto ret = true;
   is_running_ = true;
 
+  if (acceptor_count_ <= 1 && !acceptor_cpu_affinity_) {
+    ret = accept_loop(svr_sock_, 0);
+  } else {
+    // Every acceptor runs in its own thread so pinning never touches the
+    // caller's thread. The extra sockets join the SO_REUSEPORT group of
+    // svr_sock_ and the kernel spreads new connections across them.
+    std::vector<std::thread> acceptors;
+    acceptors.emplace_back([&] { ret = accept_loop(svr_sock_, 0); });
+
+    for (size_t i = 1; i < acceptor_count_; i++) {
+      auto sock = create_server_socket(bind_host_.c_str(), bind_port_,
+                                       bind_socket_flags_, socket_options_);
+      if (sock == INVALID_SOCKET) { break; }
+      {
+        std::lock_guard<std::mutex> guard(acceptor_socks_mutex_);
+        acceptor_socks_.push_back(sock);
+      }
+      acceptors.emplace_back([=] {
+        accept_loop(sock, i);
+
+        // Removed under the lock before close, see stop()
+        std::lock_guard<std::mutex> guard(acceptor_socks_mutex_);
+        acceptor_socks_.erase(
+            std::find(acceptor_socks_.begin(), acceptor_socks_.end(), sock));
+        detail::close_socket(sock);
+      });
+    }
+
+    for (auto &t : acceptors) {
+      t.join();
+    }
+  }
+
+  is_running_ = false;
+  return ret;
+}
+
+// Pins the calling thread, and the workers it creates afterwards (threads
+// inherit the affinity mask), to the index-th CPU this process may run on.
+// SO_INCOMING_CPU makes the kernel prefer this socket for connections whose
+// packets are processed on the same CPU.
+void Server::pin_acceptor(socket_t sock, size_t index) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return; }
+  auto count = static_cast<size_t>(CPU_COUNT(&allowed));
+  if (count == 0) { return; }
+
+  auto target = index % count;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) { continue; }
+    if (target-- > 0) { continue; }
+
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+#ifdef SO_INCOMING_CPU
+    setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+#endif
+    break;
+  }
+#else
+  (void)sock;
+  (void)index;
+#endif
+}
+
+bool Server::accept_loop(socket_t listen_sock, size_t index) {
+  auto ret = true;
+
+  if (acceptor_cpu_affinity_) { pin_acceptor(listen_sock, index); }
+
   {
     std::unique_ptr<TaskQueue> task_queue(new_task_queue());
 
@@ -3492,7 +3730,7 @@ bool Server::listen_internal() {
 #ifndef _WIN32
       if (idle_interval_sec_ > 0 || idle_interval_usec_ > 0) {
 #endif
-        auto val = detail::select_read(svr_sock_, idle_interval_sec_,
+        auto val = detail::select_read(listen_sock, idle_interval_sec_,
                                        idle_interval_usec_);
         if (val == 0) { // Timeout
           task_queue->on_idle();
@@ -3501,7 +3739,15 @@ bool Server::listen_internal() {
 #ifndef _WIN32
       }
 #endif
-      socket_t sock = accept(svr_sock_, nullptr, nullptr);
+#if defined(__linux__)
+      // CLOEXEC: a new binary started by this process for an upgrade must
+      // not inherit client connections
+      socket_t sock =
+          accept4(listen_sock, nullptr, nullptr,
+                  SOCK_CLOEXEC | (nonblocking_accept_ ? SOCK_NONBLOCK : 0));
+#else
+      socket_t sock = accept(listen_sock, nullptr, nullptr);
+#endif
 
       if (sock == INVALID_SOCKET) {
         if (errno == EMFILE) {
@@ -3511,7 +3757,7 @@ bool Server::listen_internal() {
           continue;
         }
         if (svr_sock_ != INVALID_SOCKET) {
-          detail::close_socket(svr_sock_);
+          if (index == 0) { detail::close_socket(svr_sock_); }
           ret = false;
         } else {
           ; // The server socket was closed by user.
@@ -3519,6 +3765,11 @@ bool Server::listen_internal() {
         break;
       }
 
+#if defined(__linux__)
+      // A non-blocking socket is only read/written after select()/poll(), which
+      // already enforces the timeouts
+      if (!nonblocking_accept_) {
+#endif
       {
 #ifdef _WIN32
         auto timeout = static_cast<uint32_t>(read_timeout_sec_ * 1000 +
@@ -3546,6 +3797,16 @@ bool Server::listen_internal() {
         setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv, sizeof(tv));
 #endif
       }
+#if defined(__linux__)
+      }
+#endif
+
+      {
+        std::lock_guard<std::mutex> guard(connections_mutex_);
+        connections_.insert(sock);
+      }
+      detail::http_metrics().server_connections.inc();
+      detail::http_metrics().server_active_connections.add(1);
 
 #if __cplusplus > 201703L
       task_queue->enqueue([=, this]() { process_and_close_socket(sock); });
@@ -3554,13 +3815,42 @@ bool Server::listen_internal() {
 #endif
     }
 
+    drain_connections();
     task_queue->shutdown();
   }
 
-  is_running_ = false;
   return ret;
 }
 
+// Keep-alive loops see the closed server socket and end after the current
+// request. Whatever is still open at the deadline is shut down so reads and
+// writes fail fast; a handler that is busy computing is still waited for by
+// task_queue->shutdown().
+void Server::drain_connections() {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(drain_timeout_sec_) +
+                  std::chrono::microseconds(drain_timeout_usec_);
+
+  std::unique_lock<std::mutex> lock(connections_mutex_);
+  if (!connections_cond_.wait_until(lock, deadline,
+                                    [&] { return connections_.empty(); })) {
+    for (auto sock : connections_) {
+      detail::shutdown_socket(sock);
+    }
+  }
+}
+
+void Server::close_connection_socket(socket_t sock) {
+  // Removed under the lock before close, so drain_connections() never shuts
+  // down a descriptor number that has already been reused
+  std::lock_guard<std::mutex> guard(connections_mutex_);
+  connections_.erase(sock);
+  detail::shutdown_socket(sock);
+  detail::close_socket(sock);
+  connections_cond_.notify_all();
+  detail::http_metrics().server_active_connections.sub(1);
+}
+
 bool Server::routing(Request &req, Response &res, Stream &strm) {
   if (pre_routing_handler_ &&
       pre_routing_handler_(req, res) == HandlerResponse::Handled) {
@@ -3645,6 +3935,7 @@ bool Server::dispatch_request(Request &req, Response &res,
     const auto &handler = x.second;
 
     if (std::regex_match(req.path, req.matches, pattern)) {
+      req.handler_time_ = std::chrono::steady_clock::now();
       handler(req, res);
       return true;
     }
@@ -3770,6 +4061,7 @@ bool Server::dispatch_request_for_content_reader(
     const auto &handler = x.second;
 
     if (std::regex_match(req.path, req.matches, pattern)) {
+      req.handler_time_ = std::chrono::steady_clock::now();
       handler(req, res, content_reader);
       return true;
     }
@@ -3791,6 +4083,7 @@ Server::process_request(Stream &strm, bool close_connection,
   Request req;
   Response res;
 
+  req.start_time_ = std::chrono::steady_clock::now();
   res.version = "HTTP/1.1";
 
   for (const auto &header : default_headers_) {
@@ -3887,11 +4180,23 @@ Server::process_request(Stream &strm, bool close_connection,
   }
 #endif
 
+  req.response_time_ = std::chrono::steady_clock::now();
+
   if (routed) {
     if (res.status == -1) { res.status = req.ranges.empty() ? 200 : 206; }
-    return write_response_with_content(strm, close_connection, req, res);
   } else {
     if (res.status == -1) { res.status = 404; }
+  }
+
+  auto status_class = res.status / 100;
+  detail::http_metrics()
+      .server_responses[status_class >= 1 && status_class <= 5 ? status_class
+                                                                : 0]
+      ->inc();
+
+  if (routed) {
+    return write_response_with_content(strm, close_connection, req, res);
+  } else {
     return write_response(strm, close_connection, req, res);
   }
 }
@@ -3899,17 +4204,22 @@ Server::process_request(Stream &strm, bool close_connection,
 bool Server::is_valid() const { return true; }
 
 bool Server::process_and_close_socket(socket_t sock) {
+  uint64_t served = 0;
   auto ret = detail::process_server_socket(
       svr_sock_, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
       read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
       write_timeout_usec_,
-      [this](Stream &strm, bool close_connection, bool &connection_closed) {
-        return process_request(strm, close_connection, connection_closed,
-                               nullptr);
+      [&](Stream &strm, bool close_connection, bool &connection_closed) {
+        auto ok = process_request(strm, close_connection, connection_closed,
+                                  nullptr);
+        if (ok) { served++; }
+        return ok;
       });
 
-  detail::shutdown_socket(sock);
-  detail::close_socket(sock);
+  if (served > 0) {
+    detail::http_metrics().server_connection_requests.record(served);
+  }
+  close_connection_socket(sock);
   return ret;
 }
 
@@ -4005,6 +4315,7 @@ bool ClientImpl::create_and_connect_socket(Socket &socket,
   auto sock = create_client_socket(error);
   if (sock == INVALID_SOCKET) { return false; }
   socket.sock = sock;
+  detail::http_metrics().client_connections.inc();
   return true;
 }
 
@@ -4077,6 +4388,23 @@ bool ClientImpl::read_response_line(Stream &strm, const Request &req,
 }
 
 bool ClientImpl::send(Request &req, Response &res, Error &error) {
+  auto start = std::chrono::steady_clock::now();
+  auto ret = send_request(req, res, error);
+
+  auto &m = detail::http_metrics();
+  m.client_duration.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count()));
+  auto index = static_cast<int>(ret ? Error::Success : error);
+  if (index < 0 || index >= detail::HttpMetrics::ErrorCount) {
+    index = static_cast<int>(Error::Unknown);
+  }
+  m.client_requests[index]->inc();
+  return ret;
+}
+
+bool ClientImpl::send_request(Request &req, Response &res, Error &error) {
   std::lock_guard<std::recursive_mutex> request_mutex_guard(request_mutex_);
 
   {
@@ -5280,7 +5608,8 @@ bool process_server_socket_ssl(
         SSLSocketStream strm(sock, ssl, read_timeout_sec, read_timeout_usec,
                              write_timeout_sec, write_timeout_usec);
         return callback(strm, close_connection, connection_closed);
-      });
+      },
+      []() { return false; });
 }
 
 template <typename T>
@@ -5529,15 +5858,21 @@ bool SSLServer::process_and_close_socket(socket_t sock) {
 
   bool ret = false;
   if (ssl) {
+    uint64_t served = 0;
     ret = detail::process_server_socket_ssl(
         svr_sock_, ssl, sock, keep_alive_max_count_, keep_alive_timeout_sec_,
         read_timeout_sec_, read_timeout_usec_, write_timeout_sec_,
         write_timeout_usec_,
-        [this, ssl](Stream &strm, bool close_connection,
-                    bool &connection_closed) {
-          return process_request(strm, close_connection, connection_closed,
-                                 [&](Request &req) { req.ssl = ssl; });
+        [&, ssl](Stream &strm, bool close_connection,
+                 bool &connection_closed) {
+          auto ok = process_request(strm, close_connection, connection_closed,
+                                    [&](Request &req) { req.ssl = ssl; });
+          if (ok) { served++; }
+          return ok;
         });
+    if (served > 0) {
+      detail::http_metrics().server_connection_requests.record(served);
+    }
 
     // Shutdown gracefully if the result seemed successful, non-gracefully if
     // the connection appeared to be closed.
@@ -5545,8 +5880,7 @@ bool SSLServer::process_and_close_socket(socket_t sock) {
     detail::ssl_delete(ctx_mutex_, ssl, shutdown_gracefully);
   }
 
-  detail::shutdown_socket(sock);
-  detail::close_socket(sock);
+  close_connection_socket(sock);
   return ret;
 }
 
@@ -76,8 +76,10 @@
 #define CPPHTTPLIB_PAYLOAD_MAX_LENGTH ((std::numeric_limits<size_t>::max)())
 #endif
 
+// Headers and body are written separately; with Nagle's algorithm the second
+// write on a keep-alive connection waits for the peer's delayed ACK (~40ms)
 #ifndef CPPHTTPLIB_TCP_NODELAY
-#define CPPHTTPLIB_TCP_NODELAY false
+#define CPPHTTPLIB_TCP_NODELAY true
 #endif
 
 #ifndef CPPHTTPLIB_RECV_BUFSIZ
@@ -107,6 +109,10 @@
 #define CPPHTTPLIB_LISTEN_BACKLOG 5
 #endif
 
+#ifndef CPPHTTPLIB_DRAIN_TIMEOUT_SECOND
+#define CPPHTTPLIB_DRAIN_TIMEOUT_SECOND 5
+#endif
+
 /*
  * Headers
  */
@@ -197,6 +203,7 @@ using socket_t = int;
 #include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
 #include <climits>
 #include <condition_variable>
 #include <errno.h>
@@ -419,6 +426,12 @@ struct Request {
   Ranges ranges;
   Match matches;
 
+  // for server: steady clock time points of the request phases, the time
+  // the response was written is the time the logger is called
+  std::chrono::steady_clock::time_point start_time_;   // request line read
+  std::chrono::steady_clock::time_point handler_time_; // handler invoked
+  std::chrono::steady_clock::time_point response_time_; // handler returned
+
   // for client
   ResponseHandler response_handler;
   ContentReceiverWithProgress content_receiver;
@@ -533,6 +546,15 @@ public:
   virtual void on_idle() {}
 };
 
+namespace detail {
+
+// Thread pool metrics, defined in httplib.cc
+void thread_pool_job_queued();
+void thread_pool_job_started(std::chrono::steady_clock::time_point queued_at);
+void thread_pool_job_finished();
+
+} // namespace detail
+
 class ThreadPool : public TaskQueue {
 public:
   explicit ThreadPool(size_t n) : shutdown_(false) {
@@ -547,7 +569,8 @@ public:
 
   void enqueue(std::function<void()> fn) override {
     std::unique_lock<std::mutex> lock(mutex_);
-    jobs_.push_back(std::move(fn));
+    jobs_.push_back(Job{std::move(fn), std::chrono::steady_clock::now()});
+    detail::thread_pool_job_queued();
     cond_.notify_one();
   }
 
@@ -572,7 +595,7 @@ private:
 
     void operator()() {
       for (;;) {
-        std::function<void()> fn;
+        Job job;
         {
           std::unique_lock<std::mutex> lock(pool_.mutex_);
 
@@ -581,12 +604,14 @@ private:
 
           if (pool_.shutdown_ && pool_.jobs_.empty()) { break; }
 
-          fn = pool_.jobs_.front();
+          job = std::move(pool_.jobs_.front());
           pool_.jobs_.pop_front();
         }
 
-        assert(true == static_cast<bool>(fn));
-        fn();
+        assert(true == static_cast<bool>(job.fn));
+        detail::thread_pool_job_started(job.queued_at);
+        job.fn();
+        detail::thread_pool_job_finished();
       }
     }
 
@@ -594,8 +619,13 @@ private:
   };
   friend struct worker;
 
+  struct Job {
+    std::function<void()> fn;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
   std::vector<std::thread> threads_;
-  std::list<std::function<void()>> jobs_;
+  std::list<Job> jobs_;
 
   bool shutdown_;
 
@@ -667,6 +697,19 @@ public:
   Server &set_address_family(int family);
   Server &set_tcp_nodelay(bool on);
   Server &set_socket_options(SocketOptions socket_options);
+  // SO_REUSEPORT: another process can listen on the same port while this one
+  // drains, e.g. during a binary upgrade
+  Server &set_reuse_port(bool on);
+  Server &set_listen_backlog(int backlog);
+  // More than one acceptor opens that many SO_REUSEPORT sockets on the bound
+  // port, each with its own accept thread and task queue
+  Server &set_acceptor_count(size_t count);
+  // Pins acceptor i, and the task queue workers it creates, to the i-th
+  // usable CPU (Linux only)
+  Server &set_acceptor_cpu_affinity(bool on);
+  // Accepts with SOCK_NONBLOCK and skips SO_RCVTIMEO/SO_SNDTIMEO, as reads
+  // and writes already wait with select()/poll() (Linux only, plain sockets)
+  Server &set_nonblocking_accept(bool on);
 
   Server &set_default_headers(Headers headers);
 
@@ -685,6 +728,10 @@ public:
   template <class Rep, class Period>
   Server &set_idle_interval(const std::chrono::duration<Rep, Period> &duration);
 
+  // How long listen() waits for in-flight connections after stop(); sockets
+  // still open after that are shut down so blocked reads/writes return
+  Server &set_drain_timeout(time_t sec, time_t usec = 0);
+
   Server &set_payload_max_length(size_t length);
 
   bool bind_to_port(const char *host, int port, int socket_flags = 0);
@@ -712,8 +759,13 @@ protected:
   time_t write_timeout_usec_ = CPPHTTPLIB_WRITE_TIMEOUT_USECOND;
   time_t idle_interval_sec_ = CPPHTTPLIB_IDLE_INTERVAL_SECOND;
   time_t idle_interval_usec_ = CPPHTTPLIB_IDLE_INTERVAL_USECOND;
+  time_t drain_timeout_sec_ = CPPHTTPLIB_DRAIN_TIMEOUT_SECOND;
+  time_t drain_timeout_usec_ = 0;
   size_t payload_max_length_ = CPPHTTPLIB_PAYLOAD_MAX_LENGTH;
 
+  // Closes a connection accepted by listen_internal()
+  void close_connection_socket(socket_t sock);
+
 private:
   using Handlers = std::vector<std::pair<std::regex, Handler>>;
   using HandlersForContentReader =
@@ -723,6 +775,9 @@ private:
                                 SocketOptions socket_options) const;
   int bind_internal(const char *host, int port, int socket_flags);
   bool listen_internal();
+  bool accept_loop(socket_t listen_sock, size_t index);
+  void pin_acceptor(socket_t sock, size_t index);
+  void drain_connections();
 
   bool routing(Request &req, Response &res, Stream &strm);
   bool handle_file_request(const Request &req, Response &res,
@@ -788,8 +843,26 @@ private:
 
   int address_family_ = AF_UNSPEC;
   bool tcp_nodelay_ = CPPHTTPLIB_TCP_NODELAY;
+  bool reuse_port_ = false;
+  int listen_backlog_ = CPPHTTPLIB_LISTEN_BACKLOG;
+  size_t acceptor_count_ = 1;
+  bool acceptor_cpu_affinity_ = false;
+  bool nonblocking_accept_ = false;
   SocketOptions socket_options_ = default_socket_options;
 
+  // Address given to bind_internal(), for the extra acceptor sockets
+  std::string bind_host_;
+  int bind_port_ = 0;
+  int bind_socket_flags_ = 0;
+  // Extra acceptor sockets, owned and closed by their accept threads
+  std::vector<socket_t> acceptor_socks_;
+  std::mutex acceptor_socks_mutex_;
+
+  // Connections accepted but not yet closed, guarded by connections_mutex_
+  std::set<socket_t> connections_;
+  std::mutex connections_mutex_;
+  std::condition_variable connections_cond_;
+
   Headers default_headers_;
 };
 
@@ -1049,6 +1122,7 @@ protected:
   };
 
   Result send_(Request &&req);
+  bool send_request(Request &req, Response &res, Error &error);
 
   virtual bool create_and_connect_socket(Socket &socket, Error &error);
 
@@ -1715,6 +1789,8 @@ void parse_query_text(const std::string &s, Params &params);
 
 bool parse_range_header(const std::string &s, Ranges &ranges);
 
+bool read_headers(Stream &strm, Headers &headers);
+
 int close_socket(socket_t sock);
 
 ssize_t send_socket(socket_t sock, const void *ptr, size_t size, int flags);
@@ -1,29 +1,570 @@
-#include <iostream>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "http/async_client.h"
+#include "metrics/Histogram.h"
+#include "qlibc/QData.h"
 
+using namespace std;
+using namespace httplib;
+using Clock = std::chrono::steady_clock;
 
-int main(int argc, char* argv[]){
+/*
+ * 压测工具，用法类似 wrk，用于对比 httpServer/站点库各项改动前后的性能
+ *
+ *  1. 闭环（默认）：每个连接收到响应后立即发下一个请求，延迟从实际发送算起
+ *  2. 开环（-R）：按固定总速率安排请求，延迟从计划发送时间算起；连接都忙时请求排队，
+ *     排队时间计入延迟，服务端变慢时不会因为少发请求而低估延迟（修正协调遗漏）
+ *  3. 每个线程一个 AsyncClient 事件循环，驱动 连接数/线程数 个连接
+ *  4. 管道（-P）：每个连接一个线程，一次写入 depth 个请求再依次读响应，只支持闭环和长连接
+ */
 
+struct Options {
+    string host;
+    int port = 0;
+    string address;             // host 解析后的数字地址，启动时解析一次
+    string path = "/";
+    int connections = 10;
+    int threads = 2;
+    int durationSec = 10;
+    double rate = 0;            // 总请求速率，0 为闭环
+    int pipeline = 1;
+    bool keepAlive = true;
+    int timeoutMs = 3000;
+    vector<string> bodies;      // 请求模板，轮流发送
+};
 
-    return 0;
+struct Stats {
+    static const int ErrorCount = static_cast<int>(Error::ConnectionTimeout) + 1;
+
+    metrics::Histogram latencyUs;
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> bytes{0};          // 响应体字节数
+    std::atomic<uint64_t> errors[ErrorCount];
+    std::atomic<uint64_t> statusClass[6];   // 按状态码首位计数，其它计入 0
+    std::atomic<uint64_t> notSent{0};       // 开环结束时仍在排队的请求
+
+    Stats() {
+        for (auto& item : errors) {
+            item.store(0);
+        }
+        for (auto& item : statusClass) {
+            item.store(0);
+        }
+    }
+
+    void recordResponse(int status, size_t bodyBytes, Clock::time_point scheduled) {
+        int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - scheduled).count();
+        latencyUs.record(latency > 0 ? static_cast<uint64_t>(latency) : 0);
+        completed.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(bodyBytes, std::memory_order_relaxed);
+        int index = status / 100;
+        statusClass[index >= 1 && index <= 5 ? index : 0].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordError(Error error) {
+        int index = static_cast<int>(error);
+        errors[index >= 0 && index < ErrorCount ? index : static_cast<int>(Error::Unknown)].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// send 失败时回调在 send 内同步执行；此时不能在回调中再次派发，否则一直失败时无限递归
+static thread_local bool inSend = false;
+
+/*
+ * 一个事件循环线程及其连接
+ * 闭环时保持 connections 个请求在途；开环时由 run 所在线程按计划时间派发，在途请求达到 connections 时排队
+ */
+class AsyncWorker {
+    const Options& options;
+    Stats& stats;
+    const size_t connections;
+    const Clock::duration interval;     // 开环时相邻请求的计划间隔
+
+    AsyncClient client;
+    std::atomic<uint64_t> bodyIndex{0};
+
+    std::mutex mutex; // 保护 以下成员
+    std::condition_variable idleCond;
+    size_t inFlight = 0;
+    std::deque<Clock::time_point> backlog;
+    bool stopping = false;
+
+public:
+    AsyncWorker(const Options& pOptions, Stats& pStats, size_t pConnections, double ratePerSecond)
+        : options(pOptions), stats(pStats), connections(pConnections),
+          interval(ratePerSecond > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ratePerSecond))
+                                     : Clock::duration::zero()),
+          client(pConnections) {
+    }
+
+    // 发送到 endTime，之后等待在途请求结束
+    void run(Clock::time_point endTime) {
+        if (options.rate > 0) {
+            runOpenLoop(endTime);
+        }
+        else {
+            {
+                std::lock_guard<std::mutex> lockGuard(mutex);
+                inFlight = connections;
+            }
+            for (size_t i = 0; i < connections; ++i) {
+                dispatch(Clock::now());
+            }
+            std::this_thread::sleep_until(endTime);
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+        stats.notSent.fetch_add(backlog.size());
+        backlog.clear();
+        idleCond.wait_for(lock, std::chrono::milliseconds(options.timeoutMs + 1000), [this] { return inFlight == 0; });
+        lock.unlock();
+
+        client.stop();
+    }
+
+private:
+    void runOpenLoop(Clock::time_point endTime) {
+        for (Clock::time_point next = Clock::now(); next < endTime; next += interval) {
+            // 落后于计划时不等待，连续补发
+            std::this_thread::sleep_until(next);
+            {
+                std::lock_guard<std::mutex> lockGuard(mutex);
+                if (inFlight >= connections) {
+                    backlog.push_back(next);
+                    continue;
+                }
+                ++inFlight;
+            }
+            dispatch(next);
+        }
+    }
+
+    // 调用前 inFlight 已计入本请求；send 失败时回调同步执行，不能持锁调用
+    void dispatch(Clock::time_point scheduled) {
+        AsyncRequest request;
+        request.host = options.address;
+        request.port = options.port;
+        request.path = options.path;
+        request.body = options.bodies[bodyIndex.fetch_add(1, std::memory_order_relaxed) % options.bodies.size()];
+        request.content_type = "application/json";
+        request.timeout_msec = options.timeoutMs;
+        if (!options.keepAlive) {
+            request.headers.emplace("Connection", "close");
+        }
+
+        inSend = true;
+        client.send(std::move(request), [this, scheduled](AsyncResult& result) {
+            onComplete(scheduled, result);
+        });
+        inSend = false;
+    }
+
+    void onComplete(Clock::time_point scheduled, AsyncResult& result) {
+        if (result) {
+            stats.recordResponse(result.response.status, result.response.body.size(), scheduled);
+        }
+        else {
+            stats.recordError(result.error);
+        }
+
+        // 同步失败（客户端已停止等）只计错误，本请求不再占用在途名额
+        bool failedInSend = inSend;
+        Clock::time_point next;
+        {
+            std::lock_guard<std::mutex> lockGuard(mutex);
+            if (stopping || failedInSend || (options.rate > 0 && backlog.empty())) {
+                if (--inFlight == 0) {
+                    idleCond.notify_all();
+                }
+                return;
+            }
+            if (options.rate > 0) {
+                next = backlog.front();
+                backlog.pop_front();
+            }
+            else {
+                next = Clock::now();
+            }
+        }
+        dispatch(next);
+    }
+};
+
+static string serializeRequest(const Options& options, const string& body) {
+    string out = "POST " + options.path + " HTTP/1.1\r\nHost: " + options.host + ":" + std::to_string(options.port) + "\r\n";
+    out += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    out += body;
+    return out;
+}
+
+// 解析 host，结果以数字地址保存到 options.address
+static bool resolveHost(Options& options) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(options.host.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+
+    char address[NI_MAXHOST];
+    int ret = getnameinfo(result->ai_addr, result->ai_addrlen, address, sizeof(address), nullptr, 0, NI_NUMERICHOST);
+    freeaddrinfo(result);
+    if (ret != 0) {
+        return false;
+    }
+    options.address = address;
+    return true;
 }
 
+static int connectTo(const Options& options) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(options.address.c_str(), std::to_string(options.port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
 
+    int fd = socket(result->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        return -1;
+    }
 
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    struct timeval tv;
+    tv.tv_sec = options.timeoutMs / 1000;
+    tv.tv_usec = (options.timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
 
+static bool writeAll(int fd, const string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t n = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    return true;
+}
 
+static bool readMore(int fd, string& in) {
+    char buf[16 * 1024];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        return false;
+    }
+    in.append(buf, static_cast<size_t>(n));
+    return true;
+}
 
+// 从 in 中取出一个响应，bodyBytes 为响应体长度，connectionClose 为服务端是否将关闭连接
+// 只支持 Content-Length 响应（httplib 服务端 set_content 的响应）
+static Error readResponse(int fd, string& in, int& status, size_t& bodyBytes, bool& connectionClose) {
+    size_t header_end;
+    while ((header_end = in.find("\r\n\r\n")) == string::npos) {
+        if (!readMore(fd, in)) {
+            return Error::Read;
+        }
+    }
+    if (in.compare(0, 5, "HTTP/") != 0) {
+        return Error::Read;
+    }
+    status = atoi(in.c_str() + in.find(' ') + 1);
 
+    size_t content_length = 0;
+    connectionClose = false;
+    size_t line = in.find("\r\n") + 2;
+    while (line < header_end) {
+        size_t line_end = in.find("\r\n", line);
+        if (strncasecmp(in.c_str() + line, "Content-Length:", 15) == 0) {
+            content_length = strtoull(in.c_str() + line + 15, nullptr, 10);
+        }
+        else if (strncasecmp(in.c_str() + line, "Connection: close", 17) == 0) {
+            connectionClose = true;
+        }
+        line = line_end + 2;
+    }
 
+    size_t response_size = header_end + 4 + content_length;
+    while (in.size() < response_size) {
+        if (!readMore(fd, in)) {
+            return Error::Read;
+        }
+    }
+    in.erase(0, response_size);
+    bodyBytes = content_length;
+    return Error::Success;
+}
 
+// 管道模式的一个连接，出错或服务端关闭连接后重新连接；服务端关闭连接时未响应的请求不计入错误
+static void runPipeline(const Options& options, Stats& stats, size_t connectionIndex, Clock::time_point endTime) {
+    string batch;
+    for (int i = 0; i < options.pipeline; ++i) {
+        batch += serializeRequest(options, options.bodies[(connectionIndex + i) % options.bodies.size()]);
+    }
 
+    int fd = -1;
+    string in;
+    while (Clock::now() < endTime) {
+        if (fd < 0) {
+            fd = connectTo(options);
+            if (fd < 0) {
+                stats.recordError(Error::Connection);
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            in.clear();
+        }
 
+        Clock::time_point start = Clock::now();
+        Error error = writeAll(fd, batch) ? Error::Success : Error::Write;
+        bool connection_close = false;
+        for (int i = 0; i < options.pipeline && error == Error::Success && !connection_close; ++i) {
+            int status = 0;
+            size_t body_bytes = 0;
+            error = readResponse(fd, in, status, body_bytes, connection_close);
+            if (error == Error::Success) {
+                stats.recordResponse(status, body_bytes, start);
+            }
+        }
+        if (error != Error::Success) {
+            stats.recordError(error);
+        }
+        if (error != Error::Success || connection_close) {
+            close(fd);
+            fd = -1;
+        }
+    }
 
+    if (fd >= 0) {
+        close(fd);
+    }
+}
 
+static void printReport(const Options& options, Stats& stats, double elapsedSec) {
+    metrics::Histogram::Snapshot snapshot = stats.latencyUs.snapshot();
+    printf("  Latency(us)    mean      p50      p75      p90      p99    p99.9      max\n");
+    printf("             %8.0f %8llu %8llu %8llu %8llu %8llu %8llu\n", snapshot.mean(),
+           (unsigned long long)snapshot.percentile(0.50), (unsigned long long)snapshot.percentile(0.75),
+           (unsigned long long)snapshot.percentile(0.90), (unsigned long long)snapshot.percentile(0.99),
+           (unsigned long long)snapshot.percentile(0.999), (unsigned long long)snapshot.max);
 
+    uint64_t completed = stats.completed.load();
+    double megabytes = stats.bytes.load() / 1048576.0;
+    printf("  %llu requests in %.2fs, %.2fMB read\n", (unsigned long long)completed, elapsedSec, megabytes);
 
+    uint64_t non2xx = completed - stats.statusClass[2].load();
+    if (non2xx > 0) {
+        printf("  Non-2xx responses: %llu (1xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu)\n", (unsigned long long)non2xx,
+               (unsigned long long)stats.statusClass[1].load(), (unsigned long long)stats.statusClass[3].load(),
+               (unsigned long long)stats.statusClass[4].load(), (unsigned long long)stats.statusClass[5].load(),
+               (unsigned long long)stats.statusClass[0].load());
+    }
+
+    string errors;
+    for (int i = 0; i < Stats::ErrorCount; ++i) {
+        uint64_t count = stats.errors[i].load();
+        if (count > 0) {
+            errors += (errors.empty() ? "" : ", ") + to_string(static_cast<Error>(i)) + " " + std::to_string(count);
+        }
+    }
+    if (!errors.empty()) {
+        printf("  Errors: %s\n", errors.c_str());
+    }
+    if (stats.notSent.load() > 0) {
+        printf("  Not sent (still queued at end): %llu\n", (unsigned long long)stats.notSent.load());
+    }
+
+    printf("Requests/sec: %10.2f\n", completed / elapsedSec);
+    printf("Transfer/sec: %10.2fMB\n", megabytes / elapsedSec);
+    if (options.rate > 0) {
+        printf("Target rate:  %10.2f\n", options.rate);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "./httpClient [options] <host:port>\n"
+            "  -c <N>          connections, default 10\n"
+            "  -t <N>          threads (event loops), default 2\n"
+            "  -d <seconds>    duration, default 10\n"
+            "  -R <rate>       open loop at <rate> requests/sec in total, default closed loop\n"
+            "  -P <depth>      pipeline <depth> requests per connection, one thread per connection\n"
+            "  -T <ms>         request timeout, default 3000\n"
+            "  -p <path>       request path, default /\n"
+            "  -s <service_id> request {\"service_id\": <service_id>, \"request\": <-r>}, default testService\n"
+            "  -r <json>       \"request\" of -s, default {}\n"
+            "  -f <file>       request bodies: a JSON object, or an array of objects sent in turn\n"
+            "  --no-keepalive  one connection per request\n");
+}
 
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    static const struct option longOptions[] = {
+        {"no-keepalive", no_argument, nullptr, 'K'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
 
+    string service_id = "testService";
+    string request = "{}";
+    string template_file;
+    int c;
+    while ((c = getopt_long(argc, argv, "c:t:d:R:P:T:p:s:r:f:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'c': options.connections = atoi(optarg); break;
+            case 't': options.threads = atoi(optarg); break;
+            case 'd': options.durationSec = atoi(optarg); break;
+            case 'R': options.rate = atof(optarg); break;
+            case 'P': options.pipeline = atoi(optarg); break;
+            case 'T': options.timeoutMs = atoi(optarg); break;
+            case 'p': options.path = optarg; break;
+            case 's': service_id = optarg; break;
+            case 'r': request = optarg; break;
+            case 'f': template_file = optarg; break;
+            case 'K': options.keepAlive = false; break;
+            default: return false;
+        }
+    }
+    if (optind + 1 != argc) {
+        return false;
+    }
 
+    string target(argv[optind]);
+    size_t colon = target.rfind(':');
+    if (colon == string::npos) {
+        return false;
+    }
+    options.host = target.substr(0, colon);
+    options.port = atoi(target.c_str() + colon + 1);
 
+    if (options.port <= 0 || options.connections <= 0 || options.threads <= 0 || options.durationSec <= 0 ||
+        options.pipeline <= 0 || options.timeoutMs <= 0 || options.rate < 0) {
+        return false;
+    }
+    if (options.threads > options.connections) {
+        options.threads = options.connections;
+    }
+    if (options.pipeline > 1 && (options.rate > 0 || !options.keepAlive)) {
+        fprintf(stderr, "-P supports closed loop with keep-alive only\n");
+        return false;
+    }
+    if (!resolveHost(options)) {
+        fprintf(stderr, "%s: cannot resolve host\n", options.host.c_str());
+        return false;
+    }
 
+    if (!template_file.empty()) {
+        qlibc::QData templates;
+        templates.loadFromFile(template_file);
+        if (templates.type() == Json::objectValue) {
+            options.bodies.push_back(templates.toJsonString());
+        }
+        else if (templates.type() == Json::arrayValue) {
+            for (Json::ArrayIndex i = 0; i < templates.size(); ++i) {
+                options.bodies.push_back(qlibc::QData(templates.viewArrayElement(i)).toJsonString());
+            }
+        }
+        if (options.bodies.empty()) {
+            fprintf(stderr, "%s: no request in file\n", template_file.c_str());
+            return false;
+        }
+    }
+    else {
+        qlibc::QData request_data(request);
+        if (request_data.type() != Json::objectValue) {
+            fprintf(stderr, "-r: not a JSON object\n");
+            return false;
+        }
+        qlibc::QData body;
+        body.setString("service_id", service_id);
+        body.putData("request", request_data);
+        options.bodies.push_back(body.toJsonString());
+    }
 
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return -1;
+    }
+
+    printf("Running %ds test @ %s:%d%s\n", options.durationSec, options.host.c_str(), options.port, options.path.c_str());
+    if (options.pipeline > 1) {
+        printf("  %d connections, pipeline depth %d\n", options.connections, options.pipeline);
+    }
+    else if (options.rate > 0) {
+        printf("  %d threads and %d connections, open loop at %.0f requests/sec%s\n", options.threads, options.connections,
+               options.rate, options.keepAlive ? "" : ", no keep-alive");
+    }
+    else {
+        printf("  %d threads and %d connections, closed loop%s\n", options.threads, options.connections,
+               options.keepAlive ? "" : ", no keep-alive");
+    }
+    fflush(stdout);
+
+    Stats stats;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end_time = start + std::chrono::seconds(options.durationSec);
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<AsyncWorker>> workers;
+    if (options.pipeline > 1) {
+        for (int i = 0; i < options.connections; ++i) {
+            threads.emplace_back(runPipeline, std::cref(options), std::ref(stats), static_cast<size_t>(i), end_time);
+        }
+    }
+    else {
+        // 连接和速率按线程平均分配
+        for (int i = 0; i < options.threads; ++i) {
+            size_t connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+            double rate = options.rate * connections / options.connections;
+            workers.emplace_back(new AsyncWorker(options, stats, connections, rate));
+        }
+        for (auto& worker : workers) {
+            threads.emplace_back(&AsyncWorker::run, worker.get(), end_time);
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    workers.clear();
+
+    double elapsed_sec = std::chrono::duration<double>(Clock::now() - start).count();
+    printReport(options, stats, elapsed_sec);
+
+    return 0;
+}
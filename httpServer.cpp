@@ -1,13 +1,11 @@
-
+#include <signal.h>
 #include <thread>
-#include "siteService/nlohmann/json.hpp"
 #include "siteService/service_site_manager.h"
 #include "log/Logging.h"
 
 using namespace std;
 using namespace servicesite;
 using namespace httplib;
-using json = nlohmann::json;
 
 
 int main(int argc, char* argv[]) {
@@ -16,6 +14,13 @@ int main(int argc, char* argv[]) {
         exit(-1);
     }
 
+    // SIGTERM/SIGINT 只由主线程 sigwait 处理；之后创建的线程继承此屏蔽字
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGTERM);
+    sigaddset(&stopSignals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
     string path(argv[1]);
     muduo::logInitLogger(path);     //设置log路径
 
@@ -24,21 +29,25 @@ int main(int argc, char* argv[]) {
     ServiceSiteManager* serviceSiteManager = ServiceSiteManager::getInstance();
     serviceSiteManager->setServerPort(9000);
     ServiceSiteManager::setSiteIdSummary("httpServer", "服务器测试站点");
+    // 升级时新进程先启动监听同一端口，再向旧进程发 SIGTERM
+    ServiceSiteManager::setReusePort(true);
+    // GET /metrics 输出 Prometheus 格式的指标
+    ServiceSiteManager::enableMetrics();
 
     serviceSiteManager->registerServiceRequestHandler("testService",
                                                       [](const Request& request, Response& response) -> int{
         
-        LOG_INFO << "received: " << request.body;
+        LOG_INFO_RATE(100) << "received: " << request.body;
         return 0;
     });
 
 
     // 站点监听线程启动
     threadPool_.enqueue([&](){
-        while(true){
+        while(!ServiceSiteManager::isShuttingDown()){
             //自启动方式
             int code = serviceSiteManager->start();
-            if(code != 0){
+            if(code != 0 && !ServiceSiteManager::isShuttingDown()){
                 LOG_INFO << "===>scribeSite startByRegister error, code = ";
                 LOG_INFO << "===>scribeSite startByRegister in 3 seconds....";
                 std::this_thread::sleep_for(std::chrono::seconds(3));
@@ -47,9 +56,16 @@ int main(int argc, char* argv[]) {
     });
 
 
-    while(true){
-        std::this_thread::sleep_for(std::chrono::seconds(60 *10));
-    }
+    int signo = 0;
+    sigwait(&stopSignals, &signo);
+    LOG_INFO << "===>received signal " << signo << ", shutdown...";
+
+    // 处理完已接受的请求、发完订阅消息、订阅落盘后返回
+    int code = ServiceSiteManager::shutdown();
+    LOG_INFO << "===>shutdown code = " << code;
+
+    threadPool_.shutdown();
+    muduo::logShutdown();
 
-    return 0;
+    return code == 0 ? 0 : 1;
 }
@@ -0,0 +1,101 @@
+//
+// Created by 78472 on 2022/7/4.
+//
+
+#include "LogSampler.h"
+#include "Logging.h"
+#include "metrics/Metrics.h"
+#include <cstring>
+#include <ctime>
+
+namespace muduo{
+
+    //粗粒度单调时钟，只用于限流窗口的划分，不需要高精度
+    static int64_t coarseSeconds(){
+        struct timespec ts{};
+#ifdef CLOCK_MONOTONIC_COARSE
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+        return ts.tv_sec;
+    }
+
+    //所有打印点被采样、限流丢弃的总条数
+    static metrics::Counter& suppressedCounter(){
+        static metrics::Counter& counter = metrics::Registry::global().counter(
+                "muduo_log_suppressed_total", "Log messages dropped by sampling or rate limiting");
+        return counter;
+    }
+
+    //所有打印点，只插入不删除（打印点都是局部静态对象）
+    static std::atomic<LogSite*>& siteList(){
+        static std::atomic<LogSite*> head{nullptr};
+        return head;
+    }
+
+    LogSite::LogSite(const char* file, int line) : file_(file), line_(line) {
+        LogSite* head = siteList().load(std::memory_order_relaxed);
+        do{
+            next_ = head;
+        }while(!siteList().compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool LogSite::everyN(uint64_t n) {
+        uint64_t count = occurrences_.fetch_add(1, std::memory_order_relaxed);
+        if(n <= 1 || count % n == 0){
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        suppressedCounter().inc();
+        return false;
+    }
+
+    //进入新的一秒时，由CAS成功的线程复位窗口计数；复位前后的少量并发调用可能被计入任一窗口，不影响限流效果
+    bool LogSite::rate(uint32_t perSecond) {
+        occurrences_.fetch_add(1, std::memory_order_relaxed);
+        int64_t now = coarseSeconds();
+        int64_t window = windowSecond_.load(std::memory_order_relaxed);
+        if(window != now && windowSecond_.compare_exchange_strong(window, now, std::memory_order_relaxed)){
+            windowCount_.store(0, std::memory_order_relaxed);
+        }
+        if(windowCount_.fetch_add(1, std::memory_order_relaxed) < perSecond){
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        suppressedCounter().inc();
+        return false;
+    }
+
+    uint64_t LogSite::takeSuppressed() {
+        if(suppressed_.load(std::memory_order_relaxed) == 0){
+            return 0;
+        }
+        return suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+
+    string LogSite::suppressedNote() {
+        uint64_t skipped = takeSuppressed();
+        if(skipped == 0){
+            return string();
+        }
+        return "(Skipped " + std::to_string(skipped) + " messages..) ";
+    }
+
+    //与打印点上的 suppressedNote 都通过 exchange 取走计数，同一批丢弃只报告一次
+    size_t LogSite::flushSuppressed() {
+        size_t lines = 0;
+        for(LogSite* site = siteList().load(std::memory_order_acquire); site != nullptr; site = site->next_){
+            uint64_t skipped = site->takeSuppressed();
+            if(skipped == 0){
+                continue;
+            }
+            const char* slash = strrchr(site->file_, '/');
+            const char* file = slash != nullptr ? slash + 1 : site->file_;
+            Logger(site->file_, site->line_, "", Logger::H_YELLOW).stream()
+                    << "(Skipped " << skipped << " messages..) at " << file << ":" << site->line_;
+            ++lines;
+        }
+        return lines;
+    }
+}
@@ -0,0 +1,80 @@
+//
+// Created by 78472 on 2022/7/4.
+//
+
+#ifndef EXHIBITION_LOGSAMPLER_H
+#define EXHIBITION_LOGSAMPLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "noncopyable.h"
+
+using namespace std;
+
+namespace muduo{
+
+    /*
+     * 单个打印点（调用点）的采样、限流状态，思路参照spdlog的dup_filter_sink：
+     *      1. 被丢弃的打印只做计数，不格式化、不输出
+     *      2. 下一条被放行的打印前面附带 "Skipped N messages.." 汇总被丢弃的条数
+     *      3. 所有计数都是原子操作，不加锁，多线程可同时访问同一个打印点
+     *      4. 丢弃后不再打印的打印点由日志后台线程定期汇总（flushSuppressed），丢弃数不会一直不报告
+     *
+     * 采样方式：
+     *      everyN(n)       ：每n次打印放行1次
+     *      rate(perSecond) ：每秒最多放行perSecond次，超出部分丢弃，下一秒重新计数
+     */
+    class LogSite : noncopyable{
+    private:
+        const char* file_;                          //打印点所在文件（__FILE__）
+        int line_;
+        LogSite* next_ = nullptr;                   //所有打印点串成只插入的链表，供定期汇总
+        std::atomic<uint64_t> occurrences_{0};      //总调用次数
+        std::atomic<uint64_t> suppressed_{0};       //自上次放行以来被丢弃的次数
+        std::atomic<int64_t>  windowSecond_{0};     //限流窗口所在的秒
+        std::atomic<uint32_t> windowCount_{0};      //限流窗口内的调用次数
+
+    public:
+        LogSite(const char* file, int line);
+
+        //每n次放行1次，n <= 1时全部放行
+        bool everyN(uint64_t n);
+
+        //每秒最多放行perSecond次
+        bool rate(uint32_t perSecond);
+
+        //取出并清零被丢弃的条数
+        uint64_t takeSuppressed();
+
+        //被丢弃条数的提示信息，没有丢弃时返回空串
+        string suppressedNote();
+
+        //所有打印点尚未报告的丢弃条数，各输出一行 "(Skipped N messages..) at file:line"，返回输出的行数
+        static size_t flushSuppressed();
+    };
+}
+
+
+//每个调用点展开出一个独立的lambda，其局部静态变量即为该调用点的LogSite
+#define LOG_SITE_() ([]() -> muduo::LogSite& { static muduo::LogSite site_(__FILE__, __LINE__); return site_; }())
+
+//for只执行0次或1次，放行时等价于 (LOG_MACRO << ...)，可以安全地用在不带括号的if/else中
+#define LOG_EVERY_N(LOG_MACRO, n)                                                                   \
+    for(muduo::LogSite* logSite_ = &LOG_SITE_(); logSite_ != nullptr && logSite_->everyN(n); logSite_ = nullptr) \
+        (LOG_MACRO << logSite_->suppressedNote())
+
+#define LOG_RATE(LOG_MACRO, perSecond)                                                              \
+    for(muduo::LogSite* logSite_ = &LOG_SITE_(); logSite_ != nullptr && logSite_->rate(perSecond); logSite_ = nullptr) \
+        (LOG_MACRO << logSite_->suppressedNote())
+
+#define LOG_INFO_EVERY_N(n)         LOG_EVERY_N(LOG_INFO, n)
+#define LOG_RED_EVERY_N(n)          LOG_EVERY_N(LOG_RED, n)
+#define LOG_YELLOW_EVERY_N(n)       LOG_EVERY_N(LOG_YELLOW, n)
+
+#define LOG_INFO_RATE(perSecond)    LOG_RATE(LOG_INFO, perSecond)
+#define LOG_RED_RATE(perSecond)     LOG_RATE(LOG_RED, perSecond)
+#define LOG_YELLOW_RATE(perSecond)  LOG_RATE(LOG_YELLOW, perSecond)
+
+
+#endif //EXHIBITION_LOGSAMPLER_H
@@ -158,6 +158,16 @@ namespace muduo{
         buffer_.append(data, len);
     }
 
+    //avail()已经为结尾的'\0'预留了一位
+    LogStream& LogStream::appendPrintf(const char *fmt, va_list ap) {
+        size_t avail = buffer_.avail();
+        int len = vsnprintf(buffer_.current(), avail + 1, fmt, ap);
+        if(len > 0){
+            buffer_.add(static_cast<size_t>(len) < avail ? len : avail);
+        }
+        return *this;
+    }
+
     const LogStream::Buffer& LogStream::buffer() const {
         return buffer_;
     }
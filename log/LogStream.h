@@ -8,6 +8,7 @@
 #include <cstdarg>
 #include <cstring>
 #include <string>
+#include "spdlog/fmt/fmt.h"
 
 using namespace std;
 
@@ -129,6 +130,18 @@ namespace muduo{
         //通用添加
         void append(const char* data, size_t len);
 
+        //fmt格式化，直接写入buffer，超出剩余空间的部分被截断
+        template<typename... Args>
+        self& format(fmt::format_string<Args...> fmtStr, Args&&... args){
+            size_t avail = buffer_.avail();
+            auto result = fmt::format_to_n(buffer_.current(), avail, fmtStr, std::forward<Args>(args)...);
+            buffer_.add(result.size < avail ? result.size : avail);
+            return *this;
+        }
+
+        //printf格式化，直接写入buffer，超出剩余空间的部分被截断
+        self& appendPrintf(const char* fmt, va_list ap);
+
         //返回buffer，重置buffer
         const Buffer& buffer() const;
         void resetBuffer();
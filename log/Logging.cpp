@@ -3,22 +3,125 @@
 //
 
 #include "Logging.h"
+#include "MmapFileSink.h"
+#include "spdlog/async.h"
+#include "metrics/Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
 
 using namespace std;
 
 namespace muduo{
     std::vector<spdlog::sink_ptr> sinks;
-    std::shared_ptr<spdlog::logger> rotating_logger;
-    bool setLoggerPath = false;
+    //logShutdown可能与写日志的线程并发，两个logger都用std::atomic_load/atomic_store读写；为空时不写文件
+    static std::shared_ptr<spdlog::logger> rotating_logger;
+    static std::shared_ptr<spdlog::logger> access_logger;
+    static std::atomic<bool> consoleOutput(true);
+
+    //日志指标：按级别的条数和字节数（与写入文件时的级别一致），访问日志条数
+    struct LogMetrics{
+        metrics::Counter& infoMessages;
+        metrics::Counter& errorMessages;
+        metrics::Counter& bytes;
+        metrics::Counter& accessMessages;
+
+        LogMetrics()
+                : infoMessages(metrics::Registry::global().counter("muduo_log_messages_total", "Log messages written",
+                                                                   metrics::Registry::label("level", "info"))),
+                  errorMessages(metrics::Registry::global().counter("muduo_log_messages_total", "Log messages written",
+                                                                    metrics::Registry::label("level", "error"))),
+                  bytes(metrics::Registry::global().counter("muduo_log_bytes_total", "Bytes of log messages written")),
+                  accessMessages(metrics::Registry::global().counter("muduo_access_log_messages_total",
+                                                                     "Access log lines written")){}
+    };
+
+    static LogMetrics& logMetrics(){
+        static LogMetrics* m = new LogMetrics();
+        return *m;
+    }
+
+    //每秒汇总一次各打印点被丢弃的条数，使丢弃后不再打印的打印点也能报告
+    static std::mutex summaryMutex;
+    static std::condition_variable summaryCond;
+    static bool summaryStop = false;
+    static std::thread summaryThread;
+
+    static void summaryLoop(){
+        std::unique_lock<std::mutex> lk(summaryMutex);
+        while(!summaryCond.wait_for(lk, std::chrono::seconds(1), []{ return summaryStop; })){
+            lk.unlock();
+            LogSite::flushSuppressed();
+            lk.lock();
+        }
+    }
+
+    //停止汇总线程并做最后一次汇总；也注册为atexit，未调用logShutdown就退出时在日志对象析构前停止
+    static void stopSummaryThread(){
+        if(!summaryThread.joinable()){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lg(summaryMutex);
+            summaryStop = true;
+        }
+        summaryCond.notify_all();
+        summaryThread.join();
+        LogSite::flushSuppressed();
+    }
 
     void logInitLogger(string& path){
-        setLoggerPath = true;
         spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e][%s %# %!][thread %t][%l] : %v");
-        rotating_logger = spdlog::rotating_logger_mt("rotating_logger", path, 1024 * 512 * 1, 0);
-        rotating_logger->flush_on(spdlog::level::trace);   //设置出发err级别的消息时立即写入文件
+        //日志写入预分配的mmap分段文件(path.<序号>，path为指向当前段的链接)，每段4M，保留4段
+        auto file_sink = std::make_shared<MmapFileSink>(path, 1024 * 1024 * 4, 4);
+        auto file_logger = std::make_shared<spdlog::logger>("rotating_logger", file_sink);
+        spdlog::initialize_logger(file_logger);
+        std::atomic_store(&rotating_logger, file_logger);
+
+        //访问日志量大，使用异步logger写入单独的文件
+        spdlog::init_thread_pool(8192, 1);
+        auto access_sink = std::make_shared<MmapFileSink>(path + ".access", 1024 * 1024 * 4, 2);
+        std::shared_ptr<spdlog::logger> async_logger = std::make_shared<spdlog::async_logger>(
+                "access_logger", access_sink, spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
+        async_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] %v");
+        spdlog::register_logger(async_logger);
+        std::atomic_store(&access_logger, async_logger);
+
+        if(!summaryThread.joinable()){
+            static bool atexitRegistered = (std::atexit(stopSummaryThread) == 0);
+            (void)atexitRegistered;
+            summaryStop = false;
+            summaryThread = std::thread(summaryLoop);
+        }
+    }
+
+    void logAccess(const char* msg, size_t len){
+        std::shared_ptr<spdlog::logger> logger = std::atomic_load(&access_logger);
+        if(logger){
+            logger->info(spdlog::string_view_t(msg, len));
+            logMetrics().accessMessages.inc();
+        }
+    }
+
+    void logShutdown(){
+        stopSummaryThread();
+        //先摘下两个logger，之后的日志只输出到控制台；正在写的线程持有自己的引用，写完后释放
+        std::shared_ptr<spdlog::logger> file_logger = std::atomic_exchange(&rotating_logger, std::shared_ptr<spdlog::logger>());
+        std::atomic_store(&access_logger, std::shared_ptr<spdlog::logger>());
+        if(file_logger){
+            file_logger->flush();
+        }
+        spdlog::shutdown();
+    }
+
+    void logSetConsoleOutput(bool enable){
+        consoleOutput.store(enable);
     }
 
     static std::recursive_mutex logging_output_mutex_;
@@ -60,14 +163,22 @@ namespace muduo{
     Logger::~Logger() {
         impl_.finish();
         const LogStream::Buffer& buf(stream().buffer());
-        if(setLoggerPath){
+        LogMetrics& m = logMetrics();
+        (impl_.level_ == LogLevel::H_RED ? m.errorMessages : m.infoMessages).inc();
+        m.bytes.inc(buf.length());
+        std::shared_ptr<spdlog::logger> file_logger = std::atomic_load(&rotating_logger);
+        if(file_logger){
+            //直接引用buffer中的内容(去掉结尾的换行)，不再拷贝成string
+            spdlog::string_view_t content(buf.data(), buf.length() -1);
             if(impl_.level_ == LogLevel::H_RED){
-                rotating_logger->error(string(buf.data(), buf.length() -1));
+                file_logger->error(content);
             }else{
-                rotating_logger->info(string(buf.data(), buf.length() -1));
+                file_logger->info(content);
             }
         }
-        defaultOutput(buf.data(), buf.length(), impl_.level_);
+        if(consoleOutput.load(std::memory_order_relaxed)){
+            defaultOutput(buf.data(), buf.length(), impl_.level_);
+        }
         if(g_output != nullptr){
             g_output(buf.data(), buf.length(), impl_.level_);
         }
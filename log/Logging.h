@@ -7,6 +7,7 @@
 
 #include "LogStream.h"
 #include "TimeStamp.h"
+#include "LogSampler.h"
 #include <functional>
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/bin_to_hex.h"
@@ -49,6 +50,15 @@
 namespace muduo{
     extern void logInitLogger(string& path);    //初始化log文件路径
 
+    //写一行访问日志（异步写入 <path>.access 文件），未初始化log路径时丢弃
+    extern void logAccess(const char* msg, size_t len);
+
+    //写出缓冲中的日志并停止异步写线程，进程退出前调用，之后的访问日志被丢弃
+    extern void logShutdown();
+
+    //控制台输出开关，默认打开；关闭后只写日志文件（例如以服务方式运行、基准测试时）
+    extern void logSetConsoleOutput(bool enable);
+
     /*
      * 打印过程：创建一个Logger对象(构造函数)，输出内容，析构（提取内容，真正打印输出）
      *      1. 向LogStream中写入初始数据：打印行所在文件的文件名，打印行所在的行号，时间戳等
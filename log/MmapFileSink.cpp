@@ -0,0 +1,332 @@
+//
+// Created by 78472 on 2022/7/8.
+//
+
+#include "MmapFileSink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "metrics/Metrics.h"
+
+namespace muduo{
+
+    static metrics::Counter& droppedMessages(){
+        static metrics::Counter& counter = metrics::Registry::global().counter(
+                "muduo_log_dropped_total", "Log messages dropped because no mmap segment was ready");
+        return counter;
+    }
+
+    MmapFileSink::MmapFileSink(string basePath, size_t segmentSize, size_t segmentCount)
+        : basePath_(std::move(basePath)),
+          segmentSize_(std::max<size_t>(segmentSize, 4096)),
+          segmentCount_(std::max<size_t>(segmentCount, 2)){
+        //旧版本写的 <basePath> 是普通文件，改名为 <basePath>.old，让出位置给指向当前段的链接
+        struct stat st{};
+        if(::lstat(basePath_.c_str(), &st) == 0 && S_ISREG(st.st_mode)){
+            ::rename(basePath_.c_str(), (basePath_ + ".old").c_str());
+        }
+        recoverOnStart();
+        if(current_.data != nullptr){
+            updateLink(current_.seq);
+        }
+        prepareSeq_ = current_.seq + 1;
+        preparing_ = true;
+        prepareRequested_ = true;
+        worker_ = std::thread(&MmapFileSink::workerLoop, this);
+    }
+
+    MmapFileSink::~MmapFileSink() {
+        {
+            std::lock_guard<std::mutex> lg(workerMutex_);
+            stop_ = true;
+            if(current_.data != nullptr){
+                toClose_.push_back(current_);
+                current_ = Segment();
+            }
+        }
+        workerCond_.notify_all();
+        worker_.join();
+
+        //未启用的预分配段直接删除
+        if(nextReady_){
+            closeSegment(next_);
+            ::unlink(segmentPath(next_.seq).c_str());
+            nextReady_ = false;
+        }
+    }
+
+    void MmapFileSink::sink_it_(const spdlog::details::log_msg &msg) {
+        spdlog::memory_buf_t formatted;
+        formatter_->format(msg, formatted);
+
+        //单条日志超过段大小时截断
+        size_t len = std::min(formatted.size(), segmentSize_);
+        if(current_.data == nullptr || current_.used + len > current_.size){
+            rotate();
+            if(current_.data == nullptr){
+                droppedMessages().inc();
+                return;
+            }
+        }
+        memcpy(current_.data + current_.used, formatted.data(), len);
+        current_.used += len;
+    }
+
+    string MmapFileSink::segmentPath(uint64_t seq) const {
+        return basePath_ + "." + std::to_string(seq);
+    }
+
+    std::vector<uint64_t> MmapFileSink::listSegments() const {
+        std::vector<uint64_t> seqs;
+
+        string dir = ".";
+        string prefix = basePath_;
+        size_t slash = basePath_.rfind('/');
+        if(slash != string::npos){
+            dir = slash == 0 ? "/" : basePath_.substr(0, slash);
+            prefix = basePath_.substr(slash + 1);
+        }
+        prefix += ".";
+
+        DIR* dp = ::opendir(dir.c_str());
+        if(dp == nullptr){
+            return seqs;
+        }
+        while(struct dirent* entry = ::readdir(dp)){
+            const char* name = entry->d_name;
+            if(strncmp(name, prefix.c_str(), prefix.size()) != 0){
+                continue;
+            }
+            const char* digits = name + prefix.size();
+            if(*digits == '\0' || strspn(digits, "0123456789") != strlen(digits)){
+                continue;
+            }
+            seqs.push_back(strtoull(digits, nullptr, 10));
+        }
+        ::closedir(dp);
+
+        std::sort(seqs.begin(), seqs.end());
+        return seqs;
+    }
+
+    bool MmapFileSink::openSegment(uint64_t seq, bool recover, Segment &seg) const {
+        string path = segmentPath(seq);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd < 0){
+            return false;
+        }
+        if(!recover && ::ftruncate(fd, 0) != 0){
+            ::close(fd);
+            return false;
+        }
+
+        struct stat st{};
+        if(::fstat(fd, &st) != 0){
+            ::close(fd);
+            return false;
+        }
+        size_t size = std::max(segmentSize_, static_cast<size_t>(st.st_size));
+
+        //预分配磁盘空间，文件系统不支持时退化为稀疏文件
+        if(::fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0){
+            if(errno != EOPNOTSUPP || ::ftruncate(fd, static_cast<off_t>(size)) != 0){
+                ::close(fd);
+                return false;
+            }
+        }
+
+        //新段预先建立页表映射，避免写日志时缺页
+        int flags = MAP_SHARED;
+        if(!recover){
+            flags |= MAP_POPULATE;
+        }
+        void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+        if(addr == MAP_FAILED){
+            ::close(fd);
+            return false;
+        }
+
+        seg.seq = seq;
+        seg.fd = fd;
+        seg.data = static_cast<char*>(addr);
+        seg.size = size;
+        seg.used = 0;
+        return true;
+    }
+
+    void MmapFileSink::closeSegment(Segment &seg) {
+        if(seg.data != nullptr){
+            ::munmap(seg.data, seg.size);
+            seg.data = nullptr;
+        }
+        if(seg.fd >= 0){
+            //截掉预分配的空白部分，已完成的段是普通文本文件
+            if(::ftruncate(seg.fd, static_cast<off_t>(seg.used)) != 0){}
+            ::close(seg.fd);
+            seg.fd = -1;
+        }
+    }
+
+    size_t MmapFileSink::recoverUsed(Segment &seg) {
+        size_t end = seg.size;
+        while(end > 0 && seg.data[end - 1] == '\0'){
+            --end;
+        }
+        size_t used = end;
+        while(used > 0 && seg.data[used - 1] != '\n'){
+            --used;
+        }
+        if(used < end){
+            memset(seg.data + used, 0, end - used);
+        }
+        return used;
+    }
+
+    void MmapFileSink::updateLink(uint64_t seq) const {
+        struct stat st{};
+        if(::lstat(basePath_.c_str(), &st) == 0 && !S_ISLNK(st.st_mode)){
+            return;
+        }
+        string target = segmentPath(seq);
+        size_t slash = target.rfind('/');
+        if(slash != string::npos){
+            target = target.substr(slash + 1);
+        }
+        string tmp = basePath_ + ".lnk";
+        ::unlink(tmp.c_str());
+        if(::symlink(target.c_str(), tmp.c_str()) == 0){
+            ::rename(tmp.c_str(), basePath_.c_str());
+        }
+    }
+
+    void MmapFileSink::removeOldSegments(uint64_t seq) const {
+        for(uint64_t old : listSegments()){
+            if(old + segmentCount_ < seq){
+                ::unlink(segmentPath(old).c_str());
+            }
+        }
+    }
+
+    //序号最大的段可能是上次预分配但未启用的空段，跳过并删除，继续查找前一段
+    void MmapFileSink::recoverOnStart() {
+        std::vector<uint64_t> seqs = listSegments();
+        uint64_t maxSeq = seqs.empty() ? 0 : seqs.back();
+
+        while(!seqs.empty()){
+            uint64_t seq = seqs.back();
+            seqs.pop_back();
+            Segment seg;
+            if(!openSegment(seq, true, seg)){
+                continue;
+            }
+            seg.used = recoverUsed(seg);
+            if(seg.used > 0 || seqs.empty()){
+                current_ = seg;
+                break;
+            }
+            closeSegment(seg);
+            ::unlink(segmentPath(seq).c_str());
+        }
+
+        //崩溃前已切换但后台线程还未截断的旧段，末尾仍是预分配的0，在这里补做截断
+        for(uint64_t seq : seqs){
+            int fd = ::open(segmentPath(seq).c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0){
+                continue;
+            }
+            struct stat st{};
+            char last = '\n';
+            if(::fstat(fd, &st) == 0 && st.st_size > 0){
+                if(::pread(fd, &last, 1, st.st_size - 1) != 1){
+                    last = '\n';
+                }
+            }
+            ::close(fd);
+            Segment seg;
+            if(last == '\0' && openSegment(seq, true, seg)){
+                seg.used = recoverUsed(seg);
+                closeSegment(seg);
+            }
+        }
+
+        if(current_.data == nullptr){
+            openSegment(maxSeq + 1, false, current_);
+        }
+    }
+
+    //调用时持有base_sink的mutex_；不等待后台线程，下一段没准备好时current_为空，本条日志由调用方丢弃
+    void MmapFileSink::rotate() {
+        std::unique_lock<std::mutex> lk(workerMutex_);
+        if(current_.data != nullptr){
+            toClose_.push_back(current_);
+            current_ = Segment();
+            workerCond_.notify_all();
+        }
+
+        if(nextReady_){
+            current_ = next_;
+            next_ = Segment();
+            nextReady_ = false;
+            linkSeq_ = current_.seq;
+            linkRequested_ = true;
+            prepareSeq_ = current_.seq + 1;
+        }
+        //正在准备时不重复请求；上次准备失败（磁盘满等）时重新请求
+        if(!preparing_){
+            preparing_ = true;
+            prepareRequested_ = true;
+        }
+        workerCond_.notify_all();
+    }
+
+    void MmapFileSink::workerLoop() {
+        std::unique_lock<std::mutex> lk(workerMutex_);
+        while(true){
+            workerCond_.wait(lk, [this]{
+                return stop_ || !toClose_.empty() || prepareRequested_ || linkRequested_;
+            });
+
+            std::vector<Segment> closing;
+            closing.swap(toClose_);
+            bool link = linkRequested_;
+            uint64_t linkSeq = linkSeq_;
+            linkRequested_ = false;
+            bool prepare = prepareRequested_ && !stop_;
+            uint64_t seq = prepareSeq_;
+            prepareRequested_ = false;
+            bool stopping = stop_;
+            lk.unlock();
+
+            for(auto& seg : closing){
+                closeSegment(seg);
+            }
+            if(link){
+                updateLink(linkSeq);
+            }
+            Segment seg;
+            bool ok = false;
+            if(prepare){
+                removeOldSegments(seq);
+                ok = openSegment(seq, false, seg);
+            }
+
+            lk.lock();
+            if(prepare){
+                if(ok){
+                    next_ = seg;
+                    nextReady_ = true;
+                }
+                preparing_ = false;
+            }
+            if(stopping && toClose_.empty()){
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+//
+// Created by 78472 on 2022/7/8.
+//
+
+#ifndef EXHIBITION_MMAPFILESINK_H
+#define EXHIBITION_MMAPFILESINK_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spdlog/sinks/base_sink.h"
+
+using namespace std;
+
+namespace muduo{
+
+    /*
+     * 基于mmap的分段日志sink：
+     *      1. 日志文件按段存储，文件名为 <basePath>.<段序号>，段序号单调递增，最多保留segmentCount段
+     *      2. 每段创建时用fallocate预分配segmentSize大小并mmap，写日志只是一次memcpy，没有write/flush系统调用
+     *      3. 后台线程提前准备好下一段；当前段写满时直接切换到已准备好的段，写线程不需要打开文件
+     *         旧段的munmap、截断到实际长度、删除超出数量的旧段都在后台线程完成
+     *         下一段还没准备好（写入速度超过后台准备速度、磁盘满等）时写线程不等待，丢弃日志并计入muduo_log_dropped_total
+     *      4. <basePath> 为指向当前段的符号链接；启动时<basePath>是普通文件（旧版本的日志）则改名为<basePath>.old，
+     *         是其他类型（如目录）时不做处理
+     *      5. 崩溃恢复：启动时打开序号最大的非空段，找到最后一个非0字节，
+     *         丢弃最后一个换行之后的半行内容，从该位置继续追加
+     *
+     * 进程崩溃时已memcpy的内容仍在页缓存中，不会丢失；掉电场景下的持久性与普通write相同
+     * 注意：当前段在写入期间文件长度即为段大小，未写入的部分为'\0'，查看时可用 tr -d '\000'
+     */
+    class MmapFileSink : public spdlog::sinks::base_sink<std::mutex>{
+    private:
+        struct Segment{
+            uint64_t seq = 0;           //段序号
+            int fd = -1;
+            char* data = nullptr;       //mmap映射地址
+            size_t size = 0;            //映射长度
+            size_t used = 0;            //已写入长度
+        };
+
+        string basePath_;
+        size_t segmentSize_;
+        size_t segmentCount_;
+
+        Segment current_;               //写线程使用，由base_sink的mutex_保护
+
+        //后台线程状态，由workerMutex_保护
+        std::mutex workerMutex_;
+        std::condition_variable workerCond_;
+        Segment next_;                  //已准备好的下一段
+        bool nextReady_ = false;
+        bool preparing_ = false;        //已请求准备下一段，后台线程尚未完成
+        bool prepareRequested_ = false;
+        uint64_t prepareSeq_ = 0;
+        std::vector<Segment> toClose_;
+        bool linkRequested_ = false;
+        uint64_t linkSeq_ = 0;
+        bool stop_ = false;
+        std::thread worker_;
+
+    public:
+        //segmentCount最小为2
+        MmapFileSink(string basePath, size_t segmentSize, size_t segmentCount);
+
+        ~MmapFileSink() override;
+
+    protected:
+        void sink_it_(const spdlog::details::log_msg& msg) override;
+
+        //内容在memcpy后即已进入页缓存，不需要额外刷新
+        void flush_() override {}
+
+    private:
+        string segmentPath(uint64_t seq) const;
+
+        //列出已存在的段序号（升序）
+        std::vector<uint64_t> listSegments() const;
+
+        //打开（recover为false时新建并清空）一个段，预分配并映射
+        bool openSegment(uint64_t seq, bool recover, Segment& seg) const;
+
+        //解除映射，截断到实际写入长度，关闭文件
+        static void closeSegment(Segment& seg);
+
+        //恢复段的实际写入长度，丢弃末尾不完整的行
+        static size_t recoverUsed(Segment& seg);
+
+        void updateLink(uint64_t seq) const;
+
+        //删除超出保留数量的旧段，seq为即将启用的段
+        void removeOldSegments(uint64_t seq) const;
+
+        void recoverOnStart();
+
+        void rotate();
+
+        void workerLoop();
+    };
+}
+
+
+#endif //EXHIBITION_MMAPFILESINK_H
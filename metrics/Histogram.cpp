@@ -0,0 +1,112 @@
+//
+// Created by 78472 on 2022/7/6.
+//
+
+#include <cstdlib>
+#include <new>
+#include "Histogram.h"
+
+namespace metrics{
+
+    unsigned threadShardIndex(){
+        static std::atomic<unsigned> nextShard{0};
+        thread_local unsigned shard = nextShard.fetch_add(1, std::memory_order_relaxed);
+        return shard;
+    }
+
+    void* CacheLineAligned::operator new(size_t size) {
+        void* ptr = nullptr;
+        if(posix_memalign(&ptr, CacheLineSize, size) != 0){
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void CacheLineAligned::operator delete(void* ptr) {
+        free(ptr);
+    }
+
+    Histogram::Histogram() {
+        reset();
+    }
+
+    int Histogram::bucketIndex(uint64_t value) {
+        if(value < SubBucketCount){
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if(msb >= MaxValueBits){
+            return BucketCount - 1;
+        }
+        int shift = msb - SubBucketBits;
+        int sub = static_cast<int>((value >> shift) & (SubBucketCount - 1));
+        return SubBucketCount + shift * SubBucketCount + sub;
+    }
+
+    uint64_t Histogram::bucketUpperBound(int index) {
+        if(index < SubBucketCount){
+            return static_cast<uint64_t>(index);
+        }
+        int shift = (index - SubBucketCount) / SubBucketCount;
+        uint64_t sub = static_cast<uint64_t>((index - SubBucketCount) % SubBucketCount);
+        uint64_t lower = (SubBucketCount + sub) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    void Histogram::record(uint64_t value) {
+        Shard& shard = shards_[threadShardIndex() % ShardCount];
+        shard.counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = shard.max.load(std::memory_order_relaxed);
+        while(value > max && !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed)){}
+    }
+
+    Histogram::Snapshot Histogram::snapshot() const {
+        Snapshot snap;
+        snap.counts.assign(BucketCount, 0);
+        for(const Shard& shard : shards_){
+            for(int i = 0; i < BucketCount; ++i){
+                snap.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+            }
+            snap.count += shard.count.load(std::memory_order_relaxed);
+            snap.sum += shard.sum.load(std::memory_order_relaxed);
+            uint64_t max = shard.max.load(std::memory_order_relaxed);
+            if(max > snap.max)  snap.max = max;
+        }
+        return snap;
+    }
+
+    void Histogram::reset() {
+        for(Shard& shard : shards_){
+            for(auto& count : shard.counts){
+                count.store(0, std::memory_order_relaxed);
+            }
+            shard.count.store(0, std::memory_order_relaxed);
+            shard.sum.store(0, std::memory_order_relaxed);
+            shard.max.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t Histogram::Snapshot::percentile(double q) const {
+        if(count == 0)  return 0;
+        if(q < 0)   q = 0;
+        if(q > 1)   q = 1;
+        //第rank个样本所在的桶，rank从1开始
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+        if(rank == 0)   rank = 1;
+        uint64_t seen = 0;
+        for(size_t i = 0; i < counts.size(); ++i){
+            seen += counts[i];
+            if(seen >= rank){
+                uint64_t upper = bucketUpperBound(static_cast<int>(i));
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+    double Histogram::Snapshot::mean() const {
+        return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+    }
+}
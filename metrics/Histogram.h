@@ -0,0 +1,87 @@
+//
+// Created by 78472 on 2022/7/6.
+//
+
+#ifndef EXHIBITION_HISTOGRAM_H
+#define EXHIBITION_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace metrics{
+
+    //当前线程的分片序号，线程第一次调用时轮转分配，之后固定不变；使用者对自己的分片数取模
+    unsigned threadShardIndex();
+
+    /*
+     * 分片按缓存行对齐的类继承此类：C++14 的 new 不保证超过16字节的 alignas，
+     * 堆上的对象可能不按64字节对齐，相邻分片落在同一缓存行上，分片失去意义
+     */
+    class CacheLineAligned{
+    public:
+        static const size_t CacheLineSize = 64;
+
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+    };
+
+    /*
+     * 对数-线性分桶直方图（HDR风格），用于记录延迟等非负整数值（单位由使用者决定，一般为微秒）
+     *      1. [0, 16)逐一分桶；之后每个2的幂区间再均分为16个子桶，相对误差不超过 1/16
+     *      2. 超过 2^36 的值计入最后一个桶
+     *      3. 按线程分片：每个线程固定写入一个分片，分片内全部为relaxed原子操作，不加锁
+     *      4. 读取时将所有分片累加成快照，快照与并发写入之间不保证严格一致
+     */
+    class Histogram : public CacheLineAligned{
+    public:
+        static const int SubBucketBits = 4;
+        static const int SubBucketCount = 1 << SubBucketBits;
+        static const int MaxValueBits = 36;
+        static const int BucketCount = SubBucketCount + (MaxValueBits - SubBucketBits) * SubBucketCount;
+        static const int ShardCount = 4;
+
+        //累加后的只读快照
+        class Snapshot{
+        public:
+            std::vector<uint64_t> counts;
+            uint64_t count = 0;
+            uint64_t sum = 0;
+            uint64_t max = 0;
+
+            //分位数，q取值[0, 1]，返回所在桶的上界（不超过max）
+            uint64_t percentile(double q) const;
+            double mean() const;
+        };
+
+    private:
+        struct alignas(CacheLineSize) Shard{
+            std::atomic<uint64_t> counts[BucketCount];
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> sum;
+            std::atomic<uint64_t> max;
+        };
+        Shard shards_[ShardCount];
+
+    public:
+        Histogram();
+        Histogram(const Histogram&) = delete;
+        Histogram& operator=(const Histogram&) = delete;
+
+        void record(uint64_t value);
+
+        Snapshot snapshot() const;
+
+        void reset();
+
+        //值对应的桶编号
+        static int bucketIndex(uint64_t value);
+
+        //桶能表示的最大值
+        static uint64_t bucketUpperBound(int index);
+    };
+}
+
+
+#endif //EXHIBITION_HISTOGRAM_H
@@ -0,0 +1,226 @@
+//
+// Created by 78472 on 2022/7/23.
+//
+
+#include <cmath>
+#include <cstdio>
+#include "Metrics.h"
+
+namespace metrics{
+
+    uint64_t Counter::value() const {
+        uint64_t sum = 0;
+        for(const Shard& shard : shards_){
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    int64_t Gauge::value() const {
+        int64_t sum = 0;
+        for(const Shard& shard : shards_){
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    //不析构：退出时仍可能有线程在写入已注册的指标
+    Registry& Registry::global() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    const std::vector<uint64_t>& Registry::defaultBounds() {
+        static const std::vector<uint64_t> bounds = [](){
+            std::vector<uint64_t> result;
+            for(uint64_t decade = 1; decade <= 1000000; decade *= 10){
+                result.push_back(decade);
+                result.push_back(decade * 5 / 2);
+                result.push_back(decade * 5);
+            }
+            result.push_back(10000000);
+            return result;
+        }();
+        return bounds;
+    }
+
+    std::string Registry::label(const std::string& key, const std::string& value) {
+        std::string out = key + "=\"";
+        for(char c : value){
+            if(c == '\\' || c == '"'){
+                out += '\\';
+                out += c;
+            }else if(c == '\n'){
+                out += "\\n";
+            }else{
+                out += c;
+            }
+        }
+        out += '"';
+        return out;
+    }
+
+    Registry::Metric* Registry::findOrCreate(const std::string& name, const std::string& help, Type type,
+                                             const std::string& labels, const std::vector<uint64_t>* bounds) {
+        Family* family = nullptr;
+        for(auto& item : families_){
+            if(item->name == name){
+                family = item.get();
+                break;
+            }
+        }
+        if(family == nullptr){
+            families_.emplace_back(new Family());
+            family = families_.back().get();
+            family->name = name;
+            family->help = help;
+            family->type = type;
+            if(type == Type::Histogram){
+                family->bounds = (bounds == nullptr || bounds->empty()) ? defaultBounds() : *bounds;
+            }
+        }else if(family->type != type){
+            return nullptr;
+        }
+
+        for(auto& metric : family->metrics){
+            if(metric->labels == labels){
+                return metric.get();
+            }
+        }
+        family->metrics.emplace_back(new Metric());
+        Metric* metric = family->metrics.back().get();
+        metric->labels = labels;
+        return metric;
+    }
+
+    Counter& Registry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+        std::lock_guard<std::mutex> lg(mutex_);
+        Metric* metric = findOrCreate(name, help, Type::Counter, labels, nullptr);
+        if(metric == nullptr){
+            orphans_.emplace_back(new Metric());
+            metric = orphans_.back().get();
+        }
+        if(!metric->counter)  metric->counter.reset(new Counter());
+        return *metric->counter;
+    }
+
+    Gauge& Registry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+        std::lock_guard<std::mutex> lg(mutex_);
+        Metric* metric = findOrCreate(name, help, Type::Gauge, labels, nullptr);
+        if(metric == nullptr){
+            orphans_.emplace_back(new Metric());
+            metric = orphans_.back().get();
+        }
+        if(!metric->gauge)  metric->gauge.reset(new Gauge());
+        return *metric->gauge;
+    }
+
+    void Registry::gaugeCallback(const std::string& name, const std::string& help, const std::string& labels,
+                                 std::function<double()> fn) {
+        std::lock_guard<std::mutex> lg(mutex_);
+        Metric* metric = findOrCreate(name, help, Type::Gauge, labels, nullptr);
+        if(metric != nullptr){
+            metric->callback = std::move(fn);
+        }
+    }
+
+    Histogram& Registry::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                                   const std::vector<uint64_t>& bounds) {
+        std::lock_guard<std::mutex> lg(mutex_);
+        Metric* metric = findOrCreate(name, help, Type::Histogram, labels, &bounds);
+        if(metric == nullptr){
+            orphans_.emplace_back(new Metric());
+            metric = orphans_.back().get();
+        }
+        if(!metric->histogram)  metric->histogram.reset(new Histogram());
+        return *metric->histogram;
+    }
+
+    //name{labels} 或 name{labels,extra}
+    static void writeSeries(std::string& out, const std::string& name, const char* suffix,
+                            const std::string& labels, const std::string& extra){
+        out += name;
+        out += suffix;
+        if(!labels.empty() || !extra.empty()){
+            out += '{';
+            out += labels;
+            if(!labels.empty() && !extra.empty())   out += ',';
+            out += extra;
+            out += '}';
+        }
+        out += ' ';
+    }
+
+    static void writeValue(std::string& out, double value){
+        char buf[32];
+        if(std::isnan(value)){
+            out += "NaN";
+        }else if(std::isinf(value)){
+            out += value > 0 ? "+Inf" : "-Inf";
+        }else if(value == std::floor(value) && std::fabs(value) < 9.0e15){
+            snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value));
+            out += buf;
+        }else{
+            snprintf(buf, sizeof(buf), "%.9g", value);
+            out += buf;
+        }
+        out += '\n';
+    }
+
+    void Registry::writeFamily(const Family& family, std::string& out) {
+        static const char* typeNames[] = {"counter", "gauge", "histogram"};
+        out += "# HELP " + family.name + " " + family.help + "\n";
+        out += "# TYPE " + family.name + " " + typeNames[static_cast<int>(family.type)] + "\n";
+
+        for(const auto& metric : family.metrics){
+            switch(family.type){
+                case Type::Counter:
+                    writeSeries(out, family.name, "", metric->labels, "");
+                    out += std::to_string(metric->counter ? metric->counter->value() : 0) + "\n";
+                    break;
+                case Type::Gauge:
+                    writeSeries(out, family.name, "", metric->labels, "");
+                    if(metric->callback){
+                        writeValue(out, metric->callback());
+                    }else{
+                        out += std::to_string(metric->gauge ? metric->gauge->value() : 0) + "\n";
+                    }
+                    break;
+                case Type::Histogram:{
+                    if(!metric->histogram)  break;
+                    Histogram::Snapshot snap = metric->histogram->snapshot();
+                    //各桶按上界归入第一个不小于它的分界，累加输出
+                    uint64_t cumulative = 0;
+                    size_t bucket = 0;
+                    for(uint64_t bound : family.bounds){
+                        while(bucket < snap.counts.size() && Histogram::bucketUpperBound(static_cast<int>(bucket)) <= bound){
+                            cumulative += snap.counts[bucket++];
+                        }
+                        writeSeries(out, family.name, "_bucket", metric->labels, "le=\"" + std::to_string(bound) + "\"");
+                        out += std::to_string(cumulative) + "\n";
+                    }
+                    //快照与并发写入不严格一致，+Inf 取较大者保证单调
+                    uint64_t total = snap.count;
+                    for(; bucket < snap.counts.size(); ++bucket)    cumulative += snap.counts[bucket];
+                    if(cumulative > total)  total = cumulative;
+                    writeSeries(out, family.name, "_bucket", metric->labels, "le=\"+Inf\"");
+                    out += std::to_string(total) + "\n";
+                    writeSeries(out, family.name, "_sum", metric->labels, "");
+                    out += std::to_string(snap.sum) + "\n";
+                    writeSeries(out, family.name, "_count", metric->labels, "");
+                    out += std::to_string(total) + "\n";
+                    break;
+                }
+            }
+        }
+    }
+
+    void Registry::writePrometheus(std::string& out) const {
+        std::lock_guard<std::mutex> lg(mutex_);
+        for(const auto& family : families_){
+            if(!family->metrics.empty()){
+                writeFamily(*family, out);
+            }
+        }
+    }
+}
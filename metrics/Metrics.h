@@ -0,0 +1,145 @@
+//
+// Created by 78472 on 2022/7/23.
+//
+
+#ifndef EXHIBITION_METRICS_H
+#define EXHIBITION_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Histogram.h"
+
+namespace metrics{
+
+    /*
+     * 计数器，只增不减
+     * 按线程分片，写入是一次relaxed原子加，不同线程写不同缓存行；读取时累加所有分片
+     */
+    class Counter : public CacheLineAligned{
+    public:
+        static const int ShardCount = 8;
+
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        void inc(uint64_t n = 1){
+            shards_[threadShardIndex() % ShardCount].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const;
+
+    private:
+        struct alignas(CacheLineSize) Shard{
+            std::atomic<uint64_t> value{0};
+        };
+        Shard shards_[ShardCount];
+    };
+
+    /*
+     * 瞬时值（活跃连接数、队列长度等），可增可减，分片方式同Counter
+     * 只支持增减，需要直接设置的值使用Registry::gaugeCallback在输出时读取
+     */
+    class Gauge : public CacheLineAligned{
+    public:
+        static const int ShardCount = 8;
+
+        Gauge() = default;
+        Gauge(const Gauge&) = delete;
+        Gauge& operator=(const Gauge&) = delete;
+
+        void add(int64_t n = 1){
+            shards_[threadShardIndex() % ShardCount].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void sub(int64_t n = 1){
+            add(-n);
+        }
+
+        int64_t value() const;
+
+    private:
+        struct alignas(CacheLineSize) Shard{
+            std::atomic<int64_t> value{0};
+        };
+        Shard shards_[ShardCount];
+    };
+
+    /*
+     * 指标注册表，按Prometheus文本格式（0.0.4）输出
+     *      1. 指标按 名称+标签 注册，重复注册返回同一个对象；对象不释放，使用者保存引用后直接写入，写入不经过注册表
+     *      2. 同名指标类型必须一致，类型不一致时返回一个不会输出的对象
+     *      3. 注册和输出加锁，只在初始化和抓取时发生
+     *      4. 直方图单位由名称表明（默认分界适合微秒），输出时把对数-线性分桶合并到分界上：
+     *         桶上界不超过分界的计入该分界，跨越分界的桶计入下一个分界
+     *
+     * labels为已格式化的标签，如 service_id="debug",method="POST"，用label()生成
+     */
+    class Registry{
+    public:
+        static Registry& global();
+
+        Registry() = default;
+        Registry(const Registry&) = delete;
+        Registry& operator=(const Registry&) = delete;
+
+        Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+        Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+        //输出时调用fn取值，fn在输出线程执行，需自行保证线程安全；同名同标签重复注册时替换fn
+        void gaugeCallback(const std::string& name, const std::string& help, const std::string& labels,
+                           std::function<double()> fn);
+
+        //bounds为空时使用defaultBounds()，同一名称以第一次注册的分界为准
+        Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                             const std::vector<uint64_t>& bounds = {});
+
+        //追加全部指标到out
+        void writePrometheus(std::string& out) const;
+
+        //1 ~ 10^7 的 1-2.5-5 分界（微秒时为 1us ~ 10s，2.5 取整为 2）
+        static const std::vector<uint64_t>& defaultBounds();
+
+        //key="value"，转义value中的 \ " 和换行
+        static std::string label(const std::string& key, const std::string& value);
+
+    private:
+        enum class Type{ Counter, Gauge, Histogram };
+
+        struct Metric{
+            std::string labels;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<Histogram> histogram;
+            std::function<double()> callback;
+        };
+
+        struct Family{
+            std::string name;
+            std::string help;
+            Type type;
+            std::vector<uint64_t> bounds;
+            std::vector<std::unique_ptr<Metric>> metrics;
+        };
+
+        //没有时创建；类型不一致时返回nullptr
+        Metric* findOrCreate(const std::string& name, const std::string& help, Type type,
+                             const std::string& labels, const std::vector<uint64_t>* bounds);
+
+        static void writeFamily(const Family& family, std::string& out);
+
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<Family>> families_;
+        //类型不一致时返回的对象
+        std::vector<std::unique_ptr<Metric>> orphans_;
+    };
+}
+
+
+#endif //EXHIBITION_METRICS_H
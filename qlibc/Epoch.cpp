@@ -0,0 +1,100 @@
+//
+// Created by 78472 on 2022/7/16.
+//
+
+#include "Epoch.h"
+#include <atomic>
+
+namespace qlibc{
+
+    /*
+     * 读者登记：每个线程首次读取时占用一个槽，读取期间在槽内记录进入时的epoch，退出时清0
+     * 写者回收epoch为E的旧对象前，确认所有槽为0或不小于E；槽用完时读者改用共享计数，
+     * 共享计数不为0期间不回收任何旧对象
+     */
+    namespace{
+        const int ReaderSlotCount = 128;
+
+        struct alignas(64) ReaderSlot{
+            std::atomic<uint64_t> epoch{0};
+            std::atomic<bool> owned{false};
+        };
+
+        struct ReaderRegistry{
+            ReaderSlot slots[ReaderSlotCount];
+            std::atomic<uint64_t> epoch{1};
+            alignas(64) std::atomic<uint64_t> overflowReaders{0};
+        };
+
+        ReaderRegistry& registry(){
+            static ReaderRegistry reg;
+            return reg;
+        }
+
+        struct ThreadReader{
+            int slot = -1;
+            int depth = 0;          //同一线程嵌套读取时只在最外层登记
+
+            ThreadReader(){
+                ReaderRegistry& reg = registry();
+                for(int i = 0; i < ReaderSlotCount; ++i){
+                    bool expected = false;
+                    if(!reg.slots[i].owned.load(std::memory_order_relaxed) &&
+                       reg.slots[i].owned.compare_exchange_strong(expected, true)){
+                        slot = i;
+                        break;
+                    }
+                }
+            }
+
+            ~ThreadReader(){
+                if(slot >= 0){
+                    registry().slots[slot].epoch.store(0);
+                    registry().slots[slot].owned.store(false);
+                }
+            }
+        };
+
+        ThreadReader& threadReader(){
+            thread_local ThreadReader reader;
+            return reader;
+        }
+    }
+
+    void epochEnter(){
+        ThreadReader& reader = threadReader();
+        if(reader.depth++ > 0)  return;
+        ReaderRegistry& reg = registry();
+        if(reader.slot >= 0){
+            reg.slots[reader.slot].epoch.store(reg.epoch.load());
+        }else{
+            reg.overflowReaders.fetch_add(1);
+        }
+    }
+
+    void epochExit(){
+        ThreadReader& reader = threadReader();
+        if(--reader.depth > 0)  return;
+        ReaderRegistry& reg = registry();
+        if(reader.slot >= 0){
+            reg.slots[reader.slot].epoch.store(0, std::memory_order_release);
+        }else{
+            reg.overflowReaders.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    uint64_t epochRetire(){
+        return registry().epoch.fetch_add(1) + 1;
+    }
+
+    uint64_t epochMinActive(){
+        ReaderRegistry& reg = registry();
+        if(reg.overflowReaders.load() != 0)     return 0;
+        uint64_t minEpoch = UINT64_MAX;
+        for(const ReaderSlot& slot : reg.slots){
+            uint64_t epoch = slot.epoch.load();
+            if(epoch != 0 && epoch < minEpoch)  minEpoch = epoch;
+        }
+        return minEpoch;
+    }
+}
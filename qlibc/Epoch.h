@@ -0,0 +1,43 @@
+//
+// Created by 78472 on 2022/7/16.
+//
+
+#ifndef EXHIBITION_EPOCH_H
+#define EXHIBITION_EPOCH_H
+
+#include <cstdint>
+
+namespace qlibc{
+
+    /*
+     * 基于epoch的延迟回收（RCU的读者登记部分），供原子指针发布的只读结构使用：
+     *      读者：在epochEnter()/epochExit()之间（或EpochReadGuard作用域内）读取原子指针，不加锁
+     *      写者：替换指针后用epochRetire()的返回值标记旧对象，
+     *           epochQuiescent(标记值)为true时已没有读者能看到旧对象，可以释放
+     * 所有使用者共用一个全局的读者登记表；同一线程可以嵌套进入
+     */
+    void epochEnter();
+    void epochExit();
+
+    //推进全局epoch，返回被替换对象的回收标记
+    uint64_t epochRetire();
+
+    //所有活跃读者中最早的进入epoch，没有活跃读者时返回UINT64_MAX
+    uint64_t epochMinActive();
+
+    //标记为retireEpoch的对象是否已没有读者
+    inline bool epochQuiescent(uint64_t retireEpoch){
+        return epochMinActive() >= retireEpoch;
+    }
+
+    class EpochReadGuard{
+    public:
+        EpochReadGuard(){ epochEnter(); }
+        ~EpochReadGuard(){ epochExit(); }
+        EpochReadGuard(const EpochReadGuard&) = delete;
+        EpochReadGuard& operator=(const EpochReadGuard&) = delete;
+    };
+}
+
+
+#endif //EXHIBITION_EPOCH_H
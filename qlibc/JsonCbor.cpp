@@ -0,0 +1,410 @@
+//
+// Created by 78472 on 2022/7/14.
+//
+
+#include "JsonCbor.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "QData.h"
+
+namespace qlibc{
+
+    const char* const CborContentType = "application/cbor";
+
+    namespace{
+        enum MajorType : uint8_t{
+            MajorUInt = 0,
+            MajorNegInt = 1,
+            MajorBytes = 2,
+            MajorText = 3,
+            MajorArray = 4,
+            MajorMap = 5,
+            MajorTag = 6,
+            MajorSimple = 7
+        };
+
+        const uint8_t CborFalse = 0xf4;
+        const uint8_t CborTrue = 0xf5;
+        const uint8_t CborNull = 0xf6;
+        const uint8_t CborUndefined = 0xf7;
+        const uint8_t CborHalf = 0xf9;
+        const uint8_t CborFloat = 0xfa;
+        const uint8_t CborDouble = 0xfb;
+        const uint8_t CborBreak = 0xff;
+        const uint8_t IndefiniteLength = 31;
+
+        const int CborMaxDepth = 512;
+
+        //类型头：major type + 长度/数值，按最短长度编码
+        void appendHead(std::string& out, uint8_t major, uint64_t value){
+            char buf[9];
+            size_t n;
+            uint8_t prefix = static_cast<uint8_t>(major << 5);
+            if(value < 24){
+                buf[0] = static_cast<char>(prefix | value);
+                n = 1;
+            }else if(value <= 0xff){
+                buf[0] = static_cast<char>(prefix | 24);
+                buf[1] = static_cast<char>(value);
+                n = 2;
+            }else if(value <= 0xffff){
+                buf[0] = static_cast<char>(prefix | 25);
+                buf[1] = static_cast<char>(value >> 8);
+                buf[2] = static_cast<char>(value);
+                n = 3;
+            }else if(value <= 0xffffffffULL){
+                buf[0] = static_cast<char>(prefix | 26);
+                for(int i = 0; i < 4; ++i){
+                    buf[1 + i] = static_cast<char>(value >> (24 - 8 * i));
+                }
+                n = 5;
+            }else{
+                buf[0] = static_cast<char>(prefix | 27);
+                for(int i = 0; i < 8; ++i){
+                    buf[1 + i] = static_cast<char>(value >> (56 - 8 * i));
+                }
+                n = 9;
+            }
+            out.append(buf, n);
+        }
+
+        void appendDouble(std::string& out, double value){
+            char buf[9];
+            float f = static_cast<float>(value);
+            if(static_cast<double>(f) == value){
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                buf[0] = static_cast<char>(CborFloat);
+                for(int i = 0; i < 4; ++i){
+                    buf[1 + i] = static_cast<char>(bits >> (24 - 8 * i));
+                }
+                out.append(buf, 5);
+                return;
+            }
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            buf[0] = static_cast<char>(CborDouble);
+            for(int i = 0; i < 8; ++i){
+                buf[1 + i] = static_cast<char>(bits >> (56 - 8 * i));
+            }
+            out.append(buf, 9);
+        }
+
+        double halfToDouble(uint16_t half){
+            int exponent = (half >> 10) & 0x1f;
+            int mantissa = half & 0x3ff;
+            double value;
+            if(exponent == 0){
+                value = std::ldexp(mantissa, -24);
+            }else if(exponent != 31){
+                value = std::ldexp(mantissa + 1024, exponent - 25);
+            }else{
+                value = mantissa == 0 ? INFINITY : NAN;
+            }
+            return (half & 0x8000) ? -value : value;
+        }
+
+        class CborDecoder{
+        private:
+            const uint8_t* _p;
+            const uint8_t* _end;
+
+        public:
+            CborDecoder(const char* data, size_t length)
+                : _p(reinterpret_cast<const uint8_t*>(data)), _end(reinterpret_cast<const uint8_t*>(data) + length){}
+
+            bool atEnd() const { return _p == _end; }
+
+            bool decode(Json::Value& value, int depth){
+                if(depth > CborMaxDepth || _p == _end)  return false;
+                uint8_t initial = *_p++;
+                uint8_t major = initial >> 5;
+                uint8_t info = initial & 0x1f;
+
+                if(major == MajorSimple){
+                    return decodeSimple(info, value);
+                }
+
+                if(info == IndefiniteLength){
+                    switch(major){
+                        case MajorBytes:
+                        case MajorText:
+                            return decodeIndefiniteString(major, value);
+                        case MajorArray:
+                            return decodeArray(value, 0, true, depth);
+                        case MajorMap:
+                            return decodeMap(value, 0, true, depth);
+                        default:
+                            return false;
+                    }
+                }
+
+                uint64_t argument;
+                if(!readArgument(info, argument))   return false;
+
+                switch(major){
+                    case MajorUInt:
+                        //与jsoncpp的reader一致：int64范围内的非负整数为intValue
+                        if(argument <= static_cast<uint64_t>(INT64_MAX)){
+                            value = Json::Value(static_cast<Json::Int64>(argument));
+                        }else{
+                            value = Json::Value(static_cast<Json::UInt64>(argument));
+                        }
+                        return true;
+                    case MajorNegInt:
+                        //-1 - argument超出int64时按double处理
+                        if(argument <= static_cast<uint64_t>(INT64_MAX)){
+                            value = Json::Value(static_cast<Json::Int64>(-1 - static_cast<int64_t>(argument)));
+                        }else{
+                            value = Json::Value(-1.0 - static_cast<double>(argument));
+                        }
+                        return true;
+                    case MajorBytes:
+                    case MajorText:{
+                        if(argument > static_cast<uint64_t>(_end - _p))    return false;
+                        const char* str = reinterpret_cast<const char*>(_p);
+                        value = Json::Value(str, str + argument);
+                        _p += argument;
+                        return true;
+                    }
+                    case MajorArray:
+                        return decodeArray(value, argument, false, depth);
+                    case MajorMap:
+                        return decodeMap(value, argument, false, depth);
+                    case MajorTag:
+                        //tag只是对后面值的语义标注，直接解码被标注的值
+                        return decode(value, depth + 1);
+                    default:
+                        return false;
+                }
+            }
+
+        private:
+            bool readArgument(uint8_t info, uint64_t& argument){
+                if(info < 24){
+                    argument = info;
+                    return true;
+                }
+                size_t n;
+                switch(info){
+                    case 24: n = 1; break;
+                    case 25: n = 2; break;
+                    case 26: n = 4; break;
+                    case 27: n = 8; break;
+                    default: return false;
+                }
+                if(static_cast<size_t>(_end - _p) < n)  return false;
+                argument = 0;
+                for(size_t i = 0; i < n; ++i){
+                    argument = (argument << 8) | _p[i];
+                }
+                _p += n;
+                return true;
+            }
+
+            bool decodeSimple(uint8_t info, Json::Value& value){
+                uint8_t initial = static_cast<uint8_t>((MajorSimple << 5) | info);
+                switch(initial){
+                    case CborFalse:
+                        value = Json::Value(false);
+                        return true;
+                    case CborTrue:
+                        value = Json::Value(true);
+                        return true;
+                    case CborNull:
+                    case CborUndefined:
+                        value = Json::Value();
+                        return true;
+                    default:
+                        break;
+                }
+
+                uint64_t bits;
+                if(initial != CborHalf && initial != CborFloat && initial != CborDouble)    return false;
+                if(!readArgument(info, bits))   return false;
+                if(initial == CborHalf){
+                    value = Json::Value(halfToDouble(static_cast<uint16_t>(bits)));
+                }else if(initial == CborFloat){
+                    uint32_t bits32 = static_cast<uint32_t>(bits);
+                    float f;
+                    memcpy(&f, &bits32, sizeof(f));
+                    value = Json::Value(static_cast<double>(f));
+                }else{
+                    double d;
+                    memcpy(&d, &bits, sizeof(d));
+                    value = Json::Value(d);
+                }
+                return true;
+            }
+
+            //不定长字符串由若干同类型的定长分段组成，以break结束
+            bool decodeIndefiniteString(uint8_t major, Json::Value& value){
+                std::string str;
+                while(true){
+                    if(_p == _end)  return false;
+                    if(*_p == CborBreak){
+                        ++_p;
+                        break;
+                    }
+                    uint8_t initial = *_p++;
+                    uint64_t length;
+                    if((initial >> 5) != major || !readArgument(initial & 0x1f, length))    return false;
+                    if(length > static_cast<uint64_t>(_end - _p))  return false;
+                    str.append(reinterpret_cast<const char*>(_p), static_cast<size_t>(length));
+                    _p += length;
+                }
+                value = Json::Value(str);
+                return true;
+            }
+
+            bool atBreak(){
+                if(_p != _end && *_p == CborBreak){
+                    ++_p;
+                    return true;
+                }
+                return false;
+            }
+
+            bool decodeArray(Json::Value& value, uint64_t count, bool indefinite, int depth){
+                value = Json::Value(Json::arrayValue);
+                //每个元素至少1字节，长度超过剩余字节数必然出错，避免按伪造的长度循环
+                if(!indefinite && count > static_cast<uint64_t>(_end - _p))    return false;
+                for(uint64_t i = 0; indefinite || i < count; ++i){
+                    if(indefinite && atBreak())     return true;
+                    if(!decode(value.append(Json::Value()), depth + 1))     return false;
+                }
+                return true;
+            }
+
+            bool decodeMap(Json::Value& value, uint64_t count, bool indefinite, int depth){
+                value = Json::Value(Json::objectValue);
+                if(!indefinite && count > static_cast<uint64_t>(_end - _p) / 2)    return false;
+                std::string key;
+                for(uint64_t i = 0; indefinite || i < count; ++i){
+                    if(indefinite && atBreak())     return true;
+                    if(!decodeKey(key, depth + 1))      return false;
+                    if(!decode(value[key], depth + 1))  return false;
+                }
+                return true;
+            }
+
+            //key通常是定长字符串，直接读取，不构造Json::Value
+            bool decodeKey(std::string& key, int depth){
+                if(_p != _end && (*_p >> 5) == MajorText && (*_p & 0x1f) != IndefiniteLength){
+                    uint8_t info = *_p++ & 0x1f;
+                    uint64_t length;
+                    if(!readArgument(info, length) || length > static_cast<uint64_t>(_end - _p))   return false;
+                    key.assign(reinterpret_cast<const char*>(_p), static_cast<size_t>(length));
+                    _p += length;
+                    return true;
+                }
+                Json::Value value;
+                if(!decode(value, depth) || !value.isString())   return false;
+                key = value.asString();
+                return true;
+            }
+        };
+
+        bool equalsIgnoreCase(const char* a, const char* b, size_t n){
+            for(size_t i = 0; i < n; ++i){
+                char ca = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] - 'A' + 'a') : a[i];
+                if(ca != b[i])  return false;
+            }
+            return true;
+        }
+    }
+
+    void appendCbor(const Json::Value &value, std::string &out) {
+        switch(value.type()){
+            case Json::nullValue:
+                out.push_back(static_cast<char>(CborNull));
+                break;
+            case Json::booleanValue:
+                out.push_back(static_cast<char>(value.asBool() ? CborTrue : CborFalse));
+                break;
+            case Json::intValue:{
+                Json::Int64 i = value.asInt64();
+                if(i >= 0){
+                    appendHead(out, MajorUInt, static_cast<uint64_t>(i));
+                }else{
+                    appendHead(out, MajorNegInt, static_cast<uint64_t>(-1 - i));
+                }
+                break;
+            }
+            case Json::uintValue:
+                appendHead(out, MajorUInt, value.asUInt64());
+                break;
+            case Json::realValue:
+                appendDouble(out, value.asDouble());
+                break;
+            case Json::stringValue:{
+                const char* begin;
+                const char* end;
+                value.getString(&begin, &end);
+                appendHead(out, MajorText, static_cast<uint64_t>(end - begin));
+                out.append(begin, static_cast<size_t>(end - begin));
+                break;
+            }
+            case Json::arrayValue:
+                appendHead(out, MajorArray, value.size());
+                for(Json::ArrayIndex i = 0; i < value.size(); ++i){
+                    appendCbor(value[i], out);
+                }
+                break;
+            case Json::objectValue:
+                appendHead(out, MajorMap, value.size());
+                for(Json::ValueConstIterator it = value.begin(); it != value.end(); ++it){
+                    const char* keyEnd;
+                    const char* key = it.memberName(&keyEnd);
+                    appendHead(out, MajorText, static_cast<uint64_t>(keyEnd - key));
+                    out.append(key, static_cast<size_t>(keyEnd - key));
+                    appendCbor(*it, out);
+                }
+                break;
+        }
+    }
+
+    void valueToCbor(const Json::Value &value, std::string &out) {
+        out.clear();
+        appendCbor(value, out);
+    }
+
+    bool parseCbor(const char *data, size_t length, Json::Value &value) {
+        CborDecoder decoder(data, length);
+        if(!decoder.decode(value, 0) || !decoder.atEnd()){
+            value = Json::nullValue;
+            return false;
+        }
+        return true;
+    }
+
+    bool parseCbor(const std::string &data, Json::Value &value) {
+        return parseCbor(data.data(), data.size(), value);
+    }
+
+    bool isCborContentType(const std::string &contentType) {
+        size_t length = strlen(CborContentType);
+        if(contentType.size() < length || !equalsIgnoreCase(contentType.data(), CborContentType, length)){
+            return false;
+        }
+        return contentType.size() == length || contentType[length] == ';' || contentType[length] == ' ';
+    }
+
+    bool acceptsCbor(const std::string &accept) {
+        size_t length = strlen(CborContentType);
+        for(size_t pos = 0; pos + length <= accept.size(); ++pos){
+            if(equalsIgnoreCase(accept.data() + pos, CborContentType, length)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseBody(const std::string &body, const std::string &contentType, Json::Value &value) {
+        if(isCborContentType(contentType)){
+            return parseCbor(body, value);
+        }
+        return QData::parseJson(body, value);
+    }
+}
@@ -0,0 +1,46 @@
+//
+// Created by 78472 on 2022/7/14.
+//
+
+#ifndef EXHIBITION_JSONCBOR_H
+#define EXHIBITION_JSONCBOR_H
+
+#include <cstddef>
+#include <string>
+#include "jsoncpp/json.h"
+
+namespace qlibc{
+
+    //CBOR报文的Content-Type
+    extern const char* const CborContentType;
+
+    /*
+     * Json::Value与CBOR（RFC 7049）之间的转换，用于站点间的二进制报文
+     * 编码：整数按最短长度编码；浮点数能无损表示为float时用4字节，否则8字节；只使用定长容器
+     * 解码：支持不定长容器/字符串、半精度浮点、tag（忽略tag本身）；字节串按字符串处理；
+     *      对象的key必须是字符串
+     */
+
+    //编码后追加到out
+    void appendCbor(const Json::Value& value, std::string& out);
+
+    //编码到out，out原有内容被清除
+    void valueToCbor(const Json::Value& value, std::string& out);
+
+    //解码[data, data + length)，必须恰好是一个完整的值；失败返回false，value为null
+    bool parseCbor(const char* data, size_t length, Json::Value& value);
+
+    bool parseCbor(const std::string& data, Json::Value& value);
+
+    //contentType是否为CBOR（忽略大小写和";"之后的参数）
+    bool isCborContentType(const std::string& contentType);
+
+    //Accept头中是否列出了CBOR
+    bool acceptsCbor(const std::string& accept);
+
+    //按Content-Type解析报文：CBOR或JSON
+    bool parseBody(const std::string& body, const std::string& contentType, Json::Value& value);
+}
+
+
+#endif //EXHIBITION_JSONCBOR_H
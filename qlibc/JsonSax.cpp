@@ -0,0 +1,487 @@
+//
+// Created by 78472 on 2022/7/13.
+//
+
+#include "JsonSax.h"
+#include <cstdlib>
+#include <cstring>
+#include "MappedFile.h"
+
+namespace qlibc{
+
+    static const size_t SaxMaxDepth = 1000;
+
+    namespace{
+        /*
+         * 单遍扫描的SAX解析器，容器嵌套用显式栈，不递归
+         * 输入不要求以'\0'结尾，所有读取都检查end
+         */
+        class SaxParser{
+        private:
+            const char* _begin;
+            const char* _p;
+            const char* _end;
+            JsonSaxHandler& _handler;
+            std::vector<bool> _stack;   //true为对象
+            std::string _scratch;       //含转义的字符串反转义后的内容
+            bool _stopped = false;
+
+        public:
+            SaxParser(const char* data, size_t length, JsonSaxHandler& handler)
+                : _begin(data), _p(data), _end(data + length), _handler(handler){}
+
+            size_t offset() const { return static_cast<size_t>(_p - _begin); }
+
+            bool parse(){
+                while(true){
+                    ValueState state = parseValue();
+                    if(state == ValueFailed)    return _stopped;
+                    if(state == ValueOpened)    continue;
+                    //值已完成，处理所在容器的分隔符或结束符
+                    while(true){
+                        skipSpace();
+                        if(_stack.empty()){
+                            return _p == _end;
+                        }
+                        if(_p == _end)  return false;
+                        bool isObject = _stack.back();
+                        if(*_p == ','){
+                            ++_p;
+                            if(isObject && !parseKey())     return _stopped;
+                            break;
+                        }
+                        if(*_p != (isObject ? '}' : ']'))   return false;
+                        ++_p;
+                        _stack.pop_back();
+                        if(!(isObject ? _handler.onEndObject() : _handler.onEndArray())){
+                            stop();
+                            return true;
+                        }
+                    }
+                }
+            }
+
+        private:
+            enum ValueState{
+                ValueFailed,        //格式错误或回调停止
+                ValueComplete,      //读完一个完整的值
+                ValueOpened,        //进入非空容器，接下来读取第一个元素
+            };
+
+            bool stop(){
+                _stopped = true;
+                return false;
+            }
+
+            void skipSpace(){
+                while(_p != _end && (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t')){
+                    ++_p;
+                }
+            }
+
+            ValueState parseValue(){
+                skipSpace();
+                if(_p == _end)  return ValueFailed;
+                char c = *_p;
+                if(c == '{' || c == '['){
+                    bool isObject = c == '{';
+                    ++_p;
+                    if(!(isObject ? _handler.onStartObject() : _handler.onStartArray())){
+                        stop();
+                        return ValueFailed;
+                    }
+                    skipSpace();
+                    if(_p != _end && *_p == (isObject ? '}' : ']')){
+                        ++_p;
+                        return (isObject ? _handler.onEndObject() : _handler.onEndArray()) || stop() ? ValueComplete : ValueFailed;
+                    }
+                    if(_stack.size() >= SaxMaxDepth)    return ValueFailed;
+                    _stack.push_back(isObject);
+                    if(isObject && !parseKey())     return ValueFailed;
+                    return ValueOpened;
+                }
+                if(c == '"'){
+                    const char* str;
+                    size_t length;
+                    if(!parseString(str, length))   return ValueFailed;
+                    return _handler.onString(str, length) || stop() ? ValueComplete : ValueFailed;
+                }
+                return parseAtom() ? ValueComplete : ValueFailed;
+            }
+
+            bool parseKey(){
+                skipSpace();
+                if(_p == _end || *_p != '"')    return false;
+                const char* key;
+                size_t length;
+                if(!parseString(key, length))   return false;
+                if(!_handler.onKey(key, length))    return stop();
+                skipSpace();
+                if(_p == _end || *_p != ':')    return false;
+                ++_p;
+                return true;
+            }
+
+            //不含转义时直接指向输入，含转义时反转义到_scratch
+            bool parseString(const char*& str, size_t& length){
+                const char* begin = ++_p;
+                while(_p != _end && *_p != '"' && *_p != '\\'){
+                    ++_p;
+                }
+                if(_p == _end)  return false;
+                if(*_p == '"'){
+                    str = begin;
+                    length = static_cast<size_t>(_p - begin);
+                    ++_p;
+                    return true;
+                }
+
+                _scratch.assign(begin, _p);
+                while(true){
+                    if(_p == _end)  return false;
+                    char c = *_p++;
+                    if(c == '"')    break;
+                    if(c != '\\'){
+                        _scratch += c;
+                        continue;
+                    }
+                    if(_p == _end)  return false;
+                    char e = *_p++;
+                    switch(e){
+                        case '"':   _scratch += '"'; break;
+                        case '\\':  _scratch += '\\'; break;
+                        case '/':   _scratch += '/'; break;
+                        case 'b':   _scratch += '\b'; break;
+                        case 'f':   _scratch += '\f'; break;
+                        case 'n':   _scratch += '\n'; break;
+                        case 'r':   _scratch += '\r'; break;
+                        case 't':   _scratch += '\t'; break;
+                        case 'u': {
+                            unsigned cp;
+                            if(!readHex4(cp))   return false;
+                            if(cp >= 0xD800 && cp <= 0xDBFF){
+                                unsigned low;
+                                if(_end - _p < 2 || _p[0] != '\\' || _p[1] != 'u')  return false;
+                                _p += 2;
+                                if(!readHex4(low) || low < 0xDC00 || low > 0xDFFF)  return false;
+                                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            }
+                            appendUtf8(cp);
+                            break;
+                        }
+                        default:
+                            return false;
+                    }
+                }
+                str = _scratch.data();
+                length = _scratch.size();
+                return true;
+            }
+
+            bool readHex4(unsigned& value){
+                if(_end - _p < 4)   return false;
+                value = 0;
+                for(int i = 0; i < 4; ++i){
+                    char c = *_p++;
+                    unsigned h;
+                    if(c >= '0' && c <= '9')        h = static_cast<unsigned>(c - '0');
+                    else if(c >= 'a' && c <= 'f')   h = static_cast<unsigned>(c - 'a' + 10);
+                    else if(c >= 'A' && c <= 'F')   h = static_cast<unsigned>(c - 'A' + 10);
+                    else    return false;
+                    value = (value << 4) | h;
+                }
+                return true;
+            }
+
+            void appendUtf8(unsigned cp){
+                if(cp < 0x80){
+                    _scratch += static_cast<char>(cp);
+                }else if(cp < 0x800){
+                    _scratch += static_cast<char>(0xC0 | (cp >> 6));
+                    _scratch += static_cast<char>(0x80 | (cp & 0x3F));
+                }else if(cp < 0x10000){
+                    _scratch += static_cast<char>(0xE0 | (cp >> 12));
+                    _scratch += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    _scratch += static_cast<char>(0x80 | (cp & 0x3F));
+                }else{
+                    _scratch += static_cast<char>(0xF0 | (cp >> 18));
+                    _scratch += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                    _scratch += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    _scratch += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+            }
+
+            bool matchLiteral(const char* literal, size_t length){
+                if(static_cast<size_t>(_end - _p) < length || memcmp(_p, literal, length) != 0)    return false;
+                _p += length;
+                return true;
+            }
+
+            bool isDigit() const{
+                return _p != _end && *_p >= '0' && *_p <= '9';
+            }
+
+            bool parseAtom(){
+                bool ok;
+                switch(*_p){
+                    case 't':
+                        if(!matchLiteral("true", 4))    return false;
+                        ok = _handler.onBool(true);
+                        break;
+                    case 'f':
+                        if(!matchLiteral("false", 5))   return false;
+                        ok = _handler.onBool(false);
+                        break;
+                    case 'n':
+                        if(!matchLiteral("null", 4))    return false;
+                        ok = _handler.onNull();
+                        break;
+                    default:
+                        if(!parseNumber(ok))    return false;
+                        break;
+                }
+                //标量之后只能是空白、分隔符或结尾
+                if(_p != _end){
+                    char c = *_p;
+                    if(c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ',' && c != ']' && c != '}')   return false;
+                }
+                return ok || stop();
+            }
+
+            bool parseNumber(bool& ok){
+                const char* start = _p;
+                bool negative = *_p == '-';
+                if(negative)    ++_p;
+                if(!isDigit())  return false;
+                if(*_p == '0' && _p + 1 != _end && _p[1] >= '0' && _p[1] <= '9')    return false;
+
+                uint64_t value = 0;
+                bool overflow = false;
+                while(isDigit()){
+                    unsigned d = static_cast<unsigned>(*_p - '0');
+                    if(value > (UINT64_MAX - d) / 10)   overflow = true;
+                    value = value * 10 + d;
+                    ++_p;
+                }
+                bool isReal = overflow;
+                if(_p != _end && *_p == '.'){
+                    isReal = true;
+                    ++_p;
+                    if(!isDigit())  return false;
+                    while(isDigit())    ++_p;
+                }
+                if(_p != _end && (*_p == 'e' || *_p == 'E')){
+                    isReal = true;
+                    ++_p;
+                    if(_p != _end && (*_p == '+' || *_p == '-'))    ++_p;
+                    if(!isDigit())  return false;
+                    while(isDigit())    ++_p;
+                }
+
+                if(isReal){
+                    //输入不以'\0'结尾，复制后再交给strtod
+                    char buf[64];
+                    size_t length = static_cast<size_t>(_p - start);
+                    double d;
+                    if(length < sizeof(buf)){
+                        memcpy(buf, start, length);
+                        buf[length] = '\0';
+                        d = strtod(buf, nullptr);
+                    }else{
+                        d = strtod(std::string(start, length).c_str(), nullptr);
+                    }
+                    ok = _handler.onDouble(d);
+                }else if(negative){
+                    if(value > uint64_t(INT64_MAX) + 1){
+                        ok = _handler.onDouble(-static_cast<double>(value));
+                    }else{
+                        ok = _handler.onInt(static_cast<int64_t>(0 - value));
+                    }
+                }else if(value > uint64_t(INT64_MAX)){
+                    ok = _handler.onUInt(value);
+                }else{
+                    ok = _handler.onInt(static_cast<int64_t>(value));
+                }
+                return true;
+            }
+        };
+    }
+
+    bool parseJsonSax(const char *data, size_t length, JsonSaxHandler &handler, size_t *errorOffset) {
+        SaxParser parser(data, length, handler);
+        bool ok = parser.parse();
+        if(!ok && errorOffset != nullptr){
+            *errorOffset = parser.offset();
+        }
+        return ok;
+    }
+
+    bool parseFileSax(const std::string &filePathName, JsonSaxHandler &handler) {
+        MappedFile file;
+        if(!file.open(filePathName)){
+            return false;
+        }
+        return parseJsonSax(file.data(), file.size(), handler);
+    }
+
+    /*
+     * JsonSubsetHandler
+     */
+    static std::vector<std::string> splitPointer(const std::string& pointer){
+        std::vector<std::string> keys;
+        size_t pos = pointer.empty() || pointer[0] != '/' ? 0 : 1;
+        if(pointer.empty()){
+            return keys;
+        }
+        while(true){
+            size_t slash = pointer.find('/', pos);
+            std::string key = pointer.substr(pos, slash == std::string::npos ? std::string::npos : slash - pos);
+            //JSON Pointer转义：~1为'/'，~0为'~'
+            std::string unescaped;
+            for(size_t i = 0; i < key.size(); ++i){
+                if(key[i] == '~' && i + 1 < key.size() && (key[i + 1] == '0' || key[i + 1] == '1')){
+                    unescaped += key[i + 1] == '0' ? '~' : '/';
+                    ++i;
+                }else{
+                    unescaped += key[i];
+                }
+            }
+            keys.push_back(unescaped);
+            if(slash == std::string::npos)  break;
+            pos = slash + 1;
+        }
+        return keys;
+    }
+
+    JsonSubsetHandler::JsonSubsetHandler(const std::vector<std::string> &keyPaths, Json::Value &value)
+        : _value(value), _found(keyPaths.size(), false), _remaining(keyPaths.size()){
+        for(const std::string& path : keyPaths){
+            _paths.push_back(splitPointer(path));
+        }
+    }
+
+    int JsonSubsetHandler::matchPath() const {
+        for(size_t i = 0; i < _paths.size(); ++i){
+            const std::vector<std::string>& path = _paths[i];
+            if(_found[i] || path.size() != _levels.size())  continue;
+            bool match = true;
+            for(size_t j = 0; j < path.size(); ++j){
+                if(!_levels[j].isObject || _levels[j].key != path[j]){
+                    match = false;
+                    break;
+                }
+            }
+            if(match)   return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    Json::Value* JsonSubsetHandler::beginValue() {
+        if(!_building.empty()){
+            Json::Value* top = _building.back();
+            if(top->isArray()){
+                return &top->append(Json::Value());
+            }
+            return &(*top)[_levels.back().key];
+        }
+        _matchIndex = matchPath();
+        if(_matchIndex < 0){
+            return nullptr;
+        }
+        Json::Value* target = &_value;
+        for(const std::string& key : _paths[static_cast<size_t>(_matchIndex)]){
+            target = &(*target)[key];
+        }
+        return target;
+    }
+
+    //一个路径提取完成，全部完成时返回false停止解析
+    bool JsonSubsetHandler::finishMatch() {
+        if(_matchIndex >= 0 && !_found[static_cast<size_t>(_matchIndex)]){
+            _found[static_cast<size_t>(_matchIndex)] = true;
+            --_remaining;
+        }
+        _matchIndex = -1;
+        return _remaining != 0;
+    }
+
+    bool JsonSubsetHandler::setScalar(Json::Value &&value) {
+        bool topLevel = _building.empty();
+        Json::Value* target = beginValue();
+        if(target == nullptr){
+            return true;
+        }
+        *target = std::move(value);
+        return topLevel ? finishMatch() : true;
+    }
+
+    bool JsonSubsetHandler::startContainer(Json::ValueType type) {
+        Json::Value* target = beginValue();
+        _levels.push_back(Level{type == Json::objectValue, std::string()});
+        if(target != nullptr){
+            *target = Json::Value(type);
+            _building.push_back(target);
+        }
+        return true;
+    }
+
+    bool JsonSubsetHandler::endContainer() {
+        _levels.pop_back();
+        if(!_building.empty()){
+            _building.pop_back();
+            if(_building.empty()){
+                return finishMatch();
+            }
+        }
+        return true;
+    }
+
+    bool JsonSubsetHandler::onNull() {
+        return setScalar(Json::Value());
+    }
+
+    bool JsonSubsetHandler::onBool(bool value) {
+        return setScalar(Json::Value(value));
+    }
+
+    bool JsonSubsetHandler::onInt(int64_t value) {
+        return setScalar(Json::Value(static_cast<Json::Int64>(value)));
+    }
+
+    bool JsonSubsetHandler::onUInt(uint64_t value) {
+        return setScalar(Json::Value(static_cast<Json::UInt64>(value)));
+    }
+
+    bool JsonSubsetHandler::onDouble(double value) {
+        return setScalar(Json::Value(value));
+    }
+
+    bool JsonSubsetHandler::onString(const char *str, size_t length) {
+        //不需要提取时不构造Json::Value
+        if(_building.empty() && matchPath() < 0){
+            return true;
+        }
+        return setScalar(Json::Value(str, str + length));
+    }
+
+    bool JsonSubsetHandler::onStartObject() {
+        return startContainer(Json::objectValue);
+    }
+
+    bool JsonSubsetHandler::onKey(const char *key, size_t length) {
+        _levels.back().key.assign(key, length);
+        return true;
+    }
+
+    bool JsonSubsetHandler::onEndObject() {
+        return endContainer();
+    }
+
+    bool JsonSubsetHandler::onStartArray() {
+        return startContainer(Json::arrayValue);
+    }
+
+    bool JsonSubsetHandler::onEndArray() {
+        return endContainer();
+    }
+}
@@ -0,0 +1,100 @@
+//
+// Created by 78472 on 2022/7/13.
+//
+
+#ifndef EXHIBITION_JSONSAX_H
+#define EXHIBITION_JSONSAX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "jsoncpp/json.h"
+
+namespace qlibc{
+
+    /*
+     * SAX方式解析JSON的回调接口，解析过程中不建立DOM
+     * 字符串和key的指针只在回调期间有效，内容不以'\0'结尾，以第二个参数（长度）为准
+     * 回调返回false时停止解析
+     */
+    class JsonSaxHandler{
+    public:
+        virtual ~JsonSaxHandler() = default;
+
+        virtual bool onNull() { return true; }
+        virtual bool onBool(bool) { return true; }
+        virtual bool onInt(int64_t) { return true; }
+        virtual bool onUInt(uint64_t) { return true; }
+        virtual bool onDouble(double) { return true; }
+        virtual bool onString(const char*, size_t) { return true; }
+        virtual bool onStartObject() { return true; }
+        virtual bool onKey(const char*, size_t) { return true; }
+        virtual bool onEndObject() { return true; }
+        virtual bool onStartArray() { return true; }
+        virtual bool onEndArray() { return true; }
+    };
+
+    /**
+     * SAX方式解析[data, data + length)，不要求以'\0'结尾
+     * 文档完整解析或回调主动停止时返回true；格式错误返回false，errorOffset为出错的大致位置
+     */
+    bool parseJsonSax(const char* data, size_t length, JsonSaxHandler& handler, size_t* errorOffset = nullptr);
+
+    /**
+     * mmap整个文件后SAX方式解析，不读入内存副本
+     * 文件打开失败或格式错误返回false
+     */
+    bool parseFileSax(const std::string& filePathName, JsonSaxHandler& handler);
+
+    /*
+     * 只提取指定路径下的内容，其余部分只做扫描，内存占用只与提取的内容有关
+     * 路径格式同JSON Pointer："/a/b"表示根对象的a成员中的b成员，""表示整个文档；不支持数组下标
+     * 提取结果按原路径放入value，例如"/a/b"的内容放在value["a"]["b"]；所有路径都提取完后停止解析
+     */
+    class JsonSubsetHandler : public JsonSaxHandler{
+    private:
+        struct Level{
+            bool isObject;
+            std::string key;
+        };
+
+        Json::Value& _value;
+        std::vector<std::vector<std::string>> _paths;
+        std::vector<bool> _found;
+        size_t _remaining;
+        std::vector<Level> _levels;             //当前位置
+        std::vector<Json::Value*> _building;    //正在提取的容器
+        int _matchIndex = -1;                   //正在提取的路径
+
+    public:
+        JsonSubsetHandler(const std::vector<std::string>& keyPaths, Json::Value& value);
+
+        //所有路径是否都已找到
+        bool complete() const { return _remaining == 0; }
+
+        bool onNull() override;
+        bool onBool(bool value) override;
+        bool onInt(int64_t value) override;
+        bool onUInt(uint64_t value) override;
+        bool onDouble(double value) override;
+        bool onString(const char*, size_t) override;
+        bool onStartObject() override;
+        bool onKey(const char*, size_t) override;
+        bool onEndObject() override;
+        bool onStartArray() override;
+        bool onEndArray() override;
+
+    private:
+        //新值的存放位置，不需要提取时返回nullptr
+        Json::Value* beginValue();
+        bool setScalar(Json::Value&& value);
+        bool startContainer(Json::ValueType type);
+        bool endContainer();
+        int matchPath() const;
+        bool finishMatch();
+    };
+}
+
+
+#endif //EXHIBITION_JSONSAX_H
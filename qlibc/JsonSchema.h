@@ -0,0 +1,263 @@
+//
+// Created by 78472 on 2022/7/15.
+//
+
+#ifndef EXHIBITION_JSONSCHEMA_H
+#define EXHIBITION_JSONSCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "jsoncpp/json.h"
+
+namespace qlibc{
+
+    /*
+     * 编译期生成的JSON -> 结构体解码器
+     *
+     * 为结构体特化JsonSchema，列出字段名与成员指针：
+     *      struct SiteInfo{ std::string site_id; int port = 0; JsonOptional<bool> online; };
+     *      template<> struct JsonSchema<SiteInfo>{
+     *          static constexpr auto fields(){
+     *              return std::make_tuple(jsonField("site_id", &SiteInfo::site_id),
+     *                                     jsonField("port", &SiteInfo::port),
+     *                                     jsonField("online", &SiteInfo::online));
+     *          }
+     *      };
+     * decodeJson(value, info)只遍历一次对象成员，按字段名分派到对应成员并检查类型，最后检查必填字段；
+     * 字段表是编译期常量，分派代码按字段展开，不做运行时的schema解释
+     *
+     * 支持的成员类型：bool、int、int64_t、uint64_t、double、std::string、Json::Value（原样复制）、
+     *                std::vector<T>、JsonOptional<T>、特化了JsonSchema的结构体
+     * JsonOptional<T>成员可以缺失或为null，其余成员都是必填的；未列出的字段忽略
+     */
+    template<typename T>
+    struct JsonSchema;
+
+    //可选字段，present为false时value为默认值
+    template<typename T>
+    struct JsonOptional{
+        bool present = false;
+        T value{};
+    };
+
+    template<typename Owner, typename Member>
+    struct JsonField{
+        const char* name;
+        size_t length;
+        Member Owner::* member;
+    };
+
+    template<typename Owner, typename Member, size_t N>
+    constexpr JsonField<Owner, Member> jsonField(const char (&name)[N], Member Owner::* member){
+        return JsonField<Owner, Member>{name, N - 1, member};
+    }
+
+    template<typename T>
+    bool decodeJson(const Json::Value& value, T& out, std::string* errorPath = nullptr);
+
+    namespace schema_detail{
+
+        //出错时由内向外拼接路径，例如"response.site_list[2].port"
+        inline void prependPath(std::string* errorPath, const char* name, size_t length){
+            if(errorPath == nullptr)    return;
+            if(errorPath->empty() || (*errorPath)[0] == '['){
+                errorPath->insert(0, name, length);
+            }else{
+                errorPath->insert(0, 1, '.');
+                errorPath->insert(0, name, length);
+            }
+        }
+
+        template<typename T, typename Enable = void>
+        struct Decoder;
+
+        template<>
+        struct Decoder<bool>{
+            static bool decode(const Json::Value& value, bool& out, std::string*){
+                if(!value.isBool())     return false;
+                out = value.asBool();
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<int>{
+            static bool decode(const Json::Value& value, int& out, std::string*){
+                if(!value.isInt())      return false;
+                out = value.asInt();
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<int64_t>{
+            static bool decode(const Json::Value& value, int64_t& out, std::string*){
+                if(!value.isInt64())    return false;
+                out = value.asInt64();
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<uint64_t>{
+            static bool decode(const Json::Value& value, uint64_t& out, std::string*){
+                if(!value.isUInt64())   return false;
+                out = value.asUInt64();
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<double>{
+            static bool decode(const Json::Value& value, double& out, std::string*){
+                if(!value.isNumeric())  return false;
+                out = value.asDouble();
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<std::string>{
+            static bool decode(const Json::Value& value, std::string& out, std::string*){
+                if(!value.isString())   return false;
+                const char* begin;
+                const char* end;
+                value.getString(&begin, &end);
+                out.assign(begin, end);
+                return true;
+            }
+        };
+
+        template<>
+        struct Decoder<Json::Value>{
+            static bool decode(const Json::Value& value, Json::Value& out, std::string*){
+                out = value;
+                return true;
+            }
+        };
+
+        template<typename T>
+        struct Decoder<std::vector<T>>{
+            static bool decode(const Json::Value& value, std::vector<T>& out, std::string* errorPath){
+                if(!value.isArray())    return false;
+                out.resize(value.size());
+                for(Json::ArrayIndex i = 0; i < value.size(); ++i){
+                    if(!Decoder<T>::decode(value[i], out[i], errorPath)){
+                        std::string index = "[" + std::to_string(i) + "]";
+                        prependPath(errorPath, index.data(), index.size());
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        template<typename T>
+        struct IsOptional : std::false_type{};
+
+        template<typename T>
+        struct IsOptional<JsonOptional<T>> : std::true_type{};
+
+        template<typename Owner, typename Member>
+        bool decodeMember(const JsonField<Owner, Member>& field, const Json::Value& value, Owner& out,
+                          std::string* errorPath, std::false_type){
+            return Decoder<Member>::decode(value, out.*(field.member), errorPath);
+        }
+
+        //可选字段为null时视为缺失
+        template<typename Owner, typename Member>
+        bool decodeMember(const JsonField<Owner, Member>& field, const Json::Value& value, Owner& out,
+                          std::string* errorPath, std::true_type){
+            auto& optional = out.*(field.member);
+            if(value.isNull()){
+                optional = Member();
+                return true;
+            }
+            optional.present = true;
+            return Decoder<decltype(optional.value)>::decode(value, optional.value, errorPath);
+        }
+
+        //返回匹配的字段序号；-1为未列出的字段，-2为类型错误
+        template<size_t I, typename Owner, typename Fields>
+        typename std::enable_if<I == std::tuple_size<Fields>::value, int>::type
+        dispatchField(const Fields&, const char*, size_t, const Json::Value&, Owner&, std::string*){
+            return -1;
+        }
+
+        template<size_t I, typename Owner, typename Fields>
+        typename std::enable_if<(I < std::tuple_size<Fields>::value), int>::type
+        dispatchField(const Fields& fields, const char* key, size_t length, const Json::Value& value,
+                      Owner& out, std::string* errorPath){
+            const auto& field = std::get<I>(fields);
+            if(field.length == length && memcmp(field.name, key, length) == 0){
+                using Member = typename std::remove_reference<decltype(out.*(field.member))>::type;
+                if(!decodeMember(field, value, out, errorPath, IsOptional<Member>())){
+                    prependPath(errorPath, field.name, field.length);
+                    return -2;
+                }
+                return static_cast<int>(I);
+            }
+            return dispatchField<I + 1>(fields, key, length, value, out, errorPath);
+        }
+
+        //缺失的必填字段；可选字段重置为缺失
+        template<size_t I, typename Owner, typename Fields>
+        typename std::enable_if<I == std::tuple_size<Fields>::value, bool>::type
+        checkMissing(const Fields&, uint64_t, Owner&, std::string*){
+            return true;
+        }
+
+        template<size_t I, typename Owner, typename Fields>
+        typename std::enable_if<(I < std::tuple_size<Fields>::value), bool>::type
+        checkMissing(const Fields& fields, uint64_t seen, Owner& out, std::string* errorPath){
+            const auto& field = std::get<I>(fields);
+            if((seen & (uint64_t(1) << I)) == 0){
+                using Member = typename std::remove_reference<decltype(out.*(field.member))>::type;
+                if(!IsOptional<Member>::value){
+                    prependPath(errorPath, field.name, field.length);
+                    return false;
+                }
+                out.*(field.member) = Member();
+            }
+            return checkMissing<I + 1>(fields, seen, out, errorPath);
+        }
+
+        template<typename T>
+        struct Decoder<T, decltype(JsonSchema<T>::fields(), void())>{
+            static bool decode(const Json::Value& value, T& out, std::string* errorPath){
+                if(!value.isObject())   return false;
+                constexpr auto fields = JsonSchema<T>::fields();
+                using Fields = typename std::remove_const<decltype(fields)>::type;
+                static_assert(std::tuple_size<Fields>::value <= 64, "JsonSchema supports at most 64 fields");
+
+                uint64_t seen = 0;
+                for(Json::ValueConstIterator it = value.begin(); it != value.end(); ++it){
+                    const char* keyEnd;
+                    const char* key = it.memberName(&keyEnd);
+                    int index = dispatchField<0>(fields, key, static_cast<size_t>(keyEnd - key), *it, out, errorPath);
+                    if(index == -2)     return false;
+                    if(index >= 0)      seen |= uint64_t(1) << index;
+                }
+                return checkMissing<0>(fields, seen, out, errorPath);
+            }
+        };
+    }
+
+    /**
+     * 按T的类型（通常是特化了JsonSchema的结构体）解码value
+     * 成功返回true；失败返回false，errorPath不为空时写入出错字段的路径
+     */
+    template<typename T>
+    bool decodeJson(const Json::Value& value, T& out, std::string* errorPath){
+        if(errorPath != nullptr)    errorPath->clear();
+        return schema_detail::Decoder<T>::decode(value, out, errorPath);
+    }
+}
+
+
+#endif //EXHIBITION_JSONSCHEMA_H
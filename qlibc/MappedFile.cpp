@@ -0,0 +1,52 @@
+//
+// Created by 78472 on 2022/7/13.
+//
+
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace qlibc{
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool MappedFile::open(const std::string &filePathName) {
+        close();
+        int fd = ::open(filePathName.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
+            return false;
+        }
+        struct stat st{};
+        if(::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+            ::close(fd);
+            return false;
+        }
+        if(st.st_size == 0){
+            ::close(fd);
+            return true;
+        }
+
+        void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(addr == MAP_FAILED){
+            return false;
+        }
+        //解析是顺序读取，提示内核加大预读
+        ::madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        _data = static_cast<const char*>(addr);
+        _size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if(_data != nullptr){
+            ::munmap(const_cast<char*>(_data), _size);
+            _data = nullptr;
+            _size = 0;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+//
+// Created by 78472 on 2022/7/13.
+//
+
+#ifndef EXHIBITION_MAPPEDFILE_H
+#define EXHIBITION_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace qlibc{
+
+    /*
+     * 只读映射整个文件，析构时解除映射
+     * 映射内容不以'\0'结尾，使用者不能越过size()读取
+     */
+    class MappedFile{
+    private:
+        const char* _data = nullptr;
+        size_t _size = 0;
+
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        //成功返回true，空文件也返回true（data()为nullptr）
+        bool open(const std::string& filePathName);
+
+        void close();
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+    };
+}
+
+
+#endif //EXHIBITION_MAPPEDFILE_H
@@ -5,72 +5,258 @@
 #include "QData.h"
 #include <sstream>
 #include <fstream>
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "JsonSax.h"
+#include "MappedFile.h"
 
 namespace qlibc{
-    QData::QData() {
-        _value.reset(new Json::Value(Json::nullValue));
-        _mutex.reset(new std::recursive_mutex);
+    typedef std::lock_guard<QDataMutex> Lock;
+
+    //对象成员，不是对象或不存在时返回nullptr；调用者负责加锁
+    static const Json::Value* findMember(const Json::Value& value, const std::string& key){
+        if(!value.isObject() || key.empty())    return nullptr;
+        return value.find(key.data(), key.data() + key.size());
+    }
+
+    //CharReader不是线程安全的，每个线程缓存一个，避免每次解析都创建
+    static Json::CharReader& threadReader(){
+        thread_local std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+        return *reader;
+    }
+
+    static void appendUInt(Json::LargestUInt value, std::string& out){
+        char buf[24];
+        char* end = buf + sizeof(buf);
+        char* cur = end;
+        do{
+            *--cur = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }while(value != 0);
+        out.append(cur, end);
+    }
+
+    static void appendInt(Json::LargestInt value, std::string& out){
+        if(value < 0){
+            out += '-';
+            appendUInt(Json::LargestUInt(0) - static_cast<Json::LargestUInt>(value), out);
+        }else{
+            appendUInt(static_cast<Json::LargestUInt>(value), out);
+        }
     }
 
-    QData::QData(const string &source) {
-        _value.reset(new Json::Value(Json::nullValue));
-        _mutex.reset(new std::recursive_mutex);
+    //与jsoncpp的输出保持一致：17位有效数字，整数值补".0"，非有限值输出null/±1e+9999
+    static void appendDouble(double value, std::string& out){
+        if(std::isnan(value)){
+            out += "null";
+            return;
+        }
+        if(std::isinf(value)){
+            out += value < 0 ? "-1e+9999" : "1e+9999";
+            return;
+        }
+        char buf[36];
+        int len = snprintf(buf, sizeof(buf), "%.17g", value);
+        bool isInteger = true;
+        for(int i = 0; i < len; ++i){
+            if(buf[i] == ',')   buf[i] = '.';
+            if(buf[i] == '.' || buf[i] == 'e')  isInteger = false;
+        }
+        out.append(buf, static_cast<size_t>(len));
+        if(isInteger)   out += ".0";
+    }
+
+    //转义规则与本仓库jsoncpp相同：只转义引号、反斜杠和\b\f\n\r\t，其余字节（包括UTF-8）原样输出
+    static void appendQuoted(const char* str, const char* end, std::string& out){
+        out += '"';
+        const char* run = str;
+        for(const char* c = str; c != end; ++c){
+            const char* escape = nullptr;
+            switch(*c){
+                case '"':   escape = "\\\""; break;
+                case '\\':  escape = "\\\\"; break;
+                case '\b':  escape = "\\b"; break;
+                case '\f':  escape = "\\f"; break;
+                case '\n':  escape = "\\n"; break;
+                case '\r':  escape = "\\r"; break;
+                case '\t':  escape = "\\t"; break;
+                default:    continue;
+            }
+            out.append(run, c);
+            out += escape;
+            run = c + 1;
+        }
+        out.append(run, end);
+        out += '"';
+    }
+
+    static void appendValue(const Json::Value& value, std::string& out){
+        switch(value.type()){
+            case Json::nullValue:
+                out += "null";
+                break;
+            case Json::intValue:
+                appendInt(value.asLargestInt(), out);
+                break;
+            case Json::uintValue:
+                appendUInt(value.asLargestUInt(), out);
+                break;
+            case Json::realValue:
+                appendDouble(value.asDouble(), out);
+                break;
+            case Json::stringValue: {
+                const char* str = nullptr;
+                const char* end = nullptr;
+                if(value.getString(&str, &end)){
+                    appendQuoted(str, end, out);
+                }
+                break;
+            }
+            case Json::booleanValue:
+                out += value.asBool() ? "true" : "false";
+                break;
+            case Json::arrayValue: {
+                out += '[';
+                Json::ArrayIndex size = value.size();
+                for(Json::ArrayIndex i = 0; i < size; ++i){
+                    if(i != 0)  out += ',';
+                    appendValue(value[i], out);
+                }
+                out += ']';
+                break;
+            }
+            case Json::objectValue: {
+                //成员按key有序存储，遍历顺序与getMemberNames相同
+                out += '{';
+                bool first = true;
+                for(auto it = value.begin(); it != value.end(); ++it){
+                    if(!first)  out += ',';
+                    first = false;
+                    const char* end = nullptr;
+                    const char* name = it.memberName(&end);
+                    appendQuoted(name, end, out);
+                    out += ':';
+                    appendValue(*it, out);
+                }
+                out += '}';
+                break;
+            }
+        }
+    }
+
+    QData::QData() : _value(sharedNull()){
+    }
+
+    QData::QData(const string &source) : _value(std::make_shared<Json::Value>(Json::nullValue)){
         parseJson(source, *_value);
     }
 
-    QData::QData(const char* str, int size){
-        _value.reset(new Json::Value(Json::nullValue));
-        _mutex.reset(new std::recursive_mutex);
+    QData::QData(const char* str, int size) : _value(std::make_shared<Json::Value>(Json::nullValue)){
         parseJson(str, size, *_value);
     }
 
-    QData::QData(const Json::Value &val) {
-        _value.reset(new Json::Value(val));
-        _mutex.reset(new std::recursive_mutex);
+    QData::QData(const Json::Value &val) : _value(std::make_shared<Json::Value>(val)){
+    }
+
+    QData::QData(Json::Value &&val) : _value(std::make_shared<Json::Value>(std::move(val))){
     }
 
-    QData::QData(const QData& data) {
-        _value.reset(new Json::Value(data.asValue()));
-        _mutex.reset(new std::recursive_mutex);
+    QData::QData(const QData& data) : _value(data.sharedValue()){
     }
 
     QData& QData::operator= (const QData& data){
-        _value.reset(new Json::Value(data.asValue()));
+        std::shared_ptr<Json::Value> v = data.sharedValue();
+        Lock lg(_mutex);
+        _value = std::move(v);
+        return *this;
+    }
+
+    QData::QData(QData&& data) noexcept {
+        Lock lg(data._mutex);
+        _value = std::move(data._value);
+        data._value = sharedNull();
+    }
+
+    QData& QData::operator= (QData&& data) noexcept{
+        if(this == &data)   return *this;
+        std::shared_ptr<Json::Value> v;
+        {
+            Lock lg(data._mutex);
+            v = std::move(data._value);
+            data._value = sharedNull();
+        }
+        Lock lg(_mutex);
+        _value = std::move(v);
         return *this;
     }
 
-    Json::Value& QData::asValue() const{
+    const Json::Value& QData::asValue() const{
+        Lock lg(_mutex);
         return *_value;
     }
 
+    const Json::Value& QData::value() const{
+        Lock lg(_mutex);
+        return *_value;
+    }
+
+    const Json::Value* QData::findValue(const string &key) const{
+        Lock lg(_mutex);
+        return findMember(*_value, key);
+    }
+
+    const Json::Value& QData::viewValue(const string &key) const{
+        const Json::Value* v = findValue(key);
+        return v != nullptr ? *v : Json::Value::nullSingleton();
+    }
+
+    const Json::Value& QData::viewArrayElement(Json::ArrayIndex index) const{
+        Lock lg(_mutex);
+        if(!_value->isArray() || !_value->isValidIndex(index))  return Json::Value::nullSingleton();
+        const Json::Value& array = *_value;
+        return array[index];
+    }
+
     Json::ArrayIndex QData::size() const {
+        Lock lg(_mutex);
         return _value->size();
     }
 
     Json::ValueType QData::type() const {
+        Lock lg(_mutex);
         return _value->type();
     }
 
     bool QData::empty() const {
+        Lock lg(_mutex);
         return _value->empty();
     }
 
     void QData::clear() {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if(_value->isNull() || _value->isObject() || _value->isArray()){
-            _value->clear();
+            if(_value.use_count() == 1){
+                _value->clear();
+            }else{
+                _value = std::make_shared<Json::Value>(_value->type());
+            }
         }
     }
 
     void QData::removeMember(const string &key) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        if(_value->isNull() || _value->isObject()){
-            _value->removeMember(key.c_str());
+        Lock lg(_mutex);
+        if(_value->isObject() && _value->isMember(key)){
+            detach().removeMember(key.c_str());
         }
     }
 
     Json::Value::Members QData::getMemberNames() const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if(_value->isNull() || _value->isObject()){
             return _value->getMemberNames();
         }
@@ -78,151 +264,180 @@ namespace qlibc{
     }
 
     QData& QData::setInitData(const QData& data){
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        setInitValue(data.asValue());
+        std::shared_ptr<Json::Value> v = data.sharedValue();
+        Lock lg(_mutex);
+        _value = std::move(v);
         return *this;
     }
 
     QData& QData::setInitValue(const Json::Value& value){
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        *_value = value;
+        std::shared_ptr<Json::Value> v = std::make_shared<Json::Value>(value);
+        Lock lg(_mutex);
+        _value = std::move(v);
         return *this;
     }
 
+    QData& QData::setInitValue(Json::Value&& value){
+        std::shared_ptr<Json::Value> v = std::make_shared<Json::Value>(std::move(value));
+        Lock lg(_mutex);
+        _value = std::move(v);
+        return *this;
+    }
+
+    //序列化期间只持有树的引用，不持有锁
     void QData::toJsonString(string &str, bool expand) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        std::shared_ptr<Json::Value> v = sharedValue();
         if(expand)
-            str = _value->toStyledString();
+            str = v->toStyledString();
         else
-            valueToJsonString(*_value, str);
+            valueToJsonString(*v, str);
     }
 
     std::string QData::toJsonString(bool expand) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
         string str;
         toJsonString(str, expand);
         return str;
     }
 
     void QData::loadFromFile(const string &filePathName) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        _value.reset(new Json::Value(parseFromFile(filePathName)));
+        std::shared_ptr<Json::Value> v = std::make_shared<Json::Value>(parseFromFile(filePathName));
+        Lock lg(_mutex);
+        _value = std::move(v);
     }
 
     void QData::saveToFile(const string &filePathName, bool expand) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        writeToFile(filePathName, *_value, expand);
+        std::shared_ptr<Json::Value> v = sharedValue();
+        writeToFile(filePathName, *v, expand);
     }
 
     bool QData::getBool(const string &key, bool defValue) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        if(!_value->isObject() || key.empty()) return defValue;
-        Json::Value v = _value->get(key, Json::Value());
-        if(v.isBool())  return v.asBool();
+        Lock lg(_mutex);
+        const Json::Value* v = findMember(*_value, key);
+        if(v != nullptr && v->isBool())  return v->asBool();
         return defValue;
     }
 
     bool QData::getBool(const std::string& key) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
         return getBool(key, false);
     }
 
     QData &QData::setBool(const string &key, bool value) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if((!_value->isNull() && !_value->isObject()) || key.empty())   return *this;
-        (*_value)[key] = value;
+        detach()[key] = value;
         return *this;
     }
 
     int QData::getInt(const string &key, int defValue) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        if(!_value->isObject() || key.empty())  return defValue;
-        Json::Value v = (*_value).get(key, Json::Value());
-        if(v.isInt())   return v.asInt();
+        Lock lg(_mutex);
+        const Json::Value* v = findMember(*_value, key);
+        if(v != nullptr && v->isInt())   return v->asInt();
         return defValue;
     }
 
     int QData::getInt(const string &key) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
         return getInt(key, -1);
     }
 
     QData &QData::setInt(const string &key, int val) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if((!_value->isNull() && !_value->isObject()) || key.empty())
             return *this;
-        (*_value)[key] = val;
+        detach()[key] = val;
         return *this;
     }
 
     std::string QData::getString(const string &key, const string &defValue) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if(!_value->isObject() || key.empty())  return defValue;
-        Json::Value v = _value->get(key, Json::Value());
-        if(v.type() == Json::objectValue || v.type() == Json::arrayValue){
+        const Json::Value* v = findMember(*_value, key);
+        if(v == nullptr)    return "";
+        if(v->type() == Json::objectValue || v->type() == Json::arrayValue){
             return defValue;
         }
-        return v.asString();
+        return v->asString();
     }
 
     std::string QData::getString(const string &key) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
         return getString(key, "");
     }
 
     QData &QData::setString(const string &key, const string &value) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
         if((!_value->isNull() && !_value->isObject()) || value.empty())
             return *this;
-        (*_value)[key] = value;
+        detach()[key] = value;
         return *this;
     }
 
+    //持有树的引用后，树在此期间不会被原地修改，不需要持有本对象的锁再去加data的锁
     void QData::getData(const string &key, QData &data) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        if(!_value->isObject() || key.empty()){
-            data.setInitValue(Json::Value());
+        std::shared_ptr<Json::Value> v = sharedValue();
+        const Json::Value* found = findMember(*v, key);
+        if(found == nullptr){
+            data.setInitData(QData());
             return;
         }
-        Json::Value v = _value->get(key, Json::Value());
-        data.setInitValue(v);
+        data.setInitValue(*found);
     }
 
     QData QData::getData(const string &key) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        QData data;
-        getData(key, data);
-        return data;
+        Lock lg(_mutex);
+        const Json::Value* v = findMember(*_value, key);
+        if(v == nullptr){
+            return QData();
+        }
+        return QData(*v);
     }
 
     QData& QData::putData(const string &key, const QData &data) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        std::shared_ptr<Json::Value> v = data.sharedValue();
+        Lock lg(_mutex);
         if((!_value->isNull() && !_value->isObject()) || key.empty())
             return *this;
-        (*_value)[key] = data.asValue();
+        detach()[key] = *v;
+        return *this;
+    }
+
+    QData& QData::putData(const string &key, QData &&data) {
+        Json::Value v = data.releaseValue();
+        Lock lg(_mutex);
+        if((!_value->isNull() && !_value->isObject()) || key.empty())
+            return *this;
+        detach()[key] = std::move(v);
         return *this;
     }
 
     void QData::getValue(const string &key, Json::Value &value) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        if(!_value->isObject() || key.empty()){
+        Lock lg(_mutex);
+        const Json::Value* v = findMember(*_value, key);
+        if(v == nullptr){
             value = Json::Value();
             return;
         }
-        value = _value->get(key, Json::Value());
+        value = *v;
     }
 
     Json::Value QData::getValue(const string &key) const{
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
-        Json::Value v;
-        getValue(key, v);
-        return v;
+        Lock lg(_mutex);
+        const Json::Value* v = findMember(*_value, key);
+        if(v == nullptr){
+            return Json::Value();
+        }
+        return *v;
     }
 
     QData& QData::setValue(const string &key, const Json::Value &value) {
-        std::lock_guard<std::recursive_mutex> lg(*_mutex);
+        Lock lg(_mutex);
+        if((!_value->isNull() && !_value->isObject()) || key.empty())  return *this;
+        detach()[key] = value;
+        return *this;
+    }
+
+    QData& QData::setValue(const string &key, Json::Value &&value) {
+        Lock lg(_mutex);
         if((!_value->isNull() && !_value->isObject()) || key.empty())  return *this;
-        (*_value)[key] = value;
+        detach()[key] = std::move(value);
         return *this;
     }
 
@@ -232,24 +447,11 @@ namespace qlibc{
     }
 
     bool QData::parseJson(const string &srcStr, Json::Value &destValue) {
-        Json::CharReaderBuilder b;
-        std::unique_ptr<Json::CharReader> reader(b.newCharReader());
-        const char* str = srcStr.c_str();
-        JSONCPP_STRING errs;
-        bool ok = reader->parse(str, str + srcStr.size(), &destValue, &errs);
-        if (!ok){
-            destValue = Json::nullValue;
-            return false;
-        }
-        return true;
+        return parseJson(srcStr.data(), static_cast<int>(srcStr.size()), destValue);
     }
 
     bool QData::parseJson(const char* srcStr, int srcSize, Json::Value& destValue){
-        Json::CharReaderBuilder b;
-        std::unique_ptr<Json::CharReader> reader(b.newCharReader());
-        const char* str = srcStr;
-        JSONCPP_STRING errs;
-        bool ok = reader->parse(str, str + srcSize, &destValue, &errs);
+        bool ok = threadReader().parse(srcStr, srcStr + srcSize, &destValue, nullptr);
         if (!ok){
             destValue = Json::nullValue;
             return false;
@@ -264,24 +466,20 @@ namespace qlibc{
     }
 
     bool QData::valueToJsonString(const Json::Value &obj, string &ret) {
-        std::ostringstream os;
-        Json::StreamWriterBuilder builder;
-        builder.settings_["indentation"] = "";
-        std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-        writer->write(obj, &os);
-        if(!os.good()){
-            ret = "";
-            return false;
-        }
-        ret = os.str();
+        ret.clear();
+        appendValue(obj, ret);
         return true;
     }
 
+    void QData::appendJsonString(const Json::Value &obj, string &out) {
+        appendValue(obj, out);
+    }
+
+    //文件整体mmap后直接解析，不经过ifstream/stringstream复制
     bool QData::parseFromFile(const string &fileNamePath, Json::Value &value) {
-        ifstream infile(fileNamePath,std::ios::in);
-        Json::CharReaderBuilder b;
-        JSONCPP_STRING errs;
-        if (!parseFromStream(b, infile, &value, &errs)) {
+        MappedFile file;
+        if(!file.open(fileNamePath) ||
+           !threadReader().parse(file.data(), file.data() + file.size(), &value, nullptr)){
             value = Json::nullValue;
             return false;
         }
@@ -294,6 +492,60 @@ namespace qlibc{
         return value;
     }
 
+    bool QData::parseFromFile(const string &fileNamePath, const std::vector<std::string> &keyPaths, Json::Value &value) {
+        value = Json::nullValue;
+        JsonSubsetHandler handler(keyPaths, value);
+        if(!parseFileSax(fileNamePath, handler)){
+            value = Json::nullValue;
+            return false;
+        }
+        return true;
+    }
+
+    //写入同目录下的临时文件并fsync，再rename覆盖目标文件，任何时刻目标文件都是完整的旧内容或新内容
+    static bool writeFileAtomic(const string& filePathName, const char* data, size_t size){
+        std::string tmpPath = filePathName + ".tmpXXXXXX";
+        int fd = mkostemp(&tmpPath[0], O_CLOEXEC);
+        if(fd < 0){
+            return false;
+        }
+
+        //沿用原文件的权限，mkostemp创建的文件默认为0600
+        struct stat st{};
+        mode_t mode = 0644;
+        if(::stat(filePathName.c_str(), &st) == 0){
+            mode = st.st_mode & 07777;
+        }
+        bool ok = ::fchmod(fd, mode) == 0;
+
+        while(ok && size > 0){
+            ssize_t n = ::write(fd, data, size);
+            if(n < 0){
+                if(errno == EINTR)  continue;
+                ok = false;
+                break;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        ok = ok && ::fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        if(!ok || ::rename(tmpPath.c_str(), filePathName.c_str()) != 0){
+            ::unlink(tmpPath.c_str());
+            return false;
+        }
+
+        //rename本身要落盘需要fsync所在目录
+        size_t slash = filePathName.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : filePathName.substr(0, slash));
+        int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(dirFd >= 0){
+            ::fsync(dirFd);
+            ::close(dirFd);
+        }
+        return true;
+    }
+
     bool QData::writeToFile(const string &filePathName, const Json::Value &value, bool expand) {
         string content;
         if(expand)
@@ -301,51 +553,92 @@ namespace qlibc{
         else
             valueToJsonString(value, content);
 
-        std::ofstream out(filePathName, std::ios::out);
-        if(out.is_open()){
-            out << content;
-            return true;
-        }
-
-        return false;
+        return writeFileAtomic(filePathName, content.data(), content.size());
     }
 
-    void QData::getArrayElement(Json::ArrayIndex index, QData &element) {
-        if(_value->isNull() || _value->isArray()){
-            Json::Value v = _value->get(index, Json::Value());
-            element.setInitValue(v);
+    void QData::getArrayElement(Json::ArrayIndex index, QData &element) const{
+        std::shared_ptr<Json::Value> v = sharedValue();
+        if(v->isNull() || v->isArray()){
+            const Json::Value& array = *v;
+            element.setInitValue(v->isValidIndex(index) ? array[index] : Json::Value::nullSingleton());
         }
     }
 
-    QData QData::getArrayElement(Json::ArrayIndex index) {
+    QData QData::getArrayElement(Json::ArrayIndex index) const{
         QData data;
         getArrayElement(index, data);
         return data;
     }
 
-    QData& QData::arrayInsert(Json::ArrayIndex index, QData &element) {
+    QData& QData::arrayInsert(Json::ArrayIndex index, const QData &element) {
+        std::shared_ptr<Json::Value> v = element.sharedValue();
+        Lock lg(_mutex);
         if(_value->isNull() || _value->isArray()){
-            (*_value)[index] = element.asValue();
+            detach()[index] = *v;
         }
         return *this;
     }
 
+    //先取得data的引用再修改：data与本对象共享同一棵树时（包括append自身），修改前会先复制
     QData& QData::append(const QData &data) {
+        std::shared_ptr<Json::Value> v = data.sharedValue();
+        return append(*v);
+    }
+
+    QData& QData::append(QData &&data) {
+        return append(data.releaseValue());
+    }
+
+    QData& QData::append(const Json::Value &value) {
+        Lock lg(_mutex);
         if(_value->isNull() || _value->isArray()){
-            _value->append(data.asValue());
-            return *this;
+            detach().append(value);
         }
         return *this;
     }
 
-    QData& QData::append(const Json::Value &value) {
-        append( QData(value));
+    QData& QData::append(Json::Value &&value) {
+        Lock lg(_mutex);
+        if(_value->isNull() || _value->isArray()){
+            detach().append(std::move(value));
+        }
         return *this;
     }
 
     void QData::deleteArrayItem(Json::ArrayIndex index){
+        Lock lg(_mutex);
+        if(!_value->isArray() || !_value->isValidIndex(index))  return;
         Json::Value value;
-        _value->removeIndex(index, &value);
+        detach().removeIndex(index, &value);
+    }
+
+    const std::shared_ptr<Json::Value>& QData::sharedNull() {
+        static const std::shared_ptr<Json::Value> null = std::make_shared<Json::Value>(Json::nullValue);
+        return null;
+    }
+
+    std::shared_ptr<Json::Value> QData::sharedValue() const {
+        Lock lg(_mutex);
+        return _value;
+    }
+
+    Json::Value QData::releaseValue() {
+        Lock lg(_mutex);
+        Json::Value value;
+        if(_value.use_count() == 1){
+            value.swap(*_value);
+        }else{
+            value = *_value;
+        }
+        _value = sharedNull();
+        return value;
+    }
+
+    Json::Value& QData::detach() {
+        if(_value.use_count() != 1){
+            _value = std::make_shared<Json::Value>(*_value);
+        }
+        return *_value;
     }
 
 }
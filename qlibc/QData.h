@@ -8,30 +8,67 @@
 #include <string>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include "jsoncpp/json.h"
 
 using namespace std;
 
 namespace qlibc{
+#ifdef QLIBC_QDATA_THREAD_CONFINED
+    //QData只在单个线程内使用（如请求内的局部对象），不加锁
+    struct QDataNullMutex{
+        void lock(){}
+        void unlock(){}
+    };
+    typedef QDataNullMutex QDataMutex;
+#else
+    typedef std::mutex QDataMutex;
+#endif
+
     /*
  * 封装Json::Value的操作，增加判断条件，避免操作抛出异常从而终止程序
  */
+    /*
+     * 写时复制：
+     *      1. 拷贝构造、赋值只增加_value的引用计数，多个QData共享同一棵树，共享期间该树只读
+     *      2. 修改前若_value被共享，先复制一份独占的树再修改（detach），其他持有者不受影响
+     *      3. 移动构造、移动赋值直接转移_value，被移动的对象变为null
+     *      4. asValue/value/findValue/viewValue返回树内节点的只读引用，不复制；在本对象下次修改之前有效
+     *         不提供可修改的引用：引用在detach之后仍指向共享的树，绕过写时复制；修改通过setXxx、putData、append等接口
+     *      5. 每个对象一把互斥锁，保护_value的读取和替换；定义QLIBC_QDATA_THREAD_CONFINED时不加锁
+     *         多线程共享、读多写少的配置使用QDataSnapshot
+     */
     class QData {
     private:
+        friend class QDataSnapshot;
+
         std::shared_ptr<Json::Value> _value;
-        std::shared_ptr<std::recursive_mutex> _mutex;
+        mutable QDataMutex _mutex;
     public:
         //构造函数，失败则_value被赋值为Json::Value(Json::nullValue)
         QData();
         explicit QData(const std::string& source);
         explicit QData(const char* str, int size);
         explicit QData(const Json::Value& val);
-        //拷贝构造、赋值函数
+        explicit QData(Json::Value&& val);
+        //拷贝构造、赋值函数，与data共享同一棵树
         QData(const QData& data);
         QData& operator= (const QData& data);
+        //移动构造、赋值函数，data变为null
+        QData(QData&& data) noexcept;
+        QData& operator= (QData&& data) noexcept;
 
     public:
-        Json::Value& asValue() const;
+        //只读视图，不复制
+        const Json::Value& asValue() const;
+        const Json::Value& value() const;
+        //key对应节点的只读视图，不存在返回nullptr
+        const Json::Value* findValue(const std::string& key) const;
+        //key对应节点的只读视图，不存在返回null节点
+        const Json::Value& viewValue(const std::string& key) const;
+        //数组元素的只读视图，不存在返回null节点
+        const Json::Value& viewArrayElement(Json::ArrayIndex index) const;
+
         Json::ArrayIndex size() const;
         Json::ValueType type() const;
         bool empty() const;
@@ -42,6 +79,7 @@ namespace qlibc{
         //将_value赋值为新值
         QData& setInitData(const QData& data);
         QData& setInitValue(const Json::Value& value);
+        QData& setInitValue(Json::Value&& value);
 
         void toJsonString(std::string& str, bool expand = false) const;
         std::string toJsonString(bool expand = false) const;
@@ -63,23 +101,42 @@ namespace qlibc{
         void getData(const std::string& key, QData& data) const;
         QData getData(const std::string& key) const;
         QData& putData(const std::string& key, const QData& data);
+        QData& putData(const std::string& key, QData&& data);
 
         void getValue(const std::string& key, Json::Value& value) const;
         Json::Value getValue(const std::string& key) const;
         QData& setValue(const std::string& key, const Json::Value& value);
+        QData& setValue(const std::string& key, Json::Value&& value);
 
-        void getArrayElement(Json::ArrayIndex index, QData& element);
+        void getArrayElement(Json::ArrayIndex index, QData& element) const;
 
-        QData getArrayElement(Json::ArrayIndex index);
+        QData getArrayElement(Json::ArrayIndex index) const;
 
-        QData& arrayInsert(Json::ArrayIndex, QData& element);
+        QData& arrayInsert(Json::ArrayIndex, const QData& element);
 
         QData& append(const QData& data);
 
+        QData& append(QData&& data);
+
         QData& append(const Json::Value &value);
 
+        QData& append(Json::Value&& value);
+
         void deleteArrayItem(Json::ArrayIndex index);
 
+    private:
+        //所有默认构造和被移动的对象共享的null节点
+        static const std::shared_ptr<Json::Value>& sharedNull();
+
+        //加锁取得_value的引用，用于跨对象操作时只持有一个锁
+        std::shared_ptr<Json::Value> sharedValue() const;
+
+        //取出树的内容，独占时直接转移，共享时复制；之后本对象变为null
+        Json::Value releaseValue();
+
+        //修改前调用，调用者持有_mutex；共享时先复制一份独占的树
+        Json::Value& detach();
+
     public:
         /**
         * 判断源字符串中是否含有目标字符串
@@ -107,17 +164,30 @@ namespace qlibc{
         static Json::Value parseJson(const std::string& srcStr);
 
         /**
-         * 将Json::Value对象转换为字符串，失败则ret为空。
+         * 将Json::Value对象转换为紧凑格式的字符串，失败则ret为空。
+         * 直接写入ret，复用ret已有的容量，重复使用同一个ret时基本不再分配内存
          * 成功返回true; 失败返回false,且ret为空;
          */
         static bool valueToJsonString(const Json::Value& obj, std::string& ret);
 
         /**
-         * 将从文件读取的内容转换为Json::Value对象
+         * 将Json::Value对象转换为紧凑格式的字符串，追加到out末尾
+         */
+        static void appendJsonString(const Json::Value& obj, std::string& out);
+
+        /**
+         * 将从文件读取的内容转换为Json::Value对象，文件通过mmap读取，不做中间复制
          * 成功返回true; 失败返回fasle,且value为Json::Value(Json::nullValue)
          */
         static bool parseFromFile(const std::string& fileNamePath, Json::Value& value);
 
+        /**
+         * 只提取文件中keyPaths指定的部分（格式见JsonSubsetHandler，如"/device_list"），按原路径放入value
+         * 其余内容只扫描不建树，所有路径提取完后不再继续读取
+         * 成功返回true; 失败返回fasle,且value为Json::Value(Json::nullValue)
+         */
+        static bool parseFromFile(const std::string& fileNamePath, const std::vector<std::string>& keyPaths, Json::Value& value);
+
         /**
          * 将从文件读取的内容转换为Json::Value对象
          * 失败返回Json::Value(Json::nullValue)
@@ -125,7 +195,8 @@ namespace qlibc{
         static Json::Value parseFromFile(const std::string& filePathName);
 
         /**
-         * 将value对象转换为字符串后写入到文件中（truncate方式）
+         * 将value对象转换为字符串后写入到文件中
+         * 先写临时文件并fsync，再rename替换原文件，写入失败或中途掉电时原文件保持不变
          * 成功返回true;失败返回false;
          */
         static bool writeToFile(const std::string& filePathName, const Json::Value& value, bool expand = false);
@@ -0,0 +1,115 @@
+//
+// Created by 78472 on 2022/7/12.
+//
+
+#include "QDataSnapshot.h"
+#include "Epoch.h"
+
+namespace qlibc{
+
+    QDataSnapshot::ReadView::ReadView(const Version *version) : _version(version), _active(true){
+    }
+
+    QDataSnapshot::ReadView::ReadView(ReadView &&view) noexcept : _version(view._version), _active(view._active){
+        view._active = false;
+    }
+
+    QDataSnapshot::ReadView::~ReadView() {
+        if(_active){
+            epochExit();
+        }
+    }
+
+    const Json::Value& QDataSnapshot::ReadView::value() const {
+        return *_version->value;
+    }
+
+    const Json::Value& QDataSnapshot::ReadView::viewValue(const string &key) const {
+        const Json::Value& root = *_version->value;
+        if(!root.isObject() || key.empty())     return Json::Value::nullSingleton();
+        const Json::Value* v = root.find(key.data(), key.data() + key.size());
+        return v != nullptr ? *v : Json::Value::nullSingleton();
+    }
+
+    bool QDataSnapshot::ReadView::getBool(const string &key, bool defValue) const {
+        const Json::Value& v = viewValue(key);
+        return v.isBool() ? v.asBool() : defValue;
+    }
+
+    int QDataSnapshot::ReadView::getInt(const string &key, int defValue) const {
+        const Json::Value& v = viewValue(key);
+        return v.isInt() ? v.asInt() : defValue;
+    }
+
+    std::string QDataSnapshot::ReadView::getString(const string &key, const string &defValue) const {
+        const Json::Value& v = viewValue(key);
+        if(v.isString())    return v.asString();
+        if(v.isObject() || v.isArray())     return defValue;
+        return v.asString();
+    }
+
+    QData QDataSnapshot::ReadView::toData() const {
+        QData data;
+        data._value = _version->value;
+        return data;
+    }
+
+    QDataSnapshot::QDataSnapshot() : QDataSnapshot(QData()){
+    }
+
+    QDataSnapshot::QDataSnapshot(const QData &data) : _current(nullptr), _version(0){
+        Version* version = new Version;
+        version->value = data.sharedValue();
+        _current.store(version);
+    }
+
+    //析构时不应再有读者
+    QDataSnapshot::~QDataSnapshot() {
+        delete _current.load();
+        for(Version* version : _retired){
+            delete version;
+        }
+    }
+
+    //先登记再读取当前版本，写者发布后的回收检查一定能看到本次登记
+    QDataSnapshot::ReadView QDataSnapshot::read() const {
+        epochEnter();
+        return ReadView(_current.load());
+    }
+
+    QData QDataSnapshot::get() const {
+        return read().toData();
+    }
+
+    void QDataSnapshot::publish(const QData &data) {
+        std::lock_guard<std::mutex> lg(_writeMutex);
+        publishLocked(data);
+    }
+
+    uint64_t QDataSnapshot::version() const {
+        return _version.load(std::memory_order_relaxed);
+    }
+
+    void QDataSnapshot::publishLocked(const QData &data) {
+        Version* version = new Version;
+        version->value = data.sharedValue();
+        Version* old = _current.exchange(version);
+        old->retireEpoch = epochRetire();
+        _retired.push_back(old);
+        _version.fetch_add(1, std::memory_order_relaxed);
+        reclaimLocked();
+    }
+
+    void QDataSnapshot::reclaimLocked() {
+        uint64_t minActive = epochMinActive();
+        size_t kept = 0;
+        for(Version* version : _retired){
+            if(version->retireEpoch <= minActive){
+                delete version;
+            }else{
+                _retired[kept++] = version;
+            }
+        }
+        _retired.resize(kept);
+    }
+}
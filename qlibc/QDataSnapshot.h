@@ -0,0 +1,107 @@
+//
+// Created by 78472 on 2022/7/12.
+//
+
+#ifndef EXHIBITION_QDATASNAPSHOT_H
+#define EXHIBITION_QDATASNAPSHOT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "QData.h"
+
+namespace qlibc{
+
+    /*
+     * 多线程共享、读多写少的配置（RCU方式）：
+     *      1. 当前版本是一棵不可变的树，通过原子指针发布；读者只读原子指针，不加锁、不修改引用计数
+     *      2. 写者复制当前版本、修改后发布新版本，写者之间用互斥锁串行
+     *      3. 旧版本在所有可能读到它的读者退出后才释放（基于epoch的延迟回收）
+     *
+     * 读取：
+     *      auto view = config.read();
+     *      int port = view.getInt("port");
+     * view在作用域内始终看到同一个版本，不要长期持有（会推迟旧版本的回收）
+     *
+     * 修改：
+     *      config.update([](QData& data){ data.setInt("port", 9000); });
+     */
+    class QDataSnapshot{
+    private:
+        struct Version{
+            std::shared_ptr<Json::Value> value;
+            uint64_t retireEpoch = 0;
+        };
+
+        std::atomic<Version*> _current;
+        std::atomic<uint64_t> _version;
+        std::mutex _writeMutex;
+        std::vector<Version*> _retired;
+
+    public:
+        /*
+         * 只读视图，持有期间所看到的版本不会被释放
+         */
+        class ReadView{
+        private:
+            friend class QDataSnapshot;
+            const Version* _version;
+            bool _active;
+
+            explicit ReadView(const Version* version);
+
+        public:
+            ReadView(ReadView&& view) noexcept;
+            ReadView(const ReadView&) = delete;
+            ReadView& operator=(const ReadView&) = delete;
+            ReadView& operator=(ReadView&&) = delete;
+            ~ReadView();
+
+            const Json::Value& value() const;
+            //key对应节点的只读视图，不存在返回null节点
+            const Json::Value& viewValue(const std::string& key) const;
+
+            bool getBool(const std::string& key, bool defValue = false) const;
+            int getInt(const std::string& key, int defValue = -1) const;
+            std::string getString(const std::string& key, const std::string& defValue = "") const;
+
+            //与当前版本共享同一棵树的QData，修改时写时复制，不影响快照
+            QData toData() const;
+        };
+
+        QDataSnapshot();
+        explicit QDataSnapshot(const QData& data);
+        ~QDataSnapshot();
+
+        QDataSnapshot(const QDataSnapshot&) = delete;
+        QDataSnapshot& operator=(const QDataSnapshot&) = delete;
+
+        ReadView read() const;
+
+        //当前版本的QData，与快照共享同一棵树
+        QData get() const;
+
+        //发布新版本；与data共享同一棵树，之后修改data不会影响已发布的版本
+        void publish(const QData& data);
+
+        //在当前版本的副本上修改后发布
+        template<typename Fn>
+        void update(Fn&& fn){
+            std::lock_guard<std::mutex> lg(_writeMutex);
+            QData data = get();
+            fn(data);
+            publishLocked(data);
+        }
+
+        //已发布的版本数，每次publish/update加1
+        uint64_t version() const;
+
+    private:
+        void publishLocked(const QData& data);
+        void reclaimLocked();
+    };
+}
+
+
+#endif //EXHIBITION_QDATASNAPSHOT_H
@@ -0,0 +1,166 @@
+/*
+ * access_log.cpp
+ *
+ *  Created on: 2022年7月6日
+ */
+#include <chrono>
+#include "access_log.h"
+#include "log/Logging.h"
+#include "metrics/Metrics.h"
+
+using namespace servicesite;
+
+namespace servicesite {
+
+// 指标对象属于 metrics::Registry::global()，/metrics 与 debug 服务读取同一份数据
+class ServiceStats {
+public:
+    const string serviceId;
+    ServiceStats* next = nullptr;
+
+    metrics::Counter& errors;
+    metrics::Counter& bytesIn;
+    metrics::Counter& bytesOut;
+
+    metrics::Histogram& parse;
+    metrics::Histogram& handler;
+    metrics::Histogram& write;
+    metrics::Histogram& total;
+
+    explicit ServiceStats(string pServiceId)
+        : serviceId(std::move(pServiceId)),
+          errors(metrics::Registry::global().counter("site_request_errors_total",
+                                                     "Site requests answered with status >= 400", labels(nullptr, nullptr))),
+          bytesIn(metrics::Registry::global().counter("site_request_bytes_total",
+                                                      "Site request and response body bytes", labels("direction", "in"))),
+          bytesOut(metrics::Registry::global().counter("site_request_bytes_total",
+                                                       "Site request and response body bytes", labels("direction", "out"))),
+          parse(phase("parse")),
+          handler(phase("handler")),
+          write(phase("write")),
+          total(phase("total")) {}
+
+private:
+    string labels(const char* key, const char* value) const {
+        string result = metrics::Registry::label("service_id", serviceId);
+        if (key != nullptr) {
+            result += "," + metrics::Registry::label(key, value);
+        }
+        return result;
+    }
+
+    metrics::Histogram& phase(const char* name) const {
+        return metrics::Registry::global().histogram("site_request_phase_microseconds",
+                                                     "Site request latency by phase: parse, handler, write, total",
+                                                     labels("phase", name));
+    }
+};
+
+}
+
+// 未能解析出 service_id 的请求（格式错误、非站点请求等）
+static const string UNKNOWN_REQUEST_ID = "-";
+
+static thread_local string currentRequestId;
+
+AccessLog AccessLog::instance;
+
+AccessLog::AccessLog() : statsHead(nullptr) {
+}
+
+void AccessLog::setRequestId(const string& id) {
+    currentRequestId = id;
+}
+
+// 只插入不删除的单链表，service_id 数量很少，查找直接遍历
+ServiceStats* AccessLog::findOrCreateStats(const string& serviceId) {
+    ServiceStats* head = statsHead.load(std::memory_order_acquire);
+    for (ServiceStats* item = head; item != nullptr; item = item->next) {
+        if (item->serviceId == serviceId) {
+            return item;
+        }
+    }
+
+    ServiceStats* created = new ServiceStats(serviceId);
+    while (true) {
+        created->next = head;
+        if (statsHead.compare_exchange_weak(head, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return created;
+        }
+        // 其他线程插入了新节点，检查是否已经有相同的 service_id
+        for (ServiceStats* item = head; item != created->next; item = item->next) {
+            if (item->serviceId == serviceId) {
+                delete created;
+                return item;
+            }
+        }
+    }
+}
+
+static uint64_t elapsedMicros(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    if (from.time_since_epoch().count() == 0 || to < from) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+void AccessLog::log(const Request& request, const Response& response) {
+    auto now = std::chrono::steady_clock::now();
+
+    const string& requestId = currentRequestId.empty() ? UNKNOWN_REQUEST_ID : currentRequestId;
+    ServiceStats* stats = findOrCreateStats(requestId);
+
+    // 没有进入处理函数（请求格式错误等）时，解析耗时计到响应准备好为止
+    auto handlerTime = request.handler_time_.time_since_epoch().count() != 0 ? request.handler_time_ : request.response_time_;
+    uint64_t parseUs = elapsedMicros(request.start_time_, handlerTime);
+    uint64_t handlerUs = elapsedMicros(request.handler_time_, request.response_time_);
+    uint64_t writeUs = elapsedMicros(request.response_time_, now);
+    uint64_t totalUs = elapsedMicros(request.start_time_, now);
+
+    stats->parse.record(parseUs);
+    stats->handler.record(handlerUs);
+    stats->write.record(writeUs);
+    stats->total.record(totalUs);
+    stats->bytesIn.inc(request.body.size());
+    stats->bytesOut.inc(response.body.size());
+    if (response.status >= 400) {
+        stats->errors.inc();
+    }
+
+    fmt::memory_buffer line;
+    fmt::format_to(std::back_inserter(line), "{}:{} {} {} {} {} {} {} parse={}us handler={}us write={}us total={}us",
+                   request.remote_addr, request.remote_port, request.method, request.path, requestId,
+                   response.status, request.body.size(), response.body.size(),
+                   parseUs, handlerUs, writeUs, totalUs);
+    muduo::logAccess(line.data(), line.size());
+
+    currentRequestId.clear();
+}
+
+static Json::Value percentilesToJson(const metrics::Histogram::Snapshot& snapshot) {
+    Json::Value value;
+    value["p50"] = Json::UInt64(snapshot.percentile(0.5));
+    value["p99"] = Json::UInt64(snapshot.percentile(0.99));
+    value["p999"] = Json::UInt64(snapshot.percentile(0.999));
+    value["max"] = Json::UInt64(snapshot.max);
+    return value;
+}
+
+Json::Value AccessLog::toJson() {
+    Json::Value stats_json(Json::objectValue);
+
+    for (ServiceStats* item = statsHead.load(std::memory_order_acquire); item != nullptr; item = item->next) {
+        auto total = item->total.snapshot();
+        auto handler = item->handler.snapshot();
+
+        Json::Value& service_json = stats_json[item->serviceId];
+        service_json["count"] = Json::UInt64(total.count);
+        service_json["errors"] = Json::UInt64(item->errors.value());
+        service_json["bytes_in"] = Json::UInt64(item->bytesIn.value());
+        service_json["bytes_out"] = Json::UInt64(item->bytesOut.value());
+        service_json["total_us"] = percentilesToJson(total);
+        service_json["handler_us"] = percentilesToJson(handler);
+    }
+
+    return stats_json;
+}
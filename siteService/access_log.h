@@ -0,0 +1,63 @@
+/*
+ * access_log.h
+ *
+ *  Created on: 2022年7月6日
+ */
+
+#ifndef LIB_ACCESS_LOG_H_
+#define LIB_ACCESS_LOG_H_
+
+#include <atomic>
+#include <string>
+#include "http/httplib.h"
+#include "qlibc/jsoncpp/json.h"
+
+using namespace std;
+using namespace httplib;
+
+namespace servicesite {
+
+class ServiceStats;
+
+/**
+ * @brief 访问日志与请求延迟统计
+ * 
+ * 作为 httplib::Server::set_logger 的回调，在响应写完后调用：
+ *  1. 按 service_id（或 message_id）记录 解析/处理/写响应/总耗时 到分线程的直方图，全程无锁
+ *  2. 每个请求输出一行访问日志到异步访问日志文件
+ */
+class AccessLog {
+    std::atomic<ServiceStats*> statsHead;
+
+    static AccessLog instance;
+
+    AccessLog();
+
+    ServiceStats* findOrCreateStats(const string& serviceId);
+public:
+    static AccessLog* getInstance() {
+        return &instance;
+    }
+
+    /**
+     * @brief 标记当前线程正在处理的请求所属的 service_id / message_id
+     * 
+     * 请求处理函数与 logger 回调在同一线程内执行，由 log() 读取后清除
+     * 每个 id 的统计项不释放，只能传入已注册的 id（不能直接使用客户端发来的值），未标记的请求计入 "-"
+     */
+    static void setRequestId(const string& id);
+
+    /**
+     * @brief httplib::Server::set_logger 回调
+     */
+    void log(const Request& request, const Response& response);
+
+    /**
+     * @brief 各 service_id 的请求数、错误数、字节数与延迟分位数（微秒）
+     */
+    Json::Value toJson();
+};
+
+}
+
+#endif /* LIB_ACCESS_LOG_H_ */
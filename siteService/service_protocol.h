@@ -0,0 +1,167 @@
+/*
+ * service_protocol.h
+ *
+ *  Created on: 2022年7月15日
+ */
+
+#ifndef LIB_SERVICE_PROTOCOL_H_
+#define LIB_SERVICE_PROTOCOL_H_
+
+#include <string>
+#include <vector>
+#include "qlibc/JsonSchema.h"
+
+/*
+ * 站点间服务请求/响应的报文结构，由 qlibc::JsonSchema 在编译期生成解码器
+ * 成员名与报文字段名一致；JsonOptional 为可选字段，其余为必填
+ */
+namespace servicesite {
+
+// subscribe_message / unsubscribe_message 的 "request"
+struct SubscribeMessageRequest {
+    int port = 0;
+    std::vector<std::string> message_list;
+    qlibc::JsonOptional<bool> accept_cbor;
+};
+
+// 服务返回，"response" 只在 code 为 0 时要求存在
+template<typename T>
+struct ServiceResponse {
+    int code = 0;
+    qlibc::JsonOptional<T> response;
+};
+
+// 只检查 code 的服务返回
+struct ServiceStatus {
+    int code = 0;
+};
+
+struct ServiceListResponse {
+    std::vector<std::string> service_list;
+};
+
+struct MessageListItem {
+    std::string message_id;
+};
+
+struct MessageListResponse {
+    std::vector<MessageListItem> message_list;
+};
+
+struct SiteListItem {
+    std::string site_id;
+    std::string summary;
+    std::string ip;
+    int port = 0;
+};
+
+struct SiteListResponse {
+    std::vector<SiteListItem> site_list;
+};
+
+// 查询站点发布的 site_online / site_offline 消息的 "content"；下线消息只要求 site_id
+struct SiteEventContent {
+    std::string site_id;
+    qlibc::JsonOptional<std::string> summary;
+    qlibc::JsonOptional<int> port;
+};
+
+struct SiteEventMessage {
+    SiteEventContent content;
+};
+
+}
+
+namespace qlibc {
+
+template<>
+struct JsonSchema<servicesite::SubscribeMessageRequest> {
+    using T = servicesite::SubscribeMessageRequest;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("port", &T::port),
+                               jsonField("message_list", &T::message_list),
+                               jsonField("accept_cbor", &T::accept_cbor));
+    }
+};
+
+template<typename R>
+struct JsonSchema<servicesite::ServiceResponse<R>> {
+    using T = servicesite::ServiceResponse<R>;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("code", &T::code),
+                               jsonField("response", &T::response));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::ServiceStatus> {
+    using T = servicesite::ServiceStatus;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("code", &T::code));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::ServiceListResponse> {
+    using T = servicesite::ServiceListResponse;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("service_list", &T::service_list));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::MessageListItem> {
+    using T = servicesite::MessageListItem;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("message_id", &T::message_id));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::MessageListResponse> {
+    using T = servicesite::MessageListResponse;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("message_list", &T::message_list));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::SiteListItem> {
+    using T = servicesite::SiteListItem;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("site_id", &T::site_id),
+                               jsonField("summary", &T::summary),
+                               jsonField("ip", &T::ip),
+                               jsonField("port", &T::port));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::SiteListResponse> {
+    using T = servicesite::SiteListResponse;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("site_list", &T::site_list));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::SiteEventContent> {
+    using T = servicesite::SiteEventContent;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("site_id", &T::site_id),
+                               jsonField("summary", &T::summary),
+                               jsonField("port", &T::port));
+    }
+};
+
+template<>
+struct JsonSchema<servicesite::SiteEventMessage> {
+    using T = servicesite::SiteEventMessage;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("content", &T::content));
+    }
+};
+
+}
+
+#endif /* LIB_SERVICE_PROTOCOL_H_ */
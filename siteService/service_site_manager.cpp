@@ -8,11 +8,17 @@
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <chrono>
 #include <mutex>
 #include <semaphore.h>
 #include "http/httplib.h"
-#include "nlohmann/json.hpp"
+#include "qlibc/QData.h"
+#include "qlibc/JsonCbor.h"
 #include"service_site_manager.h"
+#include "access_log.h"
+#include "metrics/Metrics.h"
+#include "service_protocol.h"
+#include "site_discovery.h"
 
 const string OK_RESPONSE_JSON = "{\"code\": 0, \"error\": \"ok\"}";
 
@@ -28,29 +34,123 @@ using namespace std;
 using namespace servicesite;
 using namespace httplib;
 
-using json = nlohmann::json;
+// 对象的成员，不是对象或成员不存在时返回 null 节点，不会修改 value
+static const Json::Value& jsonMember(const Json::Value& value, const char* key) {
+    if (!value.isObject()) {
+        return Json::Value::nullSingleton();
+    }
+    const Json::Value* member = value.find(key, key + strlen(key));
+    return member != nullptr ? *member : Json::Value::nullSingleton();
+}
+
+
+static string toJsonString(const Json::Value& value) {
+    string body;
+    qlibc::QData::valueToJsonString(value, body);
+    return body;
+}
+
+// 当前线程正在处理的请求，由 rawHttpRequestHandler 解析一次，服务处理函数直接使用
+static thread_local Json::Value currentRequestJson;
+// 当前请求的 Accept 中包含 CBOR 时，响应用 CBOR 编码
+static thread_local bool currentResponseCbor = false;
+
+// 直接编码到 response.body，不经过中间字符串
+static void setJsonContent(Response& response, const Json::Value& value) {
+    const char* content_type = "text/plain";
+    if (currentResponseCbor) {
+        qlibc::valueToCbor(value, response.body);
+        content_type = qlibc::CborContentType;
+    }
+    else {
+        qlibc::QData::valueToJsonString(value, response.body);
+    }
+
+    auto range = response.headers.equal_range("Content-Type");
+    response.headers.erase(range.first, range.second);
+    response.set_header("Content-Type", content_type);
+}
+
+// 请求仍用 JSON（对方可能是旧版本站点），声明可以接收 CBOR 响应
+static const Headers& acceptCborHeaders() {
+    static const Headers headers = {{"Accept", string(qlibc::CborContentType) + ", application/json"}};
+    return headers;
+}
+
+// 按响应的 Content-Type 解码，旧版本站点返回 JSON
+static bool parseResponse(const Result& res, Json::Value& value) {
+    return qlibc::parseBody(res->body, res->get_header_value("Content-Type"), value);
+}
+
+// 发送服务请求，返回按 result 的报文结构解码，返回错误码
+template<typename T>
+static int postServiceRequest(Client& cli, const Json::Value& request_json, T& result) {
+    auto res = cli.Post("/", acceptCborHeaders(), toJsonString(request_json), "text/plain");
+    if (!res) {
+        SERV_LIB_LOG("client connect error.");
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_CONN;
+    }
+
+    if (res->status != 200) {
+        SERV_LIB_LOG("http status = {}, error.", res->status);
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_STATUS_CODE;
+    }
+
+    Json::Value response_json;
+    if (!parseResponse(res, response_json)) {
+        SERV_LIB_LOG("response_json format error.");
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_NOT_JSON;
+    }
+
+    string error_path;
+    if (!qlibc::decodeJson(response_json, result, &error_path)) {
+        SERV_LIB_LOG("response_json format error: {}", error_path);
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_JSON_FORMAT;
+    }
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
+
+// 相同目标、相同请求体的查询使用同一个 key
+static string queryKey(const string& ip, int port, const Json::Value& request_json) {
+    string key = ip;
+    key.append(":").append(std::to_string(port));
+    key.append("/").append(request_json["service_id"].asString());
+    key.append("/").append(std::to_string(std::hash<string>()(toJsonString(request_json))));
+    return key;
+}
+
+// code 不为 0 或缺少 response 时返回错误码
+template<typename T>
+static int checkServiceResponse(const ServiceResponse<T>& result) {
+    if (result.code != 0) {
+        SERV_LIB_LOG("response_json code error.");
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_CODE;
+    }
+
+    if (!result.response.present) {
+        SERV_LIB_LOG("response_json format error.");
+        return ServiceSiteManager::RET_CODE_ERROR_REQ_JSON_FORMAT;
+    }
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
 
 void http_exception_handler(const Request& request, Response& response, std::exception& e) {
-    SERV_LIB_LOG("http_exception_handler request.method: %s\n", request.method.c_str());
-    SERV_LIB_LOG("http_exception_handler request.path: %s\n", request.path.c_str());
-    SERV_LIB_LOG("http_exception_handler request.body: %s\n", request.body.c_str());
+    SERV_LIB_LOG("http_exception_handler request.method: {}", request.method);
+    SERV_LIB_LOG("http_exception_handler request.path: {}", request.path);
+    SERV_LIB_LOG("http_exception_handler request.body: {}", request.body);
 
-    SERV_LIB_LOG("http_exception_handler exception: %s\n", e.what());
+    SERV_LIB_LOG("http_exception_handler exception: {}", e.what());
 }
 
 void easylogging_log(const char* format, ...) {
-    char buf[1024]  = { 0 };
-
 	va_list arg_list;
 
 	va_start(arg_list, format);
-	vsprintf(buf, format, arg_list);
+    // 直接格式化进日志缓冲区，超出缓冲区的部分被截断
+    LOG_INFO.appendPrintf(format, arg_list);
     va_end(arg_list);
-
-    //如果将值直接传递给printf，不能直接解析
-    //printf(format, arg_list);
-
-	printf("%s", buf);
 }
 
 const string ServiceSiteManager::SERVICE_ID_GET_SERVICE_LIST = "get_service_list";
@@ -59,9 +159,10 @@ const string ServiceSiteManager::SERVICE_ID_SUBSCRIBE_MESSAGE = "subscribe_messa
 const string ServiceSiteManager::SERVICE_ID_UNSUBSCRIBE_MESSAGE = "unsubscribe_message";
 const string ServiceSiteManager::SERVICE_ID_DEBUG = "debug";
 
-std::vector<SiteHandle> ServiceSiteManager::siteHandleList;
-std::vector<MessageSubscriber> ServiceSiteManager::messageSubscriberList;
-std::vector<MessageSubscriberSiteHandle*> ServiceSiteManager::messageSubscriberSiteHandlePList;
+SiteDiscoveryCache ServiceSiteManager::siteDiscovery(ServiceSiteManager::fetchSiteList);
+SingleFlight<std::vector<string>> ServiceSiteManager::listQueries;
+SubscriptionRegistry<MessageSubscriberSiteHandle> ServiceSiteManager::messageSubscribers(
+    [](const string& ip, int port) { return new MessageSubscriberSiteHandle(ip, port); });
 
 ServiceRequestHandlers ServiceSiteManager::serviceRequestHandlers;
 MessageIds ServiceSiteManager::messageIds;
@@ -77,6 +178,8 @@ const int ServiceSiteManager::RET_CODE_ERROR_REQ_NOT_JSON = -3;
 const int ServiceSiteManager::RET_CODE_ERROR_REQ_JSON_FORMAT = -4;
 const int ServiceSiteManager::RET_CODE_ERROR_REQ_CODE = -5;
 
+const int ServiceSiteManager::RET_CODE_ERROR_SHUTDOWN_TIMEOUT = -6;
+
 const string ServiceSiteManager::RET_OK = "ok";
 
 const string ServiceSiteManager::QUERY_SITE_IP = "127.0.0.1";
@@ -85,13 +188,18 @@ const string ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_REGISTER = "site_reg
 const string ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_PING = "site_ping";
 
 const string ServiceSiteManager::QUERY_SITE_MESSAGE_ID_REGISTER_AGAIN = "register2QuerySiteAgain";
+const string ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_ONLINE = "site_online";
+const string ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_OFFLINE = "site_offline";
 
 const string ServiceSiteManager::MESSAGE_SUBSCRIBER_CONFIG_FILE = "_message_subscriber.json";
+const string ServiceSiteManager::MESSAGE_SUBSCRIBER_JOURNAL_FILE = "_message_subscriber.journal";
 string ServiceSiteManager::messageSubscriberConfigPath = "/data/changhong/edge_midware/";
+SubscriptionStore ServiceSiteManager::subscriptionStore;
 
 std::mutex init_mutex; // 保护 初始化
 std::mutex http_request_mutex; // 保护 http_request handler
-std::mutex messageSubscriberList_mutex; // 保护 MessageSubscriberList
+// 订阅表变更与 subscriptionStore 记录在同一把锁内完成，并发订阅/退订同一消息时日志顺序与订阅表一致
+std::mutex subscription_mutex;
 
 string ServiceSiteManager::siteId;
 int ServiceSiteManager::serverPort;
@@ -99,7 +207,14 @@ Server ServiceSiteManager::server;
 
 string ServiceSiteManager::summary;
 
-std::thread* ServiceSiteManager::pingThreadP;
+TimerWheel ServiceSiteManager::timerWheel;
+int64_t ServiceSiteManager::leaseExpireMs = 0;
+RetryBackoff ServiceSiteManager::registerBackoff(ServiceSiteManager::REGISTER_RETRY_BASE_MS, ServiceSiteManager::REGISTER_RETRY_MAX_MS);
+std::atomic<bool> ServiceSiteManager::isRegisterScheduled(false);
+
+std::atomic<bool> ServiceSiteManager::isShutdown(false);
+
+bool ServiceSiteManager::acceptCbor = false;
 
 ServiceSiteManager ServiceSiteManager::instance;
 
@@ -120,6 +235,7 @@ int ServiceSiteManager::registerMessageId(string messageId) {
     message_id.summary = messageId;
 
     messageIds.push_back(message_id);
+    messageSubscribers.addTopic(messageId);
 
     return RET_CODE_OK;
 }
@@ -132,48 +248,42 @@ int ServiceSiteManager::registerMessageId(string messageId, string name, string
     message_id.summary = summary;
 
     messageIds.push_back(message_id);
+    messageSubscribers.addTopic(messageId);
 
     return RET_CODE_OK;
 }
 
 int ServiceSiteManager::serviceRequestHandlerGetServiceList(const Request& request, Response& response) {
-    json response_json = {
-		{"code", 0},
-		{"error", "ok"},
-		{"response", {
-            {"service_list", json::array()}
-        }}
-	};
+    Json::Value response_json;
+    response_json["code"] = 0;
+    response_json["error"] = "ok";
+    Json::Value& service_list = response_json["response"]["service_list"];
+    service_list = Json::Value(Json::arrayValue);
 
     for (const auto& item : serviceRequestHandlers) {
-        response_json["response"]["service_list"].push_back(item.first);
+        service_list.append(item.first);
     }
 
-    response.set_content(response_json.dump(), "text/plain");
+    setJsonContent(response, response_json);
 
     return RET_CODE_OK;
 }
 
 int ServiceSiteManager::serviceRequestHandlerGetMessageList(const Request& request, Response& response) {
-    json response_json = {
-		{"code", 0},
-		{"error", "ok"},
-		{"response", {
-            {"message_list", json::array()}
-        }}
-	};
+    Json::Value response_json;
+    response_json["code"] = 0;
+    response_json["error"] = "ok";
+    Json::Value& message_list = response_json["response"]["message_list"];
+    message_list = Json::Value(Json::arrayValue);
 
     for (const auto& item : messageIds) {
-        json message_json = {
-            {"message_id", item.messageId},
-            {"name", item.name},
-            {"summary", item.summary},
-        };
-
-        response_json["response"]["message_list"].push_back(message_json);
+        Json::Value& message_json = message_list.append(Json::Value(Json::objectValue));
+        message_json["message_id"] = item.messageId;
+        message_json["name"] = item.name;
+        message_json["summary"] = item.summary;
     }
 
-    response.set_content(response_json.dump(), "text/plain");
+    setJsonContent(response, response_json);
 
     return RET_CODE_OK;
 }
@@ -181,36 +291,33 @@ int ServiceSiteManager::serviceRequestHandlerGetMessageList(const Request& reque
 int ServiceSiteManager::serviceRequestHandlerSubscribeMessage(const Request& request, Response& response) {
     string ip = request.remote_addr;
 
-    json request_json = json::parse(request.body);
+    SubscribeMessageRequest subscribe_request;
+    string error_path;
 
-    bool need_save = false;
-
-    if (request_json["request"].is_null()) {
+    if (!qlibc::decodeJson(jsonMember(currentRequestJson, "request"), subscribe_request, &error_path)) {
+        SERV_LIB_LOG_RATE(10, "request illegal: {}", error_path);
         response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
         return RET_CODE_OK;
     }
 
-    if (request_json["request"]["port"].is_null()) {
-        response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
-        return RET_CODE_OK;
-    }
-
-    if (request_json["request"]["message_list"].is_null()) {
-        response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
-        return RET_CODE_OK;
-    }
+    int port = subscribe_request.port;
+    // 旧版本站点不带此字段，按 JSON 发送消息
+    bool accept_cbor = subscribe_request.accept_cbor.value;
 
-    int port = request_json["request"]["port"];
+    SubscriptionRecord record;
+    record.ip = ip;
+    record.port = port;
+    record.acceptCbor = accept_cbor;
 
-    for (auto& message_id : request_json["request"]["message_list"]) {
-        need_save = subscribeMessage(message_id, ip, port);
+    std::lock_guard<std::mutex> lockGuard(subscription_mutex);
+    for (const auto& message_id : subscribe_request.message_list) {
+        if (subscribeMessage(message_id, ip, port, accept_cbor)) {
+            record.messageId = message_id;
+            subscriptionStore.recordSubscribe(record);
+        }
     }
 
     response.set_content(OK_RESPONSE_JSON, "text/plain");
-
-    if (need_save) {
-        saveMessageSubscriber();
-    }
     
     return RET_CODE_OK;
 }
@@ -218,127 +325,139 @@ int ServiceSiteManager::serviceRequestHandlerSubscribeMessage(const Request& req
 int ServiceSiteManager::serviceRequestHandlerUnsubscribeMessage(const Request& request, Response& response) {
     string ip = request.remote_addr;
 
-    json request_json = json::parse(request.body);
-
-    bool need_save = false;
+    SubscribeMessageRequest subscribe_request;
+    string error_path;
     
-    if (request_json["request"].is_null()) {
+    if (!qlibc::decodeJson(jsonMember(currentRequestJson, "request"), subscribe_request, &error_path)) {
+        SERV_LIB_LOG_RATE(10, "request illegal: {}", error_path);
         response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
         return RET_CODE_OK;
     }
 
-    if (request_json["request"]["port"].is_null()) {
-        response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
-        return RET_CODE_OK;
-    }
+    int port = subscribe_request.port;
 
-    if (request_json["request"]["message_list"].is_null()) {
-        response.set_content(ERROR_RESPONSE_REQUEST_ILLEGAL, "text/plain");
+    std::lock_guard<std::mutex> lockGuard(subscription_mutex);
+    MessageSubscriberSiteHandle* site_handle = messageSubscribers.site(ip, port, false);
+    if (site_handle == NULL) {
+        // 此站点没有订阅过， 忽略
+        response.set_content(OK_RESPONSE_JSON, "text/plain");
         return RET_CODE_OK;
     }
 
-    int port = request_json["request"]["port"];
-
-    for (auto& json_message_id : request_json["request"]["message_list"]) {
-        // 线程锁, 对象析构时解锁
-        std::lock_guard<std::mutex> lockGuard(messageSubscriberList_mutex);
-
-        MessageSubscriberSiteHandle* temp_messageSubscriberSiteHandle = NULL;
-        for (auto& item : messageSubscriberSiteHandlePList) {
-            if (item->getIp() == ip) {
-                if (item->getPort() == port) {
-                    temp_messageSubscriberSiteHandle = item;
-                    break;
-                }
-            }
-        }
-        if (temp_messageSubscriberSiteHandle == NULL) {
-            // 此站点没有订阅过， 忽略
-            response.set_content(OK_RESPONSE_JSON, "text/plain");
-            return RET_CODE_OK;
-        }
-        
-        MessageSubscriber* temp_messageSubscriber = NULL;
-        for (auto& item : messageSubscriberList) {
-            if (json_message_id == item.getMessageId()) {
-                temp_messageSubscriber = &item;
-            }
-        }
-        if (temp_messageSubscriber == NULL) {
-            // 此消息没有订阅过， 忽略
-            response.set_content(OK_RESPONSE_JSON, "text/plain");
-            return RET_CODE_OK;
-        }
-        else {
-            temp_messageSubscriber->delSiteMessageSubscriberSiteHandleP(temp_messageSubscriberSiteHandle);
-
-            need_save = true;
+    for (const auto& message_id : subscribe_request.message_list) {
+        // 此消息没有订阅过时忽略
+        if (messageSubscribers.unsubscribe(message_id, site_handle)) {
+            subscriptionStore.recordUnsubscribe(message_id, ip, port);
         }
     }
 
     response.set_content(OK_RESPONSE_JSON, "text/plain");
 
-    if (need_save) {
-        saveMessageSubscriber();
-    }
-
     return RET_CODE_OK;
 }
 
 int ServiceSiteManager::serviceRequestHandlerDebug(const Request& request, Response& response) {
-    json response_json = {
-		{"code", 0},
-		{"error", "ok"},
-		{"response", {
-            {"message_subscriber_list", json::array()},
-            {"message_subscriber_site_handle_list", json::array()}
-        }}
-	};
-
-    for (auto& item : messageSubscriberList) {
-        json item_json = {
-            {"messageId", item.getMessageId()},
-            {"site_handle_list", json::array()}
-        };
-
-        for (const auto& sub_item : item.getSiteMessageSubscriberSiteHandlePlist()) {
-            json sub_item_json = {
-                {"ip", sub_item->getIp()},
-                {"port", sub_item->getPort()},
-                {"sendRetryCount", sub_item->getSendRetryCount()},
-                {"isStop", sub_item->getIsStop()},
-            };
-
-            item_json["site_handle_list"].push_back(sub_item_json);
-        }
+    Json::Value response_json;
+    response_json["code"] = 0;
+    response_json["error"] = "ok";
+    Json::Value& response_body = response_json["response"];
+    response_body["message_subscriber_list"] = messageSubscriberListToJson();
 
-        response_json["response"]["message_subscriber_list"].push_back(item_json);
+    Json::Value& site_handle_list = response_body["message_subscriber_site_handle_list"];
+    site_handle_list = Json::Value(Json::arrayValue);
+    for (const auto& item : messageSubscribers.sites()) {
+        site_handle_list.append(siteHandleToJson(item));
     }
 
-    for (const auto& item : messageSubscriberSiteHandlePList) {
-        json item_json = {
-            {"ip", item->getIp()},
-            {"port", item->getPort()},
-            {"sendRetryCount", item->getSendRetryCount()},
-            {"isStop", item->getIsStop()},
-        };
-        response_json["response"]["message_subscriber_site_handle_list"].push_back(item_json);
-    }
+    response_body["service_latency"] = AccessLog::getInstance()->toJson();
 
-    response.set_content(response_json.dump(), "text/plain");
+    setJsonContent(response, response_json);
 
     return RET_CODE_OK;
 }
 
+Json::Value ServiceSiteManager::siteHandleToJson(MessageSubscriberSiteHandle* siteHandle) {
+    Json::Value item_json;
+    item_json["ip"] = siteHandle->getIp();
+    item_json["port"] = siteHandle->getPort();
+    item_json["sendRetryCount"] = siteHandle->getSendRetryCount();
+    item_json["isStop"] = siteHandle->getIsStop();
+    item_json["acceptCbor"] = siteHandle->getAcceptCbor();
+    return item_json;
+}
+
+Json::Value ServiceSiteManager::messageSubscriberListToJson(void) {
+    Json::Value message_subscriber_list(Json::arrayValue);
+
+    messageSubscribers.forEachTopic([&](const string& messageId, const std::vector<MessageSubscriberSiteHandle*>& siteHandles) {
+        Json::Value& item_json = message_subscriber_list.append(Json::Value(Json::objectValue));
+        item_json["messageId"] = messageId;
+        Json::Value& site_handle_list = item_json["site_handle_list"];
+        site_handle_list = Json::Value(Json::arrayValue);
+
+        for (const auto& sub_item : siteHandles) {
+            site_handle_list.append(siteHandleToJson(sub_item));
+        }
+    });
+
+    return message_subscriber_list;
+}
+
+const Json::Value& ServiceSiteManager::requestJson(void) {
+    return currentRequestJson;
+}
+
+void ServiceSiteManager::setResponseJson(Response& response, const Json::Value& value) {
+    setJsonContent(response, value);
+}
+
 void ServiceSiteManager::messageHandlerRegisterAgain(const Request& request) {
-    // 重新注册
-    registerSite();
+    // 重新注册，在定时器线程中进行；随机延迟避免所有站点同时注册
+    scheduleRegister(jitterMs(500, 1.0));
+
+    // 查询站点重启过，缓存可能漏掉了期间的上线/下线消息
+    siteDiscovery.markStale();
+}
+
+void ServiceSiteManager::messageHandlerSiteOnline(const Request&) {
+    SiteEventMessage message;
+    string error_path;
+    if (!qlibc::decodeJson(currentRequestJson, message, &error_path) || !message.content.port.present) {
+        SERV_LIB_LOG_RATE(10, "site_online illegal: {}", error_path);
+        return;
+    }
+
+    // 与 query_site 一致，ip 使用查询站点的 ip
+    siteDiscovery.applyOnline(SiteHandle(message.content.site_id, message.content.summary.value,
+                                         ServiceSiteManager::QUERY_SITE_IP, message.content.port.value));
+    listQueries.clear();
+}
+
+void ServiceSiteManager::messageHandlerSiteOffline(const Request&) {
+    SiteEventMessage message;
+    string error_path;
+    if (!qlibc::decodeJson(currentRequestJson, message, &error_path)) {
+        SERV_LIB_LOG_RATE(10, "site_offline illegal: {}", error_path);
+        return;
+    }
+
+    siteDiscovery.applyOffline(message.content.site_id, message.content.port.value);
+    listQueries.clear();
 }
 
 ServiceSiteManager::ServiceSiteManager() {
     // 设置异常 handler, 发生异常时打印
     server.set_exception_handler(http_exception_handler);
 
+    server.set_listen_backlog(LISTEN_BACKLOG);
+    // 连接的读写都先经过 select，不需要 SO_RCVTIMEO/SO_SNDTIMEO，每个连接少两次系统调用
+    server.set_nonblocking_accept(true);
+
+    // 访问日志与各服务延迟统计
+    server.set_logger([](const Request& request, const Response& response) {
+        AccessLog::getInstance()->log(request, response);
+    });
+
     registerServiceRequestHandler(SERVICE_ID_GET_SERVICE_LIST, ServiceSiteManager::serviceRequestHandlerGetServiceList);
     registerServiceRequestHandler(SERVICE_ID_GET_MESSAGE_LIST, ServiceSiteManager::serviceRequestHandlerGetMessageList);
     registerServiceRequestHandler(SERVICE_ID_SUBSCRIBE_MESSAGE, ServiceSiteManager::serviceRequestHandlerSubscribeMessage);
@@ -347,27 +466,67 @@ ServiceSiteManager::ServiceSiteManager() {
     registerServiceRequestHandler(SERVICE_ID_DEBUG, ServiceSiteManager::serviceRequestHandlerDebug);
 }
 
+// 订阅消息发送指标，所有订阅站点共用
+struct SubscriberMetrics {
+    metrics::Counter& sent;
+    metrics::Counter& failed;
+    metrics::Counter& dropped;
+    metrics::Gauge& queued;
+
+    SubscriberMetrics()
+        : sent(metrics::Registry::global().counter("site_message_sent_total", "Messages delivered to subscribers")),
+          failed(metrics::Registry::global().counter("site_message_send_failures_total",
+                                                     "Message sends that failed to connect or got a non-200 status")),
+          dropped(metrics::Registry::global().counter("site_message_dropped_total",
+                                                      "Messages dropped because a queue was full or shutdown timed out")),
+          queued(metrics::Registry::global().gauge("site_message_queued", "Messages waiting in subscriber queues")) {}
+};
+
+static SubscriberMetrics& subscriberMetrics() {
+    static SubscriberMetrics* m = new SubscriberMetrics();
+    return *m;
+}
+
+void ServiceSiteManager::enableMetrics(const string& path) {
+    // 没有订阅者时也输出为 0
+    subscriberMetrics();
+
+    server.Get(path, [path](const Request&, Response& response) {
+        AccessLog::setRequestId(path);
+
+        string body;
+        metrics::Registry::global().writePrometheus(body);
+        response.set_content(body, "text/plain; version=0.0.4");
+    });
+}
+
 void ServiceSiteManager::rawHttpRequestHandler(const Request& request, Response& response) {
     // 线程锁, 对象析构时解锁
 //    std::lock_guard<std::mutex> lockGuard(http_request_mutex);
 
-    // SERV_LIB_LOG("%s\n", request.body.c_str());
+    // SERV_LIB_LOG("{}", request.body);
 
-    if (!json::accept(request.body)) {
+    currentResponseCbor = qlibc::acceptsCbor(request.get_header_value("Accept"));
+
+    // 只解析一次，服务处理函数通过 requestJson() 使用；Content-Type 为 CBOR 时按 CBOR 解码
+    if (!qlibc::parseBody(request.body, request.get_header_value("Content-Type"), currentRequestJson)) {
         response.set_content(ERROR_RESPONSE_JSON_FORMAT, "text/plain");
         return;
     }
 
-    auto request_json = json::parse(request.body);
+    const Json::Value& request_json = currentRequestJson;
 
     // Service
-    if (!request_json["service_id"].is_null()) {
-        string request_service_id = request_json["service_id"];
+    const Json::Value& service_id = jsonMember(request_json, "service_id");
+    if (!service_id.isNull()) {
+        string request_service_id = service_id.asString();
         for (const auto& x : serviceRequestHandlers) {
             const auto& serviceId = x.first;
             const auto& handler = x.second;
 
             if (serviceId == request_service_id) {
+                // 只统计已注册的 service_id，其他请求都计入 "-"，客户端无法让统计项无限增长
+                AccessLog::setRequestId(request_service_id);
                 int code = handler(request, response);
                 if (code == 0) {
                     // 完成处理
@@ -382,20 +541,22 @@ void ServiceSiteManager::rawHttpRequestHandler(const Request& request, Response&
         }
 
         // 没有匹配的 handler
-        SERV_LIB_LOG("no handler for service_id: %s\n", request_service_id.c_str());
+        SERV_LIB_LOG("no handler for service_id: {}", request_service_id);
         response.set_content(ERROR_RESPONSE_NO_REQUEST_HANDLER_MATCH, "text/plain");
         return;
     }
 
     // Message
-    if (!request_json["message_id"].is_null()) {
-        string request_message_id = request_json["message_id"];
+    const Json::Value& message_id = jsonMember(request_json, "message_id");
+    if (!message_id.isNull()) {
+        string request_message_id = message_id.asString();
 
         for (const auto &x : messageHandlers) {
             const auto &messageId = x.first;
             const auto &handler = x.second;
 
             if (messageId == request_message_id) {
+                AccessLog::setRequestId(request_message_id);
                 handler(request);
                 response.set_content("{}", "text/plain");
                 return;
@@ -403,7 +564,7 @@ void ServiceSiteManager::rawHttpRequestHandler(const Request& request, Response&
         }
 
         // 没有匹配的 handler
-        SERV_LIB_LOG("no handler for message_id: %s\n", request_message_id.c_str());
+        SERV_LIB_LOG("no handler for message_id: {}", request_message_id);
         response.set_content(ERROR_RESPONSE_NO_MESSAGE_HANDLER_MATCH, "text/plain");
         return;
     }
@@ -419,32 +580,152 @@ int ServiceSiteManager::start(void) {
     // server.set_read_timeout(0, 500000);
     // server.set_write_timeout(0, 500000);
 
-    if (!server.listen("0.0.0.0", serverPort)) {
+    return listenServer();
+}
+
+// bind 之后再检查一次：shutdown 在 bind 之前或之后调用，listen 都会返回
+int ServiceSiteManager::listenServer(void) {
+    if (isShutdown || !server.bind_to_port("0.0.0.0", serverPort)) {
+        return RET_CODE_ERROR_START_SERVER;
+    }
+    if (isShutdown) {
+        server.stop();
+        return RET_CODE_ERROR_START_SERVER;
+    }
+
+    if (!server.listen_after_bind()) {
         return RET_CODE_ERROR_START_SERVER;
     }
 
     return RET_CODE_OK;
 }
 
-void  service_site_ping_thread(string siteId) {
-    json request_json = {
-		{"service_id", ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_PING},
-		{"request", {
-            {"site_id", siteId}
-        }}
-	};
+static int64_t steadyNowMs(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    while (true) {
-        Client cli(ServiceSiteManager::QUERY_SITE_IP, ServiceSiteManager::QUERY_SITE_PORT);
+int ServiceSiteManager::shutdown(int deadlineMs) {
+    if (isShutdown.exchange(true)) {
+        return RET_CODE_OK;
+    }
+
+    int64_t deadline_ms = steadyNowMs() + deadlineMs;
+    int ret = RET_CODE_OK;
+    SERV_LIB_LOG("shutdown, deadline {} ms", deadlineMs);
 
-        cli.Post("/", request_json.dump(), "text/plain");
+    // 不再心跳和重新注册，查询站点在租期过后认为本站点下线
+    timerWheel.stop();
 
-        sleep(ServiceSiteManager::PING_PER_SECONDS);
+    // 停止 accept；keep-alive 连接处理完当前请求后关闭，listen 在所有连接关闭后返回
+    server.set_drain_timeout(deadlineMs / 1000, (deadlineMs % 1000) * 1000);
+    server.stop();
+    while (server.is_running()) {
+        if (steadyNowMs() > deadline_ms) {
+            SERV_LIB_LOG("shutdown: requests not finished in time");
+            ret = RET_CODE_ERROR_SHUTDOWN_TIMEOUT;
+            break;
+        }
+        usleep(10 * 1000);
     }
+
+    // 请求处理中发布的消息也要发出，所以在 server 之后；各订阅者并行发送
+    std::vector<MessageSubscriberSiteHandle*> sites = messageSubscribers.sites();
+    for (auto site : sites) {
+        site->stopSending(deadline_ms);
+    }
+    for (auto site : sites) {
+        site->joinSendThread();
+    }
+
+    subscriptionStore.stop();
+    siteDiscovery.stop();
+
+    if (ret == RET_CODE_OK && steadyNowMs() > deadline_ms) {
+        ret = RET_CODE_ERROR_SHUTDOWN_TIMEOUT;
+    }
+    SERV_LIB_LOG("shutdown finished, ret = {}", ret);
+
+    return ret;
+}
+
+// 与查询站点的长连接，只在定时器线程中使用；不释放，进程退出时定时器线程可能仍在使用
+Client& ServiceSiteManager::querySiteClient(void) {
+    static Client* cli = []() {
+        Client* client = new Client(ServiceSiteManager::QUERY_SITE_IP, ServiceSiteManager::QUERY_SITE_PORT);
+        client->set_keep_alive(true);
+        client->set_connection_timeout(QUERY_SITE_TIMEOUT_SECONDS);
+        client->set_read_timeout(QUERY_SITE_TIMEOUT_SECONDS);
+        client->set_write_timeout(QUERY_SITE_TIMEOUT_SECONDS);
+        return client;
+    }();
+    return *cli;
+}
+
+// 调用方传入的间隔上下浮动 10%，各站点的心跳不会集中在同一时刻
+void ServiceSiteManager::scheduleHeartbeat(int delayMs) {
+    timerWheel.schedule(delayMs, ServiceSiteManager::heartbeatTask);
+}
+
+/*
+ * 心跳即续租：
+ *  查询站点有响应即续租，租期为 LEASE_PING_COUNT 个心跳周期
+ *  返回 code 不为 0（查询站点不认识本站点）或租期已过时重新注册
+ */
+void ServiceSiteManager::heartbeatTask(void) {
+    Json::Value request_json;
+    request_json["service_id"] = ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_PING;
+    request_json["request"]["site_id"] = siteId;
+
+    ServiceStatus result;
+    int ret = postServiceRequest(querySiteClient(), request_json, result);
+    int64_t now = steadyNowMs();
+
+    if (ret == RET_CODE_OK && result.code != 0) {
+        SERV_LIB_LOG("site_ping code = {}, register again", result.code);
+        scheduleRegister(0);
+    }
+    else if (ret == RET_CODE_OK || ret == RET_CODE_ERROR_REQ_NOT_JSON || ret == RET_CODE_ERROR_REQ_JSON_FORMAT) {
+        // 旧版本查询站点的心跳响应不一定是标准格式，有响应即视为在线
+        leaseExpireMs = now + LEASE_PING_COUNT * PING_PER_SECONDS * 1000;
+    }
+    else if (now > leaseExpireMs) {
+        SERV_LIB_LOG_RATE(1, "site_ping error ret = {}, lease expired", ret);
+        scheduleRegister(0);
+    }
+
+    scheduleHeartbeat(jitterMs(PING_PER_SECONDS * 1000, 0.1));
+}
+
+// 已有注册在等待时不重复安排
+void ServiceSiteManager::scheduleRegister(int delayMs) {
+    if (isRegisterScheduled.exchange(true)) {
+        return;
+    }
+    if (timerWheel.schedule(delayMs, ServiceSiteManager::registerTask) == 0) {
+        isRegisterScheduled.store(false);
+    }
+}
+
+void ServiceSiteManager::registerTask(void) {
+    isRegisterScheduled.store(false);
+
+    int ret = registerSite(querySiteClient());
+    if (ret == RET_CODE_OK) {
+        registerBackoff.reset();
+        leaseExpireMs = steadyNowMs() + LEASE_PING_COUNT * PING_PER_SECONDS * 1000;
+        SERV_LIB_LOG("register again ok.");
+        return;
+    }
+
+    int delay_ms = registerBackoff.nextDelayMs();
+    SERV_LIB_LOG_RATE(1, "registerSite error ret = {}, retry in {} ms", ret, delay_ms);
+    scheduleRegister(delay_ms);
 }
 
 int ServiceSiteManager::startByRegister(void) {
     int ret;
+    RetryBackoff backoff(REGISTER_RETRY_BASE_MS, REGISTER_RETRY_MAX_MS);
 
     // 注册站点
     while (true) {
@@ -452,11 +733,16 @@ int ServiceSiteManager::startByRegister(void) {
         if (ret == RET_CODE_OK) {
             break;
         }
+        else if (isShutdown) {
+            return RET_CODE_ERROR_START_SERVER;
+        }
         else {
-            SERV_LIB_LOG("registerSite error ret = %d\n", ret);
-            sleep(2);
+            int delay_ms = backoff.nextDelayMs();
+            SERV_LIB_LOG("registerSite error ret = {}, retry in {} ms", ret, delay_ms);
+            usleep(delay_ms * 1000);
         }
     }
+    backoff.reset();
 
     // 消息列表
 	std::vector<string> messageIdList;
@@ -468,28 +754,45 @@ int ServiceSiteManager::startByRegister(void) {
         if (ret == RET_CODE_OK) {
             break;
         }
+        else if (isShutdown) {
+            return RET_CODE_ERROR_START_SERVER;
+        }
         else {
-            SERV_LIB_LOG("subscribeMessage error ret = %d\n", ret);
-            sleep(2);
+            int delay_ms = backoff.nextDelayMs();
+            SERV_LIB_LOG("subscribeMessage error ret = {}, retry in {} ms", ret, delay_ms);
+            usleep(delay_ms * 1000);
         }
     }
 
     // 注册消息处理函数
     registerMessageHandler(ServiceSiteManager::QUERY_SITE_MESSAGE_ID_REGISTER_AGAIN, ServiceSiteManager::messageHandlerRegisterAgain);
 
-    pingThreadP = new std::thread(service_site_ping_thread, siteId);
+    // 站点上线/下线消息，查询站点不支持时站点发现缓存按 TTL 全量同步
+    registerMessageHandler(ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_ONLINE, ServiceSiteManager::messageHandlerSiteOnline);
+    registerMessageHandler(ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_OFFLINE, ServiceSiteManager::messageHandlerSiteOffline);
+
+    std::vector<string> siteEventIdList;
+    siteEventIdList.push_back(ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_ONLINE);
+    siteEventIdList.push_back(ServiceSiteManager::QUERY_SITE_MESSAGE_ID_SITE_OFFLINE);
+    ret = subscribeMessage(ServiceSiteManager::QUERY_SITE_IP, ServiceSiteManager::QUERY_SITE_PORT, siteEventIdList);
+    if (ret != RET_CODE_OK) {
+        SERV_LIB_LOG("subscribe site events error ret = {}", ret);
+    }
+
+    // 预先同步站点列表，之后的查找不需要等待
+    siteDiscovery.refreshAsync();
 
-    SERV_LIB_LOG("http listen port: %d\n", serverPort);
+    // 心跳由定时器线程驱动，复用与查询站点的连接
+    leaseExpireMs = steadyNowMs() + LEASE_PING_COUNT * PING_PER_SECONDS * 1000;
+    scheduleHeartbeat(jitterMs(PING_PER_SECONDS * 1000, 0.1));
+
+    SERV_LIB_LOG("http listen port: {}", serverPort);
 
     server.Post("/", ServiceSiteManager::rawHttpRequestHandler);
 
     loadMessageSubscriber();
 
-    if (!server.listen("0.0.0.0", serverPort)) {
-        return RET_CODE_ERROR_START_SERVER;
-    }
-
-    return RET_CODE_OK;
+    return listenServer();
 }
 
 int ServiceSiteManager::registerMessageHandler(string messageId, MessageHandler handler) {
@@ -498,60 +801,79 @@ int ServiceSiteManager::registerMessageHandler(string messageId, MessageHandler
     return RET_CODE_OK;
 }
 
+void ServiceSiteManager::publishMessage(string messageId, const Json::Value& message) {
+    publishEncoded(messageId, nullptr, &message);
+}
+
 void ServiceSiteManager::publishMessage(string messageId, string message) {
-    // 线程锁, 对象析构时解锁
-    std::lock_guard<std::mutex> lockGuard(messageSubscriberList_mutex);
+    publishEncoded(messageId, &message, nullptr);
+}
 
-    for (auto& messageSubscriberItem : messageSubscriberList) {
-        if (messageId == messageSubscriberItem.getMessageId()) {
-            for (auto& siteHandlePItem : messageSubscriberItem.getSiteMessageSubscriberSiteHandlePlist()) {
-                siteHandlePItem->sendMessage(message);
+void ServiceSiteManager::publishMessage(string messageId, const char* message) {
+    string json_message(message);
+    publishEncoded(messageId, &json_message, nullptr);
+}
+
+// 每种编码最多生成一次，由同一消息的所有订阅者共用
+// 订阅表无锁查找，遍历的是发布时的订阅者数组，不复制
+void ServiceSiteManager::publishEncoded(const string& messageId, const string* jsonMessage, const Json::Value* message) {
+    string json_body;
+    string cbor_body;
+    bool cbor_encoded = false;
+
+    messageSubscribers.forEachSubscriber(messageId, [&](MessageSubscriberSiteHandle* siteHandleP) {
+        if (siteHandleP->getAcceptCbor()) {
+            if (!cbor_encoded) {
+                cbor_encoded = true;
+                Json::Value parsed;
+                if (message != nullptr) {
+                    qlibc::valueToCbor(*message, cbor_body);
+                }
+                else if (qlibc::QData::parseJson(*jsonMessage, parsed)) {
+                    qlibc::valueToCbor(parsed, cbor_body);
+                }
+            }
+            // 消息不是合法 JSON 时无法转为 CBOR，按原样发送
+            if (!cbor_body.empty()) {
+                siteHandleP->sendMessage(cbor_body, true);
+                return;
             }
         }
-    }
+
+        if (jsonMessage == nullptr) {
+            json_body = toJsonString(*message);
+            jsonMessage = &json_body;
+        }
+        siteHandleP->sendMessage(*jsonMessage);
+    });
 }
 
 int ServiceSiteManager::subscribeMessage(string ip, int port, std::vector<string> messageIdList) {
-    json request_json = {
-		{"service_id", "subscribe_message"},
-		{"request", {
-			{"message_list", json::array()},
-            {"port", serverPort}
-		}}
-	};
+    Json::Value request_json;
+    request_json["service_id"] = "subscribe_message";
+    Json::Value& message_list = request_json["request"]["message_list"];
+    message_list = Json::Value(Json::arrayValue);
+    request_json["request"]["port"] = serverPort;
+    if (acceptCbor) {
+        request_json["request"]["accept_cbor"] = true;
+    }
 
     for (auto& item : messageIdList) {
-        request_json["request"]["message_list"].push_back(item);
+        message_list.append(item);
     }
 
     Client cli(ip, port);
     cli.set_connection_timeout(1, 0);
 
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
 
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
+    ServiceStatus result;
+    int ret = postServiceRequest(cli, request_json, result);
+    if (ret != RET_CODE_OK) {
+        return ret;
     }
 
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
+    if (result.code != 0) {
+        SERV_LIB_LOG("response_json code error.");
         return RET_CODE_ERROR_REQ_CODE;
     }
 
@@ -560,45 +882,27 @@ int ServiceSiteManager::subscribeMessage(string ip, int port, std::vector<string
 
 
 int ServiceSiteManager::unsubscribeMessage(string ip, int port, std::vector<string> messageIdList) {
-    json request_json = {
-		{"service_id", "unsubscribe_message"},
-		{"request", {
-			{"message_list", json::array()},
-            {"port", serverPort}
-		}}
-	};
+    Json::Value request_json;
+    request_json["service_id"] = "unsubscribe_message";
+    Json::Value& message_list = request_json["request"]["message_list"];
+    message_list = Json::Value(Json::arrayValue);
+    request_json["request"]["port"] = serverPort;
 
     for (auto& item : messageIdList) {
-        request_json["request"]["message_list"].push_back(item);
+        message_list.append(item);
     }
 
     Client cli(ip, port);
 
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
 
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
+    ServiceStatus result;
+    int ret = postServiceRequest(cli, request_json, result);
+    if (ret != RET_CODE_OK) {
+        return ret;
     }
 
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
+    if (result.code != 0) {
+        SERV_LIB_LOG("response_json code error.");
         return RET_CODE_ERROR_REQ_CODE;
     }
 
@@ -615,7 +919,7 @@ int ServiceSiteManager::createDir(string sPathName) {
             DirName[i] = 0;
             if (access(DirName, F_OK) != 0) {
                 if (mkdir(DirName, 0755) == -1) {
-                    SERV_LIB_LOG("mkdir error\n");
+                    SERV_LIB_LOG("mkdir error");
                     return -1;
                 }
             }
@@ -627,365 +931,113 @@ int ServiceSiteManager::createDir(string sPathName) {
 }
 
 int ServiceSiteManager::getServiceList(string ip, int port, std::vector<string>& serviceIdList) {
-    json request_json = {
-		{"service_id", "get_service_list"}
-	};
-
-    Client cli(ip, port);
-
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
+    Json::Value request_json;
+    request_json["service_id"] = "get_service_list";
 
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
-
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
+    SingleFlight<std::vector<string>>::ValuePtr service_list;
+    int ret = listQueries.run(queryKey(ip, port, request_json), [&](std::vector<string>& list) {
+        Client cli(ip, port);
 
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_CODE;
-    }
-
-    if (response_json["response"].is_null()) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"]["service_list"].is_null()) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
+        ServiceResponse<ServiceListResponse> result;
+        int ret = postServiceRequest(cli, request_json, result);
+        if (ret == RET_CODE_OK) {
+            ret = checkServiceResponse(result);
+        }
+        if (ret == RET_CODE_OK) {
+            list = std::move(result.response.value.service_list);
+        }
+        return ret;
+    }, service_list);
+    if (ret != RET_CODE_OK) {
+        return ret;
     }
 
-    for (auto& item : response_json["response"]["service_list"]) {
-        serviceIdList.push_back(item);
-    }
+    serviceIdList.insert(serviceIdList.end(), service_list->begin(), service_list->end());
 
     return RET_CODE_OK;
 }
 
 
 int ServiceSiteManager::getMessageList(string ip, int port, std::vector<string>& messageIdList) {
-    json request_json = {
-		{"service_id", "get_message_list"}
-	};
-
-    Client cli(ip, port);
-    cli.set_connection_timeout(1, 0);
-
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
+    Json::Value request_json;
+    request_json["service_id"] = "get_message_list";
 
-    json response_json = json::parse(res->body);
+    SingleFlight<std::vector<string>>::ValuePtr message_list;
+    int ret = listQueries.run(queryKey(ip, port, request_json), [&](std::vector<string>& list) {
+        Client cli(ip, port);
+        cli.set_connection_timeout(1, 0);
 
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_CODE;
-    }
-
-    if (response_json["response"].is_null()) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"]["message_list"].is_null()) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    for (auto& item : response_json["response"]["message_list"]) {
-        messageIdList.push_back(item["message_id"]);
-    }
-
-    return RET_CODE_OK;
-}
-
-int ServiceSiteManager::updateSiteHandleList(void) {
-    json request_json = {
-		{"service_id", "site_query"}
-	};
-
-    // 先完成本机，后续完成mDNS， 本局域网
-    string query_site_ip = ServiceSiteManager::QUERY_SITE_IP;
-    Client cli(query_site_ip, ServiceSiteManager::QUERY_SITE_PORT);
-
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
-
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"]["site_list"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_CODE;
-    }
-
-    std::vector<SiteHandle> tempSiteHandleList;
-    for (auto& json_item : response_json["response"]["site_list"]) {
-        if (json_item["site_id"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        if (json_item["summary"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        // 与 query_site 一致 
-        if (json_item["ip"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
+        ServiceResponse<MessageListResponse> result;
+        int ret = postServiceRequest(cli, request_json, result);
+        if (ret == RET_CODE_OK) {
+            ret = checkServiceResponse(result);
         }
-
-        if (json_item["port"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
+        if (ret == RET_CODE_OK) {
+            for (auto& item : result.response.value.message_list) {
+                list.push_back(std::move(item.message_id));
+            }
         }
-
-        string site_id = json_item["site_id"];
-        string summary = json_item["summary"];
-        // 与 query_site 一致 
-        string ip = json_item["ip"];
-        int port = json_item["port"];
-
-        SiteHandle siteHandle(site_id, summary, query_site_ip, port);
-        
-        tempSiteHandleList.push_back(siteHandle);
+        return ret;
+    }, message_list);
+    if (ret != RET_CODE_OK) {
+        return ret;
     }
 
-    std::swap(siteHandleList, tempSiteHandleList);
-    // siteHandleList.swap(tempSiteHandleList);
+    messageIdList.insert(messageIdList.end(), message_list->begin(), message_list->end());
 
     return RET_CODE_OK;
 }
 
-int ServiceSiteManager::querySiteList(std::vector<SiteHandle>& pSiteHandleList) {
-    json request_json = {
-		{"service_id", "site_query"}
-	};
+int ServiceSiteManager::fetchSiteList(std::vector<SiteHandle>& pSiteHandleList) {
+    Json::Value request_json;
+    request_json["service_id"] = "site_query";
 
     // 先完成本机，后续完成mDNS， 本局域网
     string query_site_ip = ServiceSiteManager::QUERY_SITE_IP;
     Client cli(query_site_ip, ServiceSiteManager::QUERY_SITE_PORT);
+    // 第一次查找同步等待此请求，不使用 httplib 默认的长超时
+    cli.set_connection_timeout(QUERY_SITE_TIMEOUT_SECONDS);
+    cli.set_read_timeout(QUERY_SITE_TIMEOUT_SECONDS);
+    cli.set_write_timeout(QUERY_SITE_TIMEOUT_SECONDS);
 
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
+    ServiceResponse<SiteListResponse> result;
+    int ret = postServiceRequest(cli, request_json, result);
+    if (ret == RET_CODE_OK) {
+        ret = checkServiceResponse(result);
     }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
-
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
+    if (ret != RET_CODE_OK) {
+        return ret;
     }
 
-    if (response_json["response"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"]["site_list"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_CODE;
-    }
-
-    for (auto& json_item : response_json["response"]["site_list"]) {
-        if (json_item["site_id"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        if (json_item["summary"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        // 与 query_site 一致 
-        if (json_item["ip"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        if (json_item["port"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        string site_id = json_item["site_id"];
-        string summary = json_item["summary"];
-        // 与 query_site 一致 
-        string ip = json_item["ip"];
-        int port = json_item["port"];
-
-        SiteHandle siteHandle(site_id, summary, query_site_ip, port);
-        
-        pSiteHandleList.push_back(siteHandle);
+    for (const auto& item : result.response.value.site_list) {
+        // 与 query_site 一致，ip 使用查询站点的 ip
+        pSiteHandleList.push_back(SiteHandle(item.site_id, item.summary, query_site_ip, item.port));
     }
 
     return RET_CODE_OK;
 }
 
-int ServiceSiteManager::querySiteListBySiteId(string pSiteId, std::vector<SiteHandle>& pSiteHandleList) {
-    json request_json = {
-		{"service_id", "site_query"},
-        {"request", {
-            {"site_id", pSiteId}
-        }}
-	};
-
-    // 先完成本机，后续完成mDNS， 本局域网
-    string query_site_ip = ServiceSiteManager::QUERY_SITE_IP;
-    Client cli(query_site_ip, ServiceSiteManager::QUERY_SITE_PORT);
-
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
-
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["response"]["site_list"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    if (response_json["code"] != 0) {
-        SERV_LIB_LOG("response_json code error.\n");
-        return RET_CODE_ERROR_REQ_CODE;
-    }
-
-    for (auto& json_item : response_json["response"]["site_list"]) {
-        if (json_item["site_id"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
-
-        if (json_item["summary"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
+int ServiceSiteManager::updateSiteHandleList(void) {
+    return siteDiscovery.refresh();
+}
 
-        // 与 query_site 一致 
-        if (json_item["ip"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
+int ServiceSiteManager::querySiteList(std::vector<SiteHandle>& pSiteHandleList) {
+    return siteDiscovery.getAll(pSiteHandleList);
+}
 
-        if (json_item["port"].is_null()) {
-            SERV_LIB_LOG("response_json format error.\n");
-            return RET_CODE_ERROR_REQ_JSON_FORMAT;
-        }
+int ServiceSiteManager::querySiteListBySiteId(string pSiteId, std::vector<SiteHandle>& pSiteHandleList) {
+    return siteDiscovery.lookup(pSiteId, pSiteHandleList);
+}
 
-        string site_id = json_item["site_id"];
-        string summary = json_item["summary"];
-        // 与 query_site 一致 
-        string ip = json_item["ip"];
-        int port = json_item["port"];
+void ServiceSiteManager::setSiteDiscoveryTtl(int seconds) {
+    siteDiscovery.setTtlSeconds(seconds);
+}
 
-        SiteHandle siteHandle(site_id, summary, query_site_ip, port);
-        
-        pSiteHandleList.push_back(siteHandle);
+void ServiceSiteManager::setQueryCacheTtl(int milliseconds) {
+    listQueries.setTtlMs(milliseconds);
+    if (milliseconds <= 0) {
+        listQueries.clear();
     }
-
-    return RET_CODE_OK;
 }
 
 SiteHandle::SiteHandle(string pSiteId, string pSummary, string pIp, int pPort) {
@@ -995,50 +1047,8 @@ SiteHandle::SiteHandle(string pSiteId, string pSummary, string pIp, int pPort) {
     port = pPort;
 }
 
-MessageSubscriber::MessageSubscriber(string pMessageId) {
-    messageId = pMessageId;
-}
-
-string MessageSubscriber::getMessageId(void) {
-    return messageId;
-}
-
-bool MessageSubscriber::addSiteMessageSubscriberSiteHandleP(MessageSubscriberSiteHandle* pMessageSubscriberSiteHandle) {
-    bool need_save = false;
-
-    MessageSubscriberSiteHandle* temp = NULL;
-    for (auto& item : siteMessageSubscriberSiteHandlePlist) {
-        if (item == pMessageSubscriberSiteHandle) {
-            // 已存在
-            temp = item;
-            break;
-        }
-    }
-
-    if (temp == NULL) {
-        // 不存在 添加
-        siteMessageSubscriberSiteHandlePlist.push_back(pMessageSubscriberSiteHandle);
-
-        need_save = true;
-    }
-
-    pMessageSubscriberSiteHandle->setIsStop(false);
-
-    return need_save;
-}
-
-void MessageSubscriber::delSiteMessageSubscriberSiteHandleP(MessageSubscriberSiteHandle* pMessageSubscriberSiteHandle) {
-    std::vector<MessageSubscriberSiteHandle*>::iterator iter=std::find(siteMessageSubscriberSiteHandlePlist.begin(), siteMessageSubscriberSiteHandlePlist.end(), pMessageSubscriberSiteHandle);
-    siteMessageSubscriberSiteHandlePlist.erase(iter);
-}
-
-std::vector<MessageSubscriberSiteHandle*> MessageSubscriber::getSiteMessageSubscriberSiteHandlePlist(void) {
-    return siteMessageSubscriberSiteHandlePlist;
-}
-
 void  message_subscriber_site_handle_send_message_thread(MessageSubscriberSiteHandle& messageSubscriberSiteHandle) {
-    while (true) {
-        messageSubscriberSiteHandle.sendFromThread();
+    while (messageSubscriberSiteHandle.sendFromThread()) {
     }
 }
 
@@ -1064,22 +1074,40 @@ int MessageSubscriberSiteHandle::getPort(void) {
     return port;
 }
 
-void MessageSubscriberSiteHandle::sendFromThread(void) {
+bool MessageSubscriberSiteHandle::sendFromThread(void) {
     string message = "";
+    bool cbor = false;
 
     sem_wait(&sem); 
 
     queue_mutex.lock();
 
     if (!queue.empty()) {
-        message = queue.front();
+        message = std::move(queue.front().first);
+        cbor = queue.front().second;
         queue.pop();
+        subscriberMetrics().queued.sub(1);
+    }
+
+    // 停止时超过时限，剩余消息丢弃
+    if (isDraining && steadyNowMs() > drainDeadlineMs) {
+        if (message != "" || !queue.empty()) {
+            SERV_LIB_LOG("drain timeout, drop {} messages to {} {}", queue.size() + (message != "" ? 1 : 0), ip, port);
+            subscriberMetrics().dropped.inc(queue.size() + (message != "" ? 1 : 0));
+            subscriberMetrics().queued.sub(queue.size());
+        }
+        while (!queue.empty()) {
+            queue.pop();
+        }
+        queue_mutex.unlock();
+        return false;
     }
 
     queue_mutex.unlock();
 
     if (message == "") {
-        return;
+        // 队列已空，stopSending 的唤醒
+        return !isDraining;
     }
 
     if (cli == nullptr) {
@@ -1100,44 +1128,67 @@ void MessageSubscriberSiteHandle::sendFromThread(void) {
         cli->set_connection_timeout(1, 0);
     }
 
-    auto res = cli->Post("/", message, "text/plain");
+    auto res = cli->Post("/", message, cbor ? qlibc::CborContentType : "text/plain");
     if (!res) {
-        SERV_LIB_LOG("client connect error. %s %d\n", ip.c_str(), port);
+        SERV_LIB_LOG_RATE(10, "client connect error. {} {}", ip, port);
 
         ++sendRetryCount;
+        subscriberMetrics().failed.inc();
     }
     else {
         if (res->status != 200) {
-            SERV_LIB_LOG("http status = %d, error.\n", res->status);
+            SERV_LIB_LOG_RATE(10, "http status = {}, error.", res->status);
 
             ++sendRetryCount;
+            subscriberMetrics().failed.inc();
+        }
+        else {
+            subscriberMetrics().sent.inc();
         }
     }
 
     if (sendRetryCount >= MAX_SEND_RETRY) {
-        SERV_LIB_LOG("sendRetryCount = %d, error.\n", sendRetryCount);
+        SERV_LIB_LOG_RATE(10, "sendRetryCount = {}, error.", sendRetryCount);
         sendRetryCount = 0;
 
         // isStop = true;
     }
+
+    return true;
+}
+
+void MessageSubscriberSiteHandle::stopSending(int64_t deadlineMs) {
+    drainDeadlineMs = deadlineMs;
+    isDraining = true;
+
+    sem_post(&sem); 
+}
+
+void MessageSubscriberSiteHandle::joinSendThread(void) {
+    if (sendMessageThreadP != nullptr && sendMessageThreadP->joinable()) {
+        sendMessageThreadP->join();
+    }
 }
 
-void MessageSubscriberSiteHandle::sendMessage(string message) {
-    if (isStop) {
+void MessageSubscriberSiteHandle::sendMessage(string message, bool cbor) {
+    if (isStop || isDraining) {
         return;
     }
     
     queue_mutex.lock();
 
     if (queue.size() > MAX_QUEUE_SIZE) {
-        SERV_LIB_LOG("queue is full.\n");
+        SERV_LIB_LOG_RATE(10, "queue is full.");
+        subscriberMetrics().dropped.inc(queue.size());
+        subscriberMetrics().queued.sub(queue.size());
 
         // 队列满， 清空
         while(!queue.empty()) {
             queue.pop();
         }
     }
-    queue.push(message);
+    queue.push(std::make_pair(std::move(message), cbor));
+    subscriberMetrics().queued.add(1);
 
     queue_mutex.unlock();
 
@@ -1157,222 +1208,80 @@ bool MessageSubscriberSiteHandle::getIsStop(void) {
     return isStop;
 }
 
-void servicesite::ServiceSiteManager::saveMessageSubscriber(void) {
-    json message_subscriber_list = json::array();
-
-    for (auto& item : messageSubscriberList) {
-        json item_json = {
-            {"messageId", item.getMessageId()},
-            {"site_handle_list", json::array()}
-        };
-
-        for (const auto& sub_item : item.getSiteMessageSubscriberSiteHandlePlist()) {
-            json sub_item_json = {
-                {"ip", sub_item->getIp()},
-                {"port", sub_item->getPort()},
-                {"sendRetryCount", sub_item->getSendRetryCount()},
-                {"isStop", sub_item->getIsStop()},
-            };
-
-            item_json["site_handle_list"].push_back(sub_item_json);
-        }
-
-        message_subscriber_list.push_back(item_json);
-    }
-
-    string config_filename = messageSubscriberConfigPath + siteId + MESSAGE_SUBSCRIBER_CONFIG_FILE;
-
-    // SERV_LIB_LOG("----%s\n", config_filename.c_str());
-    // SERV_LIB_LOG("----%s\n", message_subscriber_list.dump(4).c_str());
-
-    if (0 != createDir(ServiceSiteManager::messageSubscriberConfigPath)) {
-        SERV_LIB_LOG("createDir error: %s\n", messageSubscriberConfigPath.c_str());
-        return;
-    }
-
-    int fd = open(config_filename.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0777);
-    if(fd == -1)
-    { 
-        SERV_LIB_LOG("open error: %s\n", config_filename.c_str());
-        return;
-    } 
-
-    string json_data = message_subscriber_list.dump(4);
-    write(fd, json_data.c_str(), json_data.size());
-
-    close(fd);
+void MessageSubscriberSiteHandle::setAcceptCbor(bool pAcceptCbor) {
+    acceptCbor = pAcceptCbor;
+}
 
-    SERV_LIB_LOG("saveMessageSubscriber ok.\n");
+bool MessageSubscriberSiteHandle::getAcceptCbor(void) {
+    return acceptCbor;
 }
 
+// 快照 + 日志中的订阅在启动时恢复，之后的变化由 subscriptionStore 在后台落盘
 void servicesite::ServiceSiteManager::loadMessageSubscriber(void) {
-    const int buf_size = 10 * 1024;
-    char buf[buf_size];
-    
-    string config_filename = messageSubscriberConfigPath + siteId + MESSAGE_SUBSCRIBER_CONFIG_FILE;
-
-    // SERV_LIB_LOG("----%s\n", config_filename.c_str());
+    string snapshot_filename = messageSubscriberConfigPath + siteId + MESSAGE_SUBSCRIBER_CONFIG_FILE;
+    string journal_filename = messageSubscriberConfigPath + siteId + MESSAGE_SUBSCRIBER_JOURNAL_FILE;
 
-	int fd = open(config_filename.c_str(), O_RDONLY);
-	if(fd == -1)
-	{
-		SERV_LIB_LOG("open error: %s\n", config_filename.c_str());
-		return;
-	}
-
-	int read_len = read(fd, buf, buf_size);
-	close(fd);
-
-    if (read_len == buf_size) {
-        SERV_LIB_LOG("read_len error: %d\n", read_len);
-        return;
-    }
-
-    buf[read_len] = 0;
-
-    if (!json::accept(string(buf))) {
-        SERV_LIB_LOG("json::accept error: %s\n", buf);
-        return;
+    if (0 != createDir(ServiceSiteManager::messageSubscriberConfigPath)) {
+        SERV_LIB_LOG("createDir error: {}", messageSubscriberConfigPath);
     }
 
-    json message_subscriber_list = json::parse(buf);
-
-    // SERV_LIB_LOG("----%s\n", message_subscriber_list.dump(4).c_str());
-    for (json& item : message_subscriber_list) {
-        if (!item["messageId"].is_string()) {
-            SERV_LIB_LOG("json::parse messageId error: %s\n", item.dump().c_str());
+    bool ok = subscriptionStore.load(snapshot_filename, journal_filename, [](bool subscribe, const SubscriptionRecord& record) {
+        if (subscribe) {
+            subscribeMessage(record.messageId, record.ip, record.port, record.acceptCbor);
             return;
         }
-
-        string message_id = item["messageId"];
-
-        if (!item["site_handle_list"].is_array()) {
-            SERV_LIB_LOG("json::parse site_handle_list error: %s\n", item.dump().c_str());
-            return;
-        }
-
-        for (json& sub_item : item["site_handle_list"]) {
-            if (!sub_item["ip"].is_string()) {
-                SERV_LIB_LOG("json::parse ip error: %s\n", sub_item.dump().c_str());
-                return;
-            }
-            
-            string ip = sub_item["ip"];
-
-            if (!sub_item["port"].is_number_integer()) {
-                SERV_LIB_LOG("json::parse ip port: %s\n", sub_item.dump().c_str());
-                return;
-            }
-
-            int port = sub_item["port"];
-
-            // SERV_LIB_LOG("%s %s %d\n", messageId.c_str(), ip.c_str(), port);
-
-            subscribeMessage(message_id, ip, port);
+        MessageSubscriberSiteHandle* site_handle = messageSubscribers.site(record.ip, record.port, false);
+        if (site_handle != NULL) {
+            messageSubscribers.unsubscribe(record.messageId, site_handle);
         }
+    });
+    if (!ok) {
+        SERV_LIB_LOG("loadMessageSubscriber error: {}", snapshot_filename);
     }
+
+    subscriptionStore.start(messageSubscriberListToJson);
 }
 
 int servicesite::ServiceSiteManager::registerSite(void) {
-    json request_json = {
-		{"service_id", ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_REGISTER},
-		{"request", {
-			{"site_id", siteId},
-            {"summary", summary},
-            {"port", serverPort}
-		}}
-	};
-
     Client cli(ServiceSiteManager::QUERY_SITE_IP, ServiceSiteManager::QUERY_SITE_PORT);
+    return registerSite(cli);
+}
 
-    auto res = cli.Post("/", request_json.dump(), "text/plain");
-    if (!res) {
-        SERV_LIB_LOG("client connect error.\n");
-        return RET_CODE_ERROR_REQ_CONN;
-    }
-
-    if (res->status != 200) {
-        SERV_LIB_LOG("http status = %d, error.\n", res->status);
-        return RET_CODE_ERROR_REQ_STATUS_CODE;
-    }
-
-    if (!json::accept(res->body)) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_NOT_JSON;
-    }
-
-    json response_json = json::parse(res->body);
-
-    if (response_json["code"].is_null()) {
-        SERV_LIB_LOG("response_json format error.\n");
-        return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    }
-
-    // if (response_json["response"].is_null()) {
-    //     SERV_LIB_LOG("response_json format error.\n");
-    //     return RET_CODE_ERROR_REQ_JSON_FORMAT;
-    // }
-
-    return RET_CODE_OK;
+int servicesite::ServiceSiteManager::registerSite(Client& cli) {
+    Json::Value request_json;
+    request_json["service_id"] = ServiceSiteManager::QUERY_SITE_SERVICE_ID_SITE_REGISTER;
+    Json::Value& request_body = request_json["request"];
+    request_body["site_id"] = siteId;
+    request_body["summary"] = summary;
+    request_body["port"] = serverPort;
+
+    // 只要求返回 code
+    ServiceStatus result;
+    return postServiceRequest(cli, request_json, result);
 }
 
-bool servicesite::ServiceSiteManager::subscribeMessage(string message_id, string ip, int port) {
+bool servicesite::ServiceSiteManager::subscribeMessage(string message_id, string ip, int port, bool accept_cbor) {
     bool need_save = false;
-    bool is_msg_id_ok = false;
 
-    // 检查是否支持此 消息ID
-    for (auto& item : messageIds) {
-        if (item.messageId == message_id) {
-            is_msg_id_ok = true;
-            break;
-        }
-    }
     // 不支持消息ID，返回false
-    if (!is_msg_id_ok) {
+    if (!messageSubscribers.hasTopic(message_id)) {
         return false;
     }
 
-    // 线程锁, 对象析构时解锁
-    std::lock_guard<std::mutex> lockGuard(messageSubscriberList_mutex);
-
-    MessageSubscriberSiteHandle* temp_messageSubscriberSiteHandle = NULL;
-    // 查找站点是否订阅过
-    for (auto& item : messageSubscriberSiteHandlePList) {
-        if (item->getIp() == ip) {
-            if (item->getPort() == port) {
-                temp_messageSubscriberSiteHandle = item;
-                break;
-            }
-        }
-    }
-    // 未订阅创建新的站点handle
-    if (temp_messageSubscriberSiteHandle == NULL) {
-        temp_messageSubscriberSiteHandle = new MessageSubscriberSiteHandle(ip, port);
-        messageSubscriberSiteHandlePList.push_back(temp_messageSubscriberSiteHandle);
-    }
-    
-    // 检查此消息ID的订阅者是否存在
-    MessageSubscriber* temp_messageSubscriber = NULL;
-    for (auto& item : messageSubscriberList) {
-        if (message_id == item.getMessageId()) {
-            temp_messageSubscriber = &item;
-        }
-    }
-
-    // 不已存在，创建订阅者
-    if (temp_messageSubscriber == NULL) {
-        temp_messageSubscriber = new MessageSubscriber(message_id);
-        temp_messageSubscriber->addSiteMessageSubscriberSiteHandleP(temp_messageSubscriberSiteHandle);
+    // 站点未订阅过时创建新的站点handle
+    MessageSubscriberSiteHandle* site_handle = messageSubscribers.site(ip, port, true);
 
-        messageSubscriberList.push_back(*temp_messageSubscriber);
+    // 以最近一次订阅为准，站点升级/降级后重新订阅即可
+    if (site_handle->getAcceptCbor() != accept_cbor) {
+        site_handle->setAcceptCbor(accept_cbor);
         need_save = true;
     }
-    else {
-        // 已存在
-        if (temp_messageSubscriber->addSiteMessageSubscriberSiteHandleP(temp_messageSubscriberSiteHandle)) {
-            need_save = true;
-        }
+
+    if (messageSubscribers.subscribe(message_id, site_handle)) {
+        need_save = true;
     }
 
+    site_handle->setIsStop(false);
+
     return need_save;
 }
@@ -8,20 +8,38 @@
 #ifndef LIB_SERVICE_SITE_MANAGER_H_
 #define LIB_SERVICE_SITE_MANAGER_H_
 
+#include <atomic>
 #include <iostream>
 #include <functional>
 #include <semaphore.h>
 #include <queue>
 #include "http/httplib.h"
+#include "log/Logging.h"
+#include "qlibc/jsoncpp/json.h"
+#include "subscription_registry.h"
+#include "single_flight.h"
+#include "subscription_store.h"
+#include "timer_wheel.h"
 
-#define SERV_LIB_LOG(...) printf(__VA_ARGS__)
-// #define SERV_LIB_LOG(...) easylogging_log(__VA_ARGS__)
+/*
+ * 站点库日志，fmt 格式（"{}" 占位符），经 muduo Logger 直接格式化进日志缓冲区后写入日志文件
+ * 定义 SERV_LIB_LOG_DISABLE 时编译期去除所有站点库日志
+ */
+#ifdef SERV_LIB_LOG_DISABLE
+#define SERV_LIB_LOG(...) do {} while (0)
+#define SERV_LIB_LOG_RATE(perSecond, ...) do {} while (0)
+#else
+#define SERV_LIB_LOG(...) LOG_INFO.format(__VA_ARGS__)
+// 高频调用点使用，每秒最多输出 perSecond 条
+#define SERV_LIB_LOG_RATE(perSecond, ...) LOG_INFO_RATE(perSecond).format(__VA_ARGS__)
+#endif
  
 using namespace std;
 using namespace httplib;
 
 void http_exception_handler(const Request& request, Response& response, std::exception& e);
 
+// printf 格式的兼容接口，新代码使用 SERV_LIB_LOG
 void easylogging_log(const char* format, ...);
 
 namespace servicesite {
@@ -34,8 +52,8 @@ typedef struct MessageIdT {
 
 class SiteHandle;
 class MessageSubscriberSiteHandle;
-class MessageSubscriber;
 class ServiceSiteManager;
+class SiteDiscoveryCache;
 
 /**
  * @brief 服务请求处理函数
@@ -76,9 +94,13 @@ class ServiceSiteManager {
     static MessageIds messageIds;
     static MessageHandlers messageHandlers;
 
-    static std::vector<SiteHandle> siteHandleList;
-    static std::vector<MessageSubscriber> messageSubscriberList;
-    static std::vector<MessageSubscriberSiteHandle*> messageSubscriberSiteHandlePList;
+    // 站点发现缓存，查找不访问网络；由查询站点的上线/下线消息增量更新
+    static SiteDiscoveryCache siteDiscovery;
+    static int fetchSiteList(std::vector<SiteHandle>& pSiteHandleList);
+    // 相同的服务列表/消息列表查询合并为一次请求，结果可短时缓存
+    static SingleFlight<std::vector<string>> listQueries;
+    // 消息订阅表，按 message_id 和 (ip, port) 索引，发布时无锁查找
+    static SubscriptionRegistry<MessageSubscriberSiteHandle> messageSubscribers;
 
     static void rawHttpRequestHandler(const Request& request, Response& response);
     
@@ -90,6 +112,11 @@ class ServiceSiteManager {
     static int serviceRequestHandlerDebug(const Request& request, Response& response);
 
     static void messageHandlerRegisterAgain(const Request& request);
+    static void messageHandlerSiteOnline(const Request& request);
+    static void messageHandlerSiteOffline(const Request& request);
+
+    static Json::Value siteHandleToJson(MessageSubscriberSiteHandle* siteHandle);
+    static Json::Value messageSubscriberListToJson(void);
 
     static string siteId;
     static string summary;
@@ -98,15 +125,38 @@ class ServiceSiteManager {
     static int serverPort;
 
     static const string MESSAGE_SUBSCRIBER_CONFIG_FILE;
+    static const string MESSAGE_SUBSCRIBER_JOURNAL_FILE;
     static string messageSubscriberConfigPath;
 
-    static std::thread* pingThreadP;
+    // 订阅变化追加到日志，后台线程落盘并定期生成快照
+    static SubscriptionStore subscriptionStore;
+
+    // 心跳、注册重试等定时任务共用一个定时器线程
+    static TimerWheel timerWheel;
+
+    // 以下只在定时器线程中使用
+    static int64_t leaseExpireMs;
+    static RetryBackoff registerBackoff;
+    static std::atomic<bool> isRegisterScheduled;
+
+    static std::atomic<bool> isShutdown;
+
+    static bool acceptCbor;
 
-    static void saveMessageSubscriber(void);
     static void loadMessageSubscriber(void);
 
     static int registerSite(void);
-    static bool subscribeMessage(string message_id, string ip, int port);
+    static int registerSite(Client& cli);
+
+    static Client& querySiteClient(void);
+    static void scheduleHeartbeat(int delayMs);
+    static void heartbeatTask(void);
+    static void scheduleRegister(int delayMs);
+    static void registerTask(void);
+    static bool subscribeMessage(string message_id, string ip, int port, bool accept_cbor = false);
+    static int listenServer(void);
+
+    static void publishEncoded(const string& messageId, const string* jsonMessage, const Json::Value* message);
 
     ServiceSiteManager();
     static ServiceSiteManager instance;
@@ -118,6 +168,7 @@ public:
     static const int RET_CODE_ERROR_REQ_NOT_JSON;
     static const int RET_CODE_ERROR_REQ_JSON_FORMAT;
     static const int RET_CODE_ERROR_REQ_CODE;
+    static const int RET_CODE_ERROR_SHUTDOWN_TIMEOUT;
 
     static const string RET_OK;
 
@@ -129,11 +180,22 @@ public:
      */
     static const int QUERY_SITE_PORT = 9000;
     static const int PING_PER_SECONDS = 10;
+    // 连续这么多个心跳周期没有成功时视为注册已失效，重新注册
+    static const int LEASE_PING_COUNT = 3;
+    // 注册失败后的重试间隔，指数增长
+    static const int REGISTER_RETRY_BASE_MS = 1000;
+    static const int REGISTER_RETRY_MAX_MS = 30000;
+    static const int QUERY_SITE_TIMEOUT_SECONDS = 3;
+    static const int SHUTDOWN_DEADLINE_MS = 5000;
+    // 查询站点重启后所有站点同时重新注册，连接突发时不溢出（内核按 somaxconn 截断）
+    static const int LISTEN_BACKLOG = 1024;
 
     static const string QUERY_SITE_SERVICE_ID_SITE_REGISTER;
     static const string QUERY_SITE_SERVICE_ID_SITE_PING;
 
     static const string QUERY_SITE_MESSAGE_ID_REGISTER_AGAIN;
+    static const string QUERY_SITE_MESSAGE_ID_SITE_ONLINE;
+    static const string QUERY_SITE_MESSAGE_ID_SITE_OFFLINE;
 
 
     static ServiceSiteManager* getInstance() {
@@ -156,6 +218,41 @@ public:
      */
     static int startByRegister(void);
 
+    /**
+     * @brief 停止站点，可在任意线程调用，多次调用只执行一次
+     * 
+     * 依次：停止心跳和重新注册；停止接受新连接，等待处理中的请求结束（start/startByRegister 随后返回）；
+     * 发完各订阅者队列中的消息；订阅日志落盘并生成快照；等待站点发现的后台同步结束
+     * 之后 start/startByRegister 直接返回 RET_CODE_ERROR_START_SERVER
+     * @param deadlineMs 总时限，超时后未完成的请求连接被关闭，未发出的消息被丢弃
+     * @return int 错误码，超时返回 RET_CODE_ERROR_SHUTDOWN_TIMEOUT
+     */
+    static int shutdown(int deadlineMs = SHUTDOWN_DEADLINE_MS);
+
+    static bool isShuttingDown(void) {
+        return isShutdown;
+    }
+
+    /**
+     * @brief 监听端口时设置 SO_REUSEPORT，start 之前调用
+     * 
+     * 用于不停服升级：新进程（同样开启）先监听同一端口，再让旧进程 shutdown；旧进程停止 accept 后新连接都由新进程处理
+     * 旧进程关闭监听时 accept 队列中尚未取出的连接会被内核重置，客户端需要重试
+     */
+    static void setReusePort(bool on) {
+        server.set_reuse_port(on);
+    }
+
+    /**
+     * @brief 用 count 个 SO_REUSEPORT 套接字监听，每个有自己的 accept 线程和处理线程池，start 之前调用
+     * 
+     * 默认一个；连接建立频繁（如查询站点）时设为 CPU 数，pinCpu 为 true 时第 i 个 accept 线程及其线程池绑定到第 i 个 CPU
+     */
+    static void setListenAcceptors(size_t count, bool pinCpu) {
+        server.set_acceptor_count(count);
+        server.set_acceptor_cpu_affinity(pinCpu);
+    }
+
     /**
      * @brief 注册服务请求处理函数
      * 
@@ -200,24 +297,49 @@ public:
      * @return int 错误码参照错误码定义
      */
     void publishMessage(string messageId, string message);
+    // 字符串字面量按 JSON 字符串发布，避免与 Json::Value 重载歧义
+    void publishMessage(string messageId, const char* message);
 
     /**
-     * @brief 更新局域网内所有站点信息
+     * @brief 发布消息，序列化一次后发给所有订阅者
+     * 
+     * @param meeageId 消息ID
+     * @param message 消息 JSON
+     */
+    void publishMessage(string messageId, const Json::Value& message);
+
+    /**
+     * @brief 当前线程正在处理的请求已解析的 JSON
+     * 
+     * 只在服务请求/消息处理函数内有效，处理函数直接使用，不需要再解析 request.body
+     */
+    static const Json::Value& requestJson(void);
+
+    /**
+     * @brief 设置 JSON 响应，请求方声明接收 CBOR（Accept: application/cbor）时按 CBOR 编码
+     * 
+     * 只在服务请求处理函数内使用
+     */
+    static void setResponseJson(Response& response, const Json::Value& value);
+
+    /**
+     * @brief 立即从查询站点全量更新站点发现缓存
      * 
      * @return int 错误码参照错误码定义 
      */
     int updateSiteHandleList(void);
 
     /**
-     * @brief 查询站点列表
+     * @brief 查询站点列表，从站点发现缓存读取，不访问网络
      * 
+     * 缓存从未同步过时先同步一次；超过 TTL 时返回缓存内容并在后台同步
      * @param siteHandleList 站点handle列表
      * @return int 错误码参照错误码定义 
      */
     int querySiteList(std::vector<SiteHandle>& pSiteHandleList);
 
     /**
-     * @brief 通过站点ID列表查询站点列表
+     * @brief 通过站点ID列表查询站点列表，从站点发现缓存读取，同 querySiteList
      * 
      * @param pSiteId 站点ID
      * @param pSiteHandleList 站点handle列表
@@ -225,6 +347,27 @@ public:
      */
     int querySiteListBySiteId(string pSiteId, std::vector<SiteHandle>& pSiteHandleList);
 
+    /**
+     * @brief 站点发现缓存的过期时间，默认 60 秒
+     * 
+     * 查询站点不发布上线/下线消息时，缓存最多落后此时间
+     */
+    static void setSiteDiscoveryTtl(int seconds);
+
+    /**
+     * @brief getServiceList/getMessageList 结果的缓存时间，默认 0
+     * 
+     * 并发的相同查询总是合并为一次请求；大于 0 时成功的结果再缓存此时间，站点上线/下线时清空
+     */
+    static void setQueryCacheTtl(int milliseconds);
+
+    /**
+     * @brief 在 path 上以 GET 提供 Prometheus 文本格式的指标，默认不开启，start 之前调用
+     * 
+     * 包括 http 连接/线程池/客户端请求、各 service_id 的延迟、订阅消息发送、日志条数
+     */
+    static void enableMetrics(const string& path = "/metrics");
+
     /**
      * @brief 获取站点服务列表
      * 
@@ -275,10 +418,26 @@ public:
 
     static int createDir(string sPathName);
 
+    /**
+     * @brief 站点库共用的定时器，站点的周期任务可以直接使用，不必单独创建线程
+     */
+    static TimerWheel& getTimerWheel() {
+        return timerWheel;
+    }
+
 	static void setMessageSubscriberConfigPath(string pMessageSubscriberConfigPath) {
 		messageSubscriberConfigPath = pMessageSubscriberConfigPath;
 	}
 
+	/**
+	 * @brief 订阅消息时声明本站点可以接收 CBOR 编码的消息
+	 * 
+	 * 开启后收到的消息 request.body 可能是 CBOR，消息处理函数需通过 requestJson() 读取消息内容
+	 */
+	static void setAcceptCbor(bool pAcceptCbor) {
+		acceptCbor = pAcceptCbor;
+	}
+
 	static void setSiteIdSummary(string pSiteId, string pSummary) {
 		siteId = pSiteId;
 		summary = pSummary;
@@ -326,18 +485,6 @@ public:
 	}
 };
 
-class MessageSubscriber {
-    string messageId;
-
-    std::vector<MessageSubscriberSiteHandle*> siteMessageSubscriberSiteHandlePlist;
-public:
-    MessageSubscriber(string pMessageId);
-    string getMessageId(void);
-    bool addSiteMessageSubscriberSiteHandleP(MessageSubscriberSiteHandle* pMessageSubscriberSiteHandle);
-    void delSiteMessageSubscriberSiteHandleP(MessageSubscriberSiteHandle* pMessageSubscriberSiteHandle);
-    std::vector<MessageSubscriberSiteHandle*> getSiteMessageSubscriberSiteHandlePlist(void);
-};
-
 class MessageSubscriberSiteHandle {
     static const int MAX_QUEUE_SIZE = 20;
     static const int MAX_SEND_RETRY = 3;
@@ -348,22 +495,31 @@ class MessageSubscriberSiteHandle {
     Client* cli = nullptr;
 
     sem_t sem;
-    std::queue<string> queue;
+    std::queue<std::pair<string, bool>> queue;  // second 为 true 时消息为 CBOR 编码
     std::mutex queue_mutex; // 保护 队列
     std::thread* sendMessageThreadP;
 
     int sendRetryCount;
     bool isStop;
+    std::atomic<bool> acceptCbor{false};  // 发布线程无锁读取
+    std::atomic<bool> isDraining{false};
+    std::atomic<int64_t> drainDeadlineMs{0};
     
 public:
     MessageSubscriberSiteHandle(string pIp, int pPort);
     string getIp(void);
     int getPort(void);
-    void sendFromThread(void);
-    void sendMessage(string message);
+    // 发送一条消息，返回 false 时发送线程退出
+    bool sendFromThread(void);
+    // 不再接受新消息，队列发完（或到达 deadlineMs，steady_clock 毫秒）后发送线程退出
+    void stopSending(int64_t deadlineMs);
+    void joinSendThread(void);
+    void sendMessage(string message, bool cbor = false);
     void setIsStop(bool pIsStop);
     int getSendRetryCount(void);
     bool getIsStop(void);
+    void setAcceptCbor(bool pAcceptCbor);
+    bool getAcceptCbor(void);
 };
 
 }
@@ -0,0 +1,174 @@
+/*
+ * single_flight.h
+ *
+ *  Created on: 2022年7月21日
+ */
+
+#ifndef LIB_SINGLE_FLIGHT_H_
+#define LIB_SINGLE_FLIGHT_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace servicesite {
+
+/*
+ * 相同请求合并，Value 为解析后的结果
+ *
+ *  1. 同一 key 同一时间只有一个调用在执行，并发的相同请求等待并共享它的错误码和结果
+ *  2. ttlMs 大于 0 时成功的结果再缓存 ttlMs，期间的相同请求直接返回缓存；失败的结果不缓存
+ *  3. 结果是不可变对象，调用者之间共享，不复制
+ *
+ * loader 在第一个调用者的线程中执行，返回错误码，0 表示成功；loader 不能再对同一 key 调用 run
+ * loader 抛出异常时按失败处理，异常在第一个调用者和所有等待者中重新抛出
+ */
+template <typename Value>
+class SingleFlight {
+public:
+    using ValuePtr = std::shared_ptr<const Value>;
+    using Loader = std::function<int(Value&)>;
+
+    // 缓存条目超过此数时清理过期条目
+    static const size_t PURGE_THRESHOLD = 256;
+
+private:
+    struct Call {
+        bool done = false;
+        int ret = 0;
+        std::exception_ptr error;
+        ValuePtr value;
+        int64_t expireMs = 0;
+    };
+
+    std::mutex callMutex; // 保护 calls
+    std::condition_variable doneCond;
+    std::unordered_map<std::string, std::shared_ptr<Call>> calls;   // 执行中和已缓存的调用
+    std::atomic<int> ttlMs;
+
+public:
+    explicit SingleFlight(int pTtlMs = 0) : ttlMs(pTtlMs) {}
+
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    /**
+     * @brief 执行或加入 key 对应的调用
+     *
+     * @param value 成功时为结果
+     * @return int loader 的错误码
+     */
+    int run(const std::string& key, const Loader& loader, ValuePtr& value) {
+        std::shared_ptr<Call> call;
+        {
+            std::unique_lock<std::mutex> lock(callMutex);
+            auto iter = calls.find(key);
+            if (iter != calls.end()) {
+                call = iter->second;
+                if (!call->done) {
+                    doneCond.wait(lock, [&call] { return call->done; });
+                    if (call->error) {
+                        std::rethrow_exception(call->error);
+                    }
+                    value = call->value;
+                    return call->ret;
+                }
+                if (nowMs() < call->expireMs) {
+                    value = call->value;
+                    return call->ret;
+                }
+                calls.erase(iter);
+            }
+
+            if (calls.size() >= PURGE_THRESHOLD) {
+                purgeLocked();
+            }
+            call = std::make_shared<Call>();
+            calls.emplace(key, call);
+        }
+
+        std::shared_ptr<Value> result = std::make_shared<Value>();
+        int ret = -1;
+        std::exception_ptr error;
+        try {
+            ret = loader(*result);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lockGuard(callMutex);
+        call->done = true;
+        call->ret = ret;
+        call->error = error;
+        if (ret == 0 && !error) {
+            call->value = std::move(result);
+        }
+
+        int ttl = ttlMs.load();
+        if (ret == 0 && !error && ttl > 0) {
+            call->expireMs = nowMs() + ttl;
+        }
+        else {
+            // clear() 后 key 可能已对应新的调用
+            auto iter = calls.find(key);
+            if (iter != calls.end() && iter->second == call) {
+                calls.erase(iter);
+            }
+        }
+        doneCond.notify_all();
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        value = call->value;
+        return ret;
+    }
+
+    // 0 关闭缓存，只合并并发的请求
+    void setTtlMs(int pTtlMs) {
+        ttlMs.store(pTtlMs);
+    }
+
+    // 丢弃缓存的结果，执行中的调用不受影响
+    void clear(void) {
+        std::lock_guard<std::mutex> lockGuard(callMutex);
+        for (auto iter = calls.begin(); iter != calls.end();) {
+            if (iter->second->done) {
+                iter = calls.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+
+private:
+    void purgeLocked(void) {
+        int64_t now = nowMs();
+        for (auto iter = calls.begin(); iter != calls.end();) {
+            if (iter->second->done && now >= iter->second->expireMs) {
+                iter = calls.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+
+    static int64_t nowMs(void) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+}
+
+#endif /* LIB_SINGLE_FLIGHT_H_ */
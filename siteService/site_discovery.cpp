@@ -0,0 +1,258 @@
+/*
+ * site_discovery.cpp
+ *
+ *  Created on: 2022年7月18日
+ */
+#include <chrono>
+#include "qlibc/Epoch.h"
+#include "site_discovery.h"
+
+using namespace servicesite;
+
+static int64_t steadyNowMs(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SiteDiscoveryCache::SiteDiscoveryCache(SiteListFetcher pFetcher, int ttlSeconds)
+    : fetcher(std::move(pFetcher)), ttlMs(ttlSeconds * 1000), current(nullptr),
+      syncTimeMs(0), eventCount(0), isRefreshing(false), isStop(false),
+      refreshCount(0), lastRefreshRet(ServiceSiteManager::RET_CODE_OK) {
+}
+
+// 析构时不应再有读者
+SiteDiscoveryCache::~SiteDiscoveryCache() {
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+    delete current.load();
+    for (auto& item : retiredList) {
+        delete item.first;
+    }
+}
+
+int SiteDiscoveryCache::lookup(const string& pSiteId, std::vector<SiteHandle>& pSiteHandleList) {
+    int ret = ensureLoaded();
+    if (ret != ServiceSiteManager::RET_CODE_OK) {
+        return ret;
+    }
+
+    qlibc::EpochReadGuard guard;
+    const Directory* directory = current.load();
+    if (directory == nullptr) {
+        return ServiceSiteManager::RET_CODE_OK;
+    }
+
+    auto iter = directory->siteIdIndex.find(pSiteId);
+    if (iter != directory->siteIdIndex.end()) {
+        pSiteHandleList.insert(pSiteHandleList.end(), iter->second.begin(), iter->second.end());
+    }
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
+
+int SiteDiscoveryCache::getAll(std::vector<SiteHandle>& pSiteHandleList) {
+    int ret = ensureLoaded();
+    if (ret != ServiceSiteManager::RET_CODE_OK) {
+        return ret;
+    }
+
+    qlibc::EpochReadGuard guard;
+    const Directory* directory = current.load();
+    if (directory == nullptr) {
+        return ServiceSiteManager::RET_CODE_OK;
+    }
+
+    pSiteHandleList.insert(pSiteHandleList.end(), directory->siteList.begin(), directory->siteList.end());
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
+
+// 调用方不能在 epoch 读区间内：第一次同步是阻塞的网络请求，读区间期间全进程的 retire 都无法回收
+int SiteDiscoveryCache::ensureLoaded(void) {
+    if (current.load() == nullptr) {
+        // 从未同步成功过，并发的第一次查找只同步一次
+        uint64_t refresh_count = refreshCount.load();
+        std::lock_guard<std::mutex> lockGuard(refreshMutex);
+        if (current.load() != nullptr) {
+            return ServiceSiteManager::RET_CODE_OK;
+        }
+        // 等锁期间的同步失败了，等待者共用其结果，不逐个重复请求
+        if (refreshCount.load() != refresh_count) {
+            return lastRefreshRet;
+        }
+        // 上次失败后 REFRESH_RETRY_MS 内不再请求查询站点
+        if (!isStale()) {
+            return lastRefreshRet;
+        }
+        return refreshLocked();
+    }
+    else if (isStale()) {
+        refreshAsync();
+    }
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
+
+int SiteDiscoveryCache::refresh(void) {
+    uint64_t refresh_count = refreshCount.load();
+    std::lock_guard<std::mutex> lockGuard(refreshMutex);
+    // 等锁期间开始并完成的同步晚于本次调用，结果同样新，不再重复请求查询站点
+    if (refreshCount.load() != refresh_count) {
+        return lastRefreshRet;
+    }
+    return refreshLocked();
+}
+
+int SiteDiscoveryCache::refreshLocked(void) {
+    uint64_t event_count = eventCount.load();
+    refreshCount.fetch_add(1);
+
+    std::vector<SiteHandle> site_list;
+    int ret = fetcher(site_list);
+    lastRefreshRet = ret;
+    if (ret != ServiceSiteManager::RET_CODE_OK) {
+        // 保留原目录，REFRESH_RETRY_MS 后再重试
+        syncTimeMs.store(steadyNowMs() - ttlMs.load() + REFRESH_RETRY_MS);
+        return ret;
+    }
+
+    Directory* directory = new Directory;
+    directory->siteList = std::move(site_list);
+    buildIndex(directory);
+
+    {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+        publishLocked(directory);
+    }
+
+    // 同步期间到达的增量可能被全量结果覆盖，下次查找时再同步一次
+    syncTimeMs.store(eventCount.load() == event_count ? steadyNowMs() : 0);
+
+    return ServiceSiteManager::RET_CODE_OK;
+}
+
+void SiteDiscoveryCache::refreshAsync(void) {
+    bool expected = false;
+    if (!isRefreshing.compare_exchange_strong(expected, true)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lockGuard(writeMutex);
+    if (isStop) {
+        isRefreshing.store(false);
+        return;
+    }
+    // 上一次同步已结束（isRefreshing 已复位），join 只是回收线程
+    if (refreshThread.joinable()) {
+        refreshThread.join();
+    }
+    refreshThread = std::thread([this]() {
+        refresh();
+        isRefreshing.store(false);
+    });
+}
+
+void SiteDiscoveryCache::stop(void) {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+        isStop.store(true);
+        thread.swap(refreshThread);
+    }
+    // 同步线程发布结果时要取 writeMutex，不能持锁 join
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void SiteDiscoveryCache::applyOnline(const SiteHandle& site) {
+    std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+    eventCount.fetch_add(1);
+
+    // 从未同步过时忽略，第一次全量同步会包含此站点
+    const Directory* old_directory = current.load();
+    if (old_directory == nullptr) {
+        return;
+    }
+
+    Directory* directory = new Directory;
+    directory->siteList = old_directory->siteList;
+
+    bool replaced = false;
+    for (auto& item : directory->siteList) {
+        if (item.getSiteId() == site.getSiteId() && item.getPort() == site.getPort()) {
+            item = site;
+            replaced = true;
+            break;
+        }
+    }
+    if (!replaced) {
+        directory->siteList.push_back(site);
+    }
+
+    buildIndex(directory);
+    publishLocked(directory);
+}
+
+void SiteDiscoveryCache::applyOffline(const string& pSiteId, int port) {
+    std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+    eventCount.fetch_add(1);
+
+    const Directory* old_directory = current.load();
+    if (old_directory == nullptr) {
+        return;
+    }
+
+    Directory* directory = new Directory;
+    for (const auto& item : old_directory->siteList) {
+        if (item.getSiteId() == pSiteId && (port == 0 || item.getPort() == port)) {
+            continue;
+        }
+        directory->siteList.push_back(item);
+    }
+
+    buildIndex(directory);
+    publishLocked(directory);
+}
+
+void SiteDiscoveryCache::markStale(void) {
+    syncTimeMs.store(0);
+}
+
+bool SiteDiscoveryCache::isStale(void) const {
+    int64_t sync_time = syncTimeMs.load();
+    return sync_time == 0 || steadyNowMs() - sync_time >= ttlMs.load();
+}
+
+void SiteDiscoveryCache::setTtlSeconds(int ttlSeconds) {
+    ttlMs.store(ttlSeconds * 1000);
+}
+
+void SiteDiscoveryCache::publishLocked(Directory* directory) {
+    const Directory* old_directory = current.exchange(directory);
+    if (old_directory != nullptr) {
+        retiredList.emplace_back(old_directory, qlibc::epochRetire());
+    }
+
+    uint64_t min_active = qlibc::epochMinActive();
+    size_t kept = 0;
+    for (auto& item : retiredList) {
+        if (item.second <= min_active) {
+            delete item.first;
+        }
+        else {
+            retiredList[kept++] = item;
+        }
+    }
+    retiredList.resize(kept);
+}
+
+void SiteDiscoveryCache::buildIndex(Directory* directory) {
+    directory->siteIdIndex.clear();
+    for (const auto& item : directory->siteList) {
+        directory->siteIdIndex[item.getSiteId()].push_back(item);
+    }
+}
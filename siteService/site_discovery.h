@@ -0,0 +1,115 @@
+/*
+ * site_discovery.h
+ *
+ *  Created on: 2022年7月18日
+ */
+
+#ifndef LIB_SITE_DISCOVERY_H_
+#define LIB_SITE_DISCOVERY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "service_site_manager.h"
+
+namespace servicesite {
+
+/*
+ * 站点发现缓存
+ *
+ *  1. 站点目录是不可变快照，通过原子指针发布；按 site_id 查找不加锁、不访问网络，旧快照在没有读者后释放（qlibc/Epoch.h）
+ *  2. 查询站点发布的上线/下线消息作为增量直接修改目录（复制后替换）
+ *  3. 距上次全量同步超过 TTL 时视为过期：查找仍返回缓存内容，同时在后台线程重新全量同步，同一时间只有一个同步
+ *     查询站点不发布上线/下线消息时，目录最多落后一个 TTL
+ *  4. 从未同步过时，第一次查找同步等待全量同步
+ */
+class SiteDiscoveryCache {
+public:
+    // 从查询站点取全量站点列表，返回错误码
+    using SiteListFetcher = std::function<int(std::vector<SiteHandle>&)>;
+
+    static const int DEFAULT_TTL_SECONDS = 60;
+    // 同步失败后的重试间隔
+    static const int REFRESH_RETRY_MS = 2000;
+
+private:
+    struct Directory {
+        std::vector<SiteHandle> siteList;                               // 查询站点返回的顺序
+        std::unordered_map<string, std::vector<SiteHandle>> siteIdIndex;
+    };
+
+    SiteListFetcher fetcher;
+    std::atomic<int> ttlMs;
+
+    std::atomic<const Directory*> current;
+    std::atomic<int64_t> syncTimeMs;        // 上次全量同步的时间，0 表示需要重新同步
+    std::atomic<uint64_t> eventCount;       // 已应用的增量数，用于发现同步期间到达的增量
+    std::atomic<bool> isRefreshing;
+    std::atomic<bool> isStop;
+
+    std::atomic<uint64_t> refreshCount;     // 已开始的全量同步数
+    std::mutex refreshMutex; // 全量同步串行，保护 lastRefreshRet
+    int lastRefreshRet;
+    std::mutex writeMutex; // 保护 目录替换、retiredList、refreshThread
+    std::vector<std::pair<const Directory*, uint64_t>> retiredList;
+    std::thread refreshThread;
+
+public:
+    explicit SiteDiscoveryCache(SiteListFetcher pFetcher, int ttlSeconds = DEFAULT_TTL_SECONDS);
+    ~SiteDiscoveryCache();
+
+    SiteDiscoveryCache(const SiteDiscoveryCache&) = delete;
+    SiteDiscoveryCache& operator=(const SiteDiscoveryCache&) = delete;
+
+    /**
+     * @brief 按 site_id 查找，结果追加到 pSiteHandleList
+     *
+     * @return int 错误码，只有从未同步过且同步失败时返回同步的错误码
+     */
+    int lookup(const string& pSiteId, std::vector<SiteHandle>& pSiteHandleList);
+
+    /**
+     * @brief 所有站点，结果追加到 pSiteHandleList
+     *
+     * @return int 错误码，同 lookup
+     */
+    int getAll(std::vector<SiteHandle>& pSiteHandleList);
+
+    // 立即全量同步，失败时保留原目录；等待期间有新开始的同步完成时直接返回它的结果
+    int refresh(void);
+
+    // 后台全量同步，已有同步进行中或已 stop 时忽略
+    void refreshAsync(void);
+
+    // 等待进行中的后台同步结束，之后不再启动后台同步；查找仍返回缓存内容
+    void stop(void);
+
+    // 站点上线或信息变化，同一 site_id 和端口的旧记录被替换
+    void applyOnline(const SiteHandle& site);
+
+    // 站点下线，port 为 0 时删除该 site_id 的所有记录
+    void applyOffline(const string& pSiteId, int port = 0);
+
+    // 下次查找时重新同步，例如查询站点重启后
+    void markStale(void);
+
+    bool isStale(void) const;
+
+    void setTtlSeconds(int ttlSeconds);
+
+private:
+    // 从未同步过时先同步（在进入 epoch 读区间之前调用）；过期时触发后台同步
+    int ensureLoaded(void);
+    int refreshLocked(void);
+    void publishLocked(Directory* directory);
+    static void buildIndex(Directory* directory);
+};
+
+}
+
+#endif /* LIB_SITE_DISCOVERY_H_ */
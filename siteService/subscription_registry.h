@@ -0,0 +1,308 @@
+/*
+ * subscription_registry.h
+ *
+ *  Created on: 2022年7月16日
+ */
+
+#ifndef LIB_SUBSCRIPTION_REGISTRY_H_
+#define LIB_SUBSCRIPTION_REGISTRY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "qlibc/Epoch.h"
+
+namespace servicesite {
+
+/*
+ * 消息订阅表，Site 为订阅站点（每个 ip:port 一个对象）
+ *
+ *  1. 主题按 message_id 存放在开放寻址哈希表中，按 (ip, port) 索引订阅站点
+ *  2. 每个主题的订阅者是不可变数组，订阅/退订时复制修改后原子替换
+ *  3. 发布只做一次无锁查找，直接遍历当前数组，不加锁、不复制
+ *
+ * 写操作（增加主题、订阅、退订）之间用互斥锁串行；被替换的数组和哈希表在没有读者后释放（qlibc/Epoch.h），
+ * 读者先登记 epoch 再读原子指针，两者都用顺序一致的内存序，保证写者的回收检查能看到登记
+ * 主题在注册表析构时释放；站点由 SiteFactory 创建，注册表不负责释放
+ */
+template <typename Site>
+class SubscriptionRegistry {
+public:
+    using SubscriberList = std::vector<Site*>;
+    using SiteFactory = std::function<Site*(const std::string& ip, int port)>;
+
+private:
+    struct Topic {
+        std::string messageId;
+        size_t hash;
+        std::atomic<const SubscriberList*> subscribers;  // 无订阅者时为 nullptr
+    };
+
+    // 容量为 2 的幂，装载率不超过 1/2，查找一定能遇到空槽
+    struct TopicTable {
+        size_t mask;
+        std::unique_ptr<std::atomic<Topic*>[]> slots;
+
+        explicit TopicTable(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Topic*>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    static const size_t INITIAL_CAPACITY = 16;
+
+    SiteFactory siteFactory;
+    std::atomic<TopicTable*> table;
+
+    mutable std::mutex writeMutex;
+    std::vector<Topic*> topicOrder;                     // 注册顺序
+    std::unordered_map<std::string, Site*> siteIndex;   // key 为 "ip:port"
+    std::vector<Site*> siteOrder;                       // 创建顺序
+    std::vector<std::pair<const SubscriberList*, uint64_t>> retiredLists;
+    std::vector<std::pair<TopicTable*, uint64_t>> retiredTables;
+
+public:
+    explicit SubscriptionRegistry(SiteFactory factory)
+        : siteFactory(std::move(factory)), table(new TopicTable(INITIAL_CAPACITY)) {
+    }
+
+    // 析构时不应再有读者
+    ~SubscriptionRegistry() {
+        for (Topic* topic : topicOrder) {
+            delete topic->subscribers.load();
+            delete topic;
+        }
+        delete table.load();
+        for (auto& item : retiredLists) {
+            delete item.first;
+        }
+        for (auto& item : retiredTables) {
+            delete item.first;
+        }
+    }
+
+    SubscriptionRegistry(const SubscriptionRegistry&) = delete;
+    SubscriptionRegistry& operator=(const SubscriptionRegistry&) = delete;
+
+    // 增加主题，已存在返回 false
+    bool addTopic(const std::string& messageId) {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+        size_t hash = std::hash<std::string>()(messageId);
+        if (findTopic(table.load(std::memory_order_relaxed), messageId, hash) != nullptr) {
+            return false;
+        }
+
+        Topic* topic = new Topic;
+        topic->messageId = messageId;
+        topic->hash = hash;
+        topic->subscribers.store(nullptr, std::memory_order_relaxed);
+
+        TopicTable* current = table.load(std::memory_order_relaxed);
+        if ((topicOrder.size() + 1) * 2 > current->mask + 1) {
+            current = growLocked(current);
+        }
+        insertTopic(current, topic);
+        topicOrder.push_back(topic);
+
+        return true;
+    }
+
+    bool hasTopic(const std::string& messageId) const {
+        qlibc::EpochReadGuard guard;
+        return findTopic(table.load(), messageId, std::hash<std::string>()(messageId)) != nullptr;
+    }
+
+    // 查找 (ip, port) 对应的站点，不存在且 create 为 true 时用 SiteFactory 创建
+    Site* site(const std::string& ip, int port, bool create) {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+        std::string key = ip + ":" + std::to_string(port);
+        auto iter = siteIndex.find(key);
+        if (iter != siteIndex.end()) {
+            return iter->second;
+        }
+        if (!create) {
+            return nullptr;
+        }
+
+        Site* newSite = siteFactory(ip, port);
+        siteIndex.emplace(std::move(key), newSite);
+        siteOrder.push_back(newSite);
+        return newSite;
+    }
+
+    // 主题不存在或已订阅返回 false
+    bool subscribe(const std::string& messageId, Site* subscriber) {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+        Topic* topic = findTopic(table.load(std::memory_order_relaxed), messageId, std::hash<std::string>()(messageId));
+        if (topic == nullptr) {
+            return false;
+        }
+
+        const SubscriberList* current = topic->subscribers.load(std::memory_order_relaxed);
+        SubscriberList* next;
+        if (current == nullptr) {
+            next = new SubscriberList;
+        }
+        else {
+            if (std::find(current->begin(), current->end(), subscriber) != current->end()) {
+                return false;
+            }
+            next = new SubscriberList;
+            next->reserve(current->size() + 1);
+            *next = *current;
+        }
+        next->push_back(subscriber);
+
+        replaceLocked(topic, next);
+        return true;
+    }
+
+    // 主题不存在或未订阅返回 false
+    bool unsubscribe(const std::string& messageId, Site* subscriber) {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+        Topic* topic = findTopic(table.load(std::memory_order_relaxed), messageId, std::hash<std::string>()(messageId));
+        if (topic == nullptr) {
+            return false;
+        }
+
+        const SubscriberList* current = topic->subscribers.load(std::memory_order_relaxed);
+        if (current == nullptr) {
+            return false;
+        }
+        auto iter = std::find(current->begin(), current->end(), subscriber);
+        if (iter == current->end()) {
+            return false;
+        }
+
+        SubscriberList* next = nullptr;
+        if (current->size() > 1) {
+            next = new SubscriberList;
+            next->reserve(current->size() - 1);
+            next->insert(next->end(), current->begin(), iter);
+            next->insert(next->end(), iter + 1, current->end());
+        }
+
+        replaceLocked(topic, next);
+        return true;
+    }
+
+    /*
+     * 对 messageId 的每个订阅者调用 fn(Site*)，返回订阅者数量
+     * 不加锁；遍历的是调用时的订阅者数组，期间的订阅/退订不影响本次遍历
+     */
+    template <typename Fn>
+    size_t forEachSubscriber(const std::string& messageId, Fn&& fn) const {
+        qlibc::EpochReadGuard guard;
+
+        Topic* topic = findTopic(table.load(), messageId, std::hash<std::string>()(messageId));
+        if (topic == nullptr) {
+            return 0;
+        }
+        const SubscriberList* subscribers = topic->subscribers.load();
+        if (subscribers == nullptr) {
+            return 0;
+        }
+        for (Site* subscriber : *subscribers) {
+            fn(subscriber);
+        }
+        return subscribers->size();
+    }
+
+    // 按注册顺序对有订阅者的主题调用 fn(messageId, const SubscriberList&)，调试/保存用，持写锁
+    template <typename Fn>
+    void forEachTopic(Fn&& fn) const {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+
+        for (const Topic* topic : topicOrder) {
+            const SubscriberList* subscribers = topic->subscribers.load(std::memory_order_relaxed);
+            if (subscribers != nullptr) {
+                fn(topic->messageId, *subscribers);
+            }
+        }
+    }
+
+    // 所有站点，按创建顺序
+    std::vector<Site*> sites() const {
+        std::lock_guard<std::mutex> lockGuard(writeMutex);
+        return siteOrder;
+    }
+
+private:
+    static Topic* findTopic(const TopicTable* topicTable, const std::string& messageId, size_t hash) {
+        for (size_t i = hash & topicTable->mask; ; i = (i + 1) & topicTable->mask) {
+            Topic* topic = topicTable->slots[i].load(std::memory_order_acquire);
+            if (topic == nullptr) {
+                return nullptr;
+            }
+            if (topic->hash == hash && topic->messageId == messageId) {
+                return topic;
+            }
+        }
+    }
+
+    static void insertTopic(TopicTable* topicTable, Topic* topic) {
+        size_t i = topic->hash & topicTable->mask;
+        while (topicTable->slots[i].load(std::memory_order_relaxed) != nullptr) {
+            i = (i + 1) & topicTable->mask;
+        }
+        topicTable->slots[i].store(topic, std::memory_order_release);
+    }
+
+    // 容量翻倍后整体发布新表，读者看到的要么是旧表要么是完整的新表
+    TopicTable* growLocked(TopicTable* current) {
+        TopicTable* next = new TopicTable((current->mask + 1) * 2);
+        for (Topic* topic : topicOrder) {
+            insertTopic(next, topic);
+        }
+        table.store(next);
+        retiredTables.emplace_back(current, qlibc::epochRetire());
+        reclaimLocked();
+        return next;
+    }
+
+    void replaceLocked(Topic* topic, const SubscriberList* next) {
+        const SubscriberList* current = topic->subscribers.exchange(next);
+        if (current != nullptr) {
+            retiredLists.emplace_back(current, qlibc::epochRetire());
+        }
+        reclaimLocked();
+    }
+
+    void reclaimLocked() {
+        if (retiredLists.empty() && retiredTables.empty()) {
+            return;
+        }
+        uint64_t minActive = qlibc::epochMinActive();
+        reclaim(retiredLists, minActive);
+        reclaim(retiredTables, minActive);
+    }
+
+    template <typename T>
+    static void reclaim(std::vector<std::pair<T*, uint64_t>>& retired, uint64_t minActive) {
+        size_t kept = 0;
+        for (auto& item : retired) {
+            if (item.second <= minActive) {
+                delete item.first;
+            }
+            else {
+                retired[kept++] = item;
+            }
+        }
+        retired.resize(kept);
+    }
+};
+
+}
+
+#endif /* LIB_SUBSCRIPTION_REGISTRY_H_ */
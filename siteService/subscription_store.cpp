@@ -0,0 +1,406 @@
+/*
+ * subscription_store.cpp
+ *
+ *  Created on: 2022年7月17日
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "qlibc/JsonSax.h"
+#include "qlibc/JsonSchema.h"
+#include "qlibc/MappedFile.h"
+#include "qlibc/QData.h"
+#include "service_site_manager.h"
+#include "subscription_store.h"
+
+using namespace servicesite;
+
+// 类内初始化的常量被引用绑定（如 std::chrono::seconds 的构造参数）时需要定义
+const size_t SubscriptionStore::COMPACT_ENTRIES;
+const int SubscriptionStore::COMPACT_INTERVAL_SECONDS;
+
+namespace {
+
+const char* const JOURNAL_OP_SUBSCRIBE = "subscribe";
+const char* const JOURNAL_OP_UNSUBSCRIBE = "unsubscribe";
+
+// 日志中的一行
+struct JournalEntry {
+    string op;
+    string messageId;
+    string ip;
+    int port = 0;
+    qlibc::JsonOptional<bool> acceptCbor;
+};
+
+}
+
+namespace qlibc {
+
+template<>
+struct JsonSchema<JournalEntry> {
+    using T = JournalEntry;
+    static constexpr auto fields() {
+        return std::make_tuple(jsonField("op", &T::op),
+                               jsonField("messageId", &T::messageId),
+                               jsonField("ip", &T::ip),
+                               jsonField("port", &T::port),
+                               jsonField("acceptCbor", &T::acceptCbor));
+    }
+};
+
+}
+
+namespace {
+
+/*
+ * 流式解析快照：[ {"messageId": ..., "site_handle_list": [ {"ip": ..., "port": ..., "acceptCbor": ...}, ... ]}, ... ]
+ * 每个消息对象结束时回调其中的站点；字段顺序不限，其余字段忽略
+ */
+class SnapshotSaxHandler : public qlibc::JsonSaxHandler {
+    const SubscriptionStore::RecordHandler& handler;
+
+    int depth = 0;
+    string key;                 // 当前对象中最近的 key
+    bool inSiteList = false;
+    string messageId;
+    std::vector<SubscriptionRecord> sites;
+    SubscriptionRecord site;
+
+public:
+    explicit SnapshotSaxHandler(const SubscriptionStore::RecordHandler& pHandler) : handler(pHandler) {}
+
+    bool onString(const char* str, size_t length) override {
+        if (depth == 2 && key == "messageId") {
+            messageId.assign(str, length);
+        }
+        else if (depth == 4 && inSiteList && key == "ip") {
+            site.ip.assign(str, length);
+        }
+        return true;
+    }
+
+    bool onInt(int64_t value) override {
+        if (depth == 4 && inSiteList && key == "port") {
+            site.port = static_cast<int>(value);
+        }
+        return true;
+    }
+
+    bool onUInt(uint64_t value) override {
+        return onInt(static_cast<int64_t>(value));
+    }
+
+    bool onBool(bool value) override {
+        if (depth == 4 && inSiteList && key == "acceptCbor") {
+            site.acceptCbor = value;
+        }
+        return true;
+    }
+
+    bool onKey(const char* str, size_t length) override {
+        key.assign(str, length);
+        return true;
+    }
+
+    bool onStartObject() override {
+        ++depth;
+        if (depth == 2) {
+            messageId.clear();
+            sites.clear();
+        }
+        else if (depth == 4 && inSiteList) {
+            site = SubscriptionRecord();
+        }
+        return true;
+    }
+
+    bool onEndObject() override {
+        if (depth == 4 && inSiteList) {
+            sites.push_back(site);
+        }
+        else if (depth == 2 && !messageId.empty()) {
+            for (auto& item : sites) {
+                item.messageId = messageId;
+                handler(true, item);
+            }
+        }
+        --depth;
+        return true;
+    }
+
+    bool onStartArray() override {
+        ++depth;
+        if (depth == 3 && key == "site_handle_list") {
+            inSiteList = true;
+        }
+        return true;
+    }
+
+    bool onEndArray() override {
+        if (depth == 3) {
+            inSiteList = false;
+        }
+        --depth;
+        return true;
+    }
+};
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// 新建的日志文件要落盘需要 fsync 所在目录
+void syncParentDir(const string& path) {
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+}
+
+SubscriptionStore::~SubscriptionStore() {
+    stop();
+    if (journalFd >= 0) {
+        ::close(journalFd);
+    }
+}
+
+bool SubscriptionStore::load(const string& pSnapshotPath, const string& pJournalPath, const RecordHandler& handler) {
+    snapshotPath = pSnapshotPath;
+    journalPath = pJournalPath;
+
+    bool ok = true;
+
+    if (::access(snapshotPath.c_str(), F_OK) == 0) {
+        SnapshotSaxHandler snapshot_handler(handler);
+        if (!qlibc::parseFileSax(snapshotPath, snapshot_handler)) {
+            SERV_LIB_LOG("parse error: {}", snapshotPath);
+            ok = false;
+        }
+    }
+
+    size_t valid_size = 0;
+    if (!replayJournal(handler, valid_size)) {
+        ok = false;
+    }
+
+    bool created = ::access(journalPath.c_str(), F_OK) != 0;
+    journalFd = ::open(journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journalFd < 0) {
+        SERV_LIB_LOG("open error: {} {}", journalPath, strerror(errno));
+        return false;
+    }
+    if (created) {
+        syncParentDir(journalPath);
+    }
+
+    // 截掉末尾不完整或损坏的记录，之后的追加不会跟在半行后面
+    struct stat st{};
+    if (::fstat(journalFd, &st) == 0 && static_cast<size_t>(st.st_size) > valid_size) {
+        SERV_LIB_LOG("truncate journal {} from {} to {}", journalPath, st.st_size, valid_size);
+        if (::ftruncate(journalFd, static_cast<off_t>(valid_size)) != 0 || ::fdatasync(journalFd) != 0) {
+            ok = false;
+        }
+    }
+    journalSize = valid_size;
+    lastCompactTime = time(nullptr);
+
+    return ok;
+}
+
+// 逐行解析，validSize 为最后一条完整有效记录的结束位置
+bool SubscriptionStore::replayJournal(const RecordHandler& handler, size_t& validSize) {
+    validSize = 0;
+    journalEntries = 0;
+
+    qlibc::MappedFile file;
+    if (!file.open(journalPath) || file.data() == nullptr) {
+        return true;
+    }
+
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    const char* line = begin;
+    Json::Value line_json;
+    JournalEntry entry;
+    SubscriptionRecord record;
+
+    while (line < end) {
+        const char* line_end = static_cast<const char*>(memchr(line, '\n', static_cast<size_t>(end - line)));
+        if (line_end == nullptr) {
+            // 最后一批写到一半
+            return true;
+        }
+        if (!qlibc::QData::parseJson(line, static_cast<int>(line_end - line), line_json) ||
+            !qlibc::decodeJson(line_json, entry) ||
+            (entry.op != JOURNAL_OP_SUBSCRIBE && entry.op != JOURNAL_OP_UNSUBSCRIBE)) {
+            SERV_LIB_LOG("journal format error: {} offset {}", journalPath, line - begin);
+            return false;
+        }
+
+        record.messageId = std::move(entry.messageId);
+        record.ip = std::move(entry.ip);
+        record.port = entry.port;
+        record.acceptCbor = entry.acceptCbor.value;
+        handler(entry.op == JOURNAL_OP_SUBSCRIBE, record);
+
+        ++journalEntries;
+        line = line_end + 1;
+        validSize = static_cast<size_t>(line - begin);
+    }
+
+    return true;
+}
+
+void SubscriptionStore::start(SnapshotProvider provider) {
+    snapshotProvider = std::move(provider);
+    writeThreadP = new std::thread(&SubscriptionStore::writeFromThread, this);
+}
+
+void SubscriptionStore::recordSubscribe(const SubscriptionRecord& record) {
+    submit(PendingRecord{true, record});
+}
+
+void SubscriptionStore::recordUnsubscribe(const string& messageId, const string& ip, int port) {
+    SubscriptionRecord record;
+    record.messageId = messageId;
+    record.ip = ip;
+    record.port = port;
+    submit(PendingRecord{false, std::move(record)});
+}
+
+void SubscriptionStore::submit(PendingRecord&& pendingRecord) {
+    std::lock_guard<std::mutex> lockGuard(queueMutex);
+    pending.push_back(std::move(pendingRecord));
+    ++submittedCount;
+    queueCond.notify_one();
+}
+
+void SubscriptionStore::flush(void) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if (writeThreadP == nullptr) {
+        return;
+    }
+    uint64_t target = submittedCount;
+    writtenCond.wait(lock, [&] { return writtenCount >= target || isStop; });
+}
+
+void SubscriptionStore::stop(void) {
+    {
+        std::lock_guard<std::mutex> lockGuard(queueMutex);
+        if (writeThreadP == nullptr) {
+            return;
+        }
+        isStop = true;
+        queueCond.notify_one();
+    }
+    writeThreadP->join();
+    delete writeThreadP;
+    writeThreadP = nullptr;
+}
+
+// 一次取出队列中的全部记录写入，请求密集时自然合并为一批
+void SubscriptionStore::writeFromThread(void) {
+    std::vector<PendingRecord> batch;
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    while (true) {
+        queueCond.wait_for(lock, std::chrono::seconds(COMPACT_INTERVAL_SECONDS),
+                           [&] { return isStop || !pending.empty(); });
+        batch.swap(pending);
+        bool stopping = isStop;
+        lock.unlock();
+
+        if (!batch.empty()) {
+            appendJournal(batch);
+        }
+        if (journalEntries >= COMPACT_ENTRIES ||
+            (journalEntries > 0 && (stopping || time(nullptr) - lastCompactTime >= COMPACT_INTERVAL_SECONDS))) {
+            compact();
+        }
+
+        lock.lock();
+        writtenCount += batch.size();
+        batch.clear();
+        writtenCond.notify_all();
+        if (stopping && pending.empty()) {
+            break;
+        }
+    }
+}
+
+bool SubscriptionStore::appendJournal(const std::vector<PendingRecord>& batch) {
+    if (journalFd < 0) {
+        return false;
+    }
+
+    string content;
+    Json::Value entry_json;
+    for (const auto& item : batch) {
+        entry_json = Json::Value(Json::objectValue);
+        entry_json["op"] = item.subscribe ? JOURNAL_OP_SUBSCRIBE : JOURNAL_OP_UNSUBSCRIBE;
+        entry_json["messageId"] = item.record.messageId;
+        entry_json["ip"] = item.record.ip;
+        entry_json["port"] = item.record.port;
+        if (item.subscribe) {
+            entry_json["acceptCbor"] = item.record.acceptCbor;
+        }
+        qlibc::QData::appendJsonString(entry_json, content);
+        content.push_back('\n');
+    }
+
+    if (!writeAll(journalFd, content.data(), content.size()) || ::fdatasync(journalFd) != 0) {
+        SERV_LIB_LOG("write error: {} {}", journalPath, strerror(errno));
+        // 去掉写了一部分的内容，保证日志始终由完整的行组成
+        if (::ftruncate(journalFd, static_cast<off_t>(journalSize)) != 0) {
+            SERV_LIB_LOG("truncate error: {} {}", journalPath, strerror(errno));
+        }
+        return false;
+    }
+
+    journalSize += content.size();
+    journalEntries += batch.size();
+    return true;
+}
+
+// 快照先整体替换，再清空日志；顺序不能颠倒
+bool SubscriptionStore::compact(void) {
+    lastCompactTime = time(nullptr);
+
+    Json::Value snapshot = snapshotProvider();
+    if (!qlibc::QData::writeToFile(snapshotPath, snapshot, true)) {
+        SERV_LIB_LOG("write error: {}", snapshotPath);
+        return false;
+    }
+
+    if (journalFd >= 0) {
+        if (::ftruncate(journalFd, 0) != 0 || ::fdatasync(journalFd) != 0) {
+            SERV_LIB_LOG("truncate error: {} {}", journalPath, strerror(errno));
+            return false;
+        }
+        journalSize = 0;
+    }
+    journalEntries = 0;
+
+    SERV_LIB_LOG("message subscriber snapshot ok: {}", snapshotPath);
+    return true;
+}
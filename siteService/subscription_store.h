@@ -0,0 +1,111 @@
+/*
+ * subscription_store.h
+ *
+ *  Created on: 2022年7月17日
+ */
+
+#ifndef LIB_SUBSCRIPTION_STORE_H_
+#define LIB_SUBSCRIPTION_STORE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "qlibc/jsoncpp/json.h"
+
+namespace servicesite {
+
+// 一条订阅记录
+struct SubscriptionRecord {
+    std::string messageId;
+    std::string ip;
+    int port = 0;
+    bool acceptCbor = false;
+};
+
+/*
+ * 消息订阅的持久化：快照 + 追加日志
+ *
+ *  1. 订阅/退订只把记录放入内存队列，后台线程批量追加到日志文件，每批一次 fdatasync
+ *  2. 日志达到 COMPACT_ENTRIES 条，或日志非空且距上次快照超过 COMPACT_INTERVAL_SECONDS 时，
+ *     由 SnapshotProvider 取得当前完整订阅表，写临时文件后 rename 为快照，再清空日志
+ *  3. 启动时流式解析快照（SAX，不建 DOM），再逐行重放日志；日志末尾写了一半的记录被丢弃并截掉
+ *
+ * 快照格式与原 _message_subscriber.json 相同，旧版本的配置文件可以直接加载
+ * 重放是幂等的，快照已包含的日志记录再重放一次结果不变：在写快照和清空日志之间崩溃不会丢失订阅
+ */
+class SubscriptionStore {
+public:
+    // 返回当前完整订阅表，格式同快照文件
+    using SnapshotProvider = std::function<Json::Value(void)>;
+    // subscribe 为 false 时是退订记录，acceptCbor 无意义
+    using RecordHandler = std::function<void(bool subscribe, const SubscriptionRecord& record)>;
+
+    static const size_t COMPACT_ENTRIES = 1024;
+    static const int COMPACT_INTERVAL_SECONDS = 60;
+
+private:
+    struct PendingRecord {
+        bool subscribe;
+        SubscriptionRecord record;
+    };
+
+    std::string snapshotPath;
+    std::string journalPath;
+    int journalFd = -1;
+    size_t journalSize = 0;
+    size_t journalEntries = 0;
+    time_t lastCompactTime = 0;
+
+    SnapshotProvider snapshotProvider;
+    std::thread* writeThreadP = nullptr;
+
+    std::mutex queueMutex; // 保护 以下成员
+    std::condition_variable queueCond;
+    std::condition_variable writtenCond;
+    std::vector<PendingRecord> pending;
+    uint64_t submittedCount = 0;
+    uint64_t writtenCount = 0;
+    bool isStop = false;
+
+public:
+    SubscriptionStore() = default;
+    ~SubscriptionStore();
+
+    SubscriptionStore(const SubscriptionStore&) = delete;
+    SubscriptionStore& operator=(const SubscriptionStore&) = delete;
+
+    /**
+     * @brief 加载快照并重放日志，按写入顺序回调 handler，之后打开日志准备追加
+     *
+     * @return bool 文件不存在视为空；快照或日志格式错误时返回 false，已解析的部分仍会回调
+     */
+    bool load(const std::string& pSnapshotPath, const std::string& pJournalPath, const RecordHandler& handler);
+
+    // 启动后台写线程，只调用一次
+    void start(SnapshotProvider provider);
+
+    void recordSubscribe(const SubscriptionRecord& record);
+    void recordUnsubscribe(const std::string& messageId, const std::string& ip, int port);
+
+    // 等待已提交的记录写入日志
+    void flush(void);
+
+    // 写完剩余记录并生成快照后停止后台线程
+    void stop(void);
+
+private:
+    void submit(PendingRecord&& pendingRecord);
+    void writeFromThread(void);
+    bool appendJournal(const std::vector<PendingRecord>& batch);
+    bool compact(void);
+    bool replayJournal(const RecordHandler& handler, size_t& validSize);
+};
+
+}
+
+#endif /* LIB_SUBSCRIPTION_STORE_H_ */
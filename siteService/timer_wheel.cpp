@@ -0,0 +1,163 @@
+/*
+ * timer_wheel.cpp
+ *
+ *  Created on: 2022年7月19日
+ */
+#include <chrono>
+#include <random>
+#include "timer_wheel.h"
+
+using namespace servicesite;
+
+TimerWheel::TimerWheel(int pTickMs, size_t slotCount) : tickMs(pTickMs), slots(slotCount) {
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+TimerWheel::TimerId TimerWheel::schedule(int delayMs, Task task) {
+    std::lock_guard<std::mutex> lockGuard(timerMutex);
+
+    if (isStop) {
+        return 0;
+    }
+    if (tickThreadP == nullptr) {
+        tickThreadP = new std::thread(&TimerWheel::tickFromThread, this);
+    }
+
+    // 至少等一个 tick，当前格已经在处理中
+    uint64_t ticks = delayMs <= 0 ? 1 : (static_cast<uint64_t>(delayMs) + tickMs - 1) / tickMs;
+    size_t slot = (cursor + ticks) % slots.size();
+    uint64_t rounds = (ticks - 1) / slots.size();
+
+    TimerId id = nextId++;
+    slots[slot].push_back(Timer{id, rounds, std::move(task)});
+    timerSlot[id] = slot;
+
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lockGuard(timerMutex);
+
+    auto iter = timerSlot.find(id);
+    if (iter == timerSlot.end()) {
+        return false;
+    }
+
+    std::vector<Timer>& slot = slots[iter->second];
+    for (size_t i = 0; i < slot.size(); ++i) {
+        if (slot[i].id == id) {
+            slot[i] = std::move(slot.back());
+            slot.pop_back();
+            break;
+        }
+    }
+    timerSlot.erase(iter);
+
+    return true;
+}
+
+void TimerWheel::stop(void) {
+    std::thread* thread_p;
+    {
+        std::lock_guard<std::mutex> lockGuard(timerMutex);
+        isStop = true;
+        thread_p = tickThreadP;
+        tickThreadP = nullptr;
+        stopCond.notify_all();
+    }
+
+    if (thread_p != nullptr) {
+        // 任务中调用 stop 时不能 join 自己
+        if (thread_p->get_id() == std::this_thread::get_id()) {
+            thread_p->detach();
+        }
+        else {
+            thread_p->join();
+        }
+        delete thread_p;
+    }
+
+    std::lock_guard<std::mutex> lockGuard(timerMutex);
+    for (auto& slot : slots) {
+        slot.clear();
+    }
+    timerSlot.clear();
+}
+
+size_t TimerWheel::pendingCount(void) {
+    std::lock_guard<std::mutex> lockGuard(timerMutex);
+    return timerSlot.size();
+}
+
+// 按绝对时间推进，任务执行耗时不会累积成误差；落后时连续补走
+void TimerWheel::tickFromThread(void) {
+    std::vector<Task> expired;
+    auto next_tick = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(timerMutex);
+    while (!isStop) {
+        next_tick += std::chrono::milliseconds(tickMs);
+        if (stopCond.wait_until(lock, next_tick, [this] { return isStop; })) {
+            break;
+        }
+
+        cursor = (cursor + 1) % slots.size();
+        std::vector<Timer>& slot = slots[cursor];
+        size_t kept = 0;
+        for (size_t i = 0; i < slot.size(); ++i) {
+            if (slot[i].rounds > 0) {
+                --slot[i].rounds;
+                if (kept != i) {
+                    slot[kept] = std::move(slot[i]);
+                }
+                ++kept;
+            }
+            else {
+                timerSlot.erase(slot[i].id);
+                expired.push_back(std::move(slot[i].task));
+            }
+        }
+        slot.resize(kept);
+
+        if (expired.empty()) {
+            continue;
+        }
+        lock.unlock();
+        for (auto& task : expired) {
+            task();
+        }
+        expired.clear();
+        lock.lock();
+    }
+}
+
+static std::minstd_rand& threadRandom(void) {
+    thread_local std::minstd_rand random(std::random_device{}());
+    return random;
+}
+
+int RetryBackoff::nextDelayMs(void) {
+    int64_t delay = baseMs;
+    for (int i = 0; i < attempt && delay < maxMs; ++i) {
+        delay *= 2;
+    }
+    if (delay > maxMs) {
+        delay = maxMs;
+    }
+    ++attempt;
+
+    std::uniform_int_distribution<int64_t> distribution(delay / 2, delay);
+    return static_cast<int>(distribution(threadRandom()));
+}
+
+int servicesite::jitterMs(int value, double ratio) {
+    int range = static_cast<int>(value * ratio);
+    if (range <= 0) {
+        return value;
+    }
+    std::uniform_int_distribution<int> distribution(-range, range);
+    return value + distribution(threadRandom());
+}
@@ -0,0 +1,105 @@
+/*
+ * timer_wheel.h
+ *
+ *  Created on: 2022年7月19日
+ */
+
+#ifndef LIB_TIMER_WHEEL_H_
+#define LIB_TIMER_WHEEL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace servicesite {
+
+/*
+ * 时间轮定时器，一个线程驱动所有定时任务
+ *
+ * 每 tickMs 前进一格，共 slotCount 格；超过一圈的任务记录剩余圈数
+ * 添加、取消都是 O(1)（取消只在所在格内查找），到期精度为一个 tick
+ * 任务在定时器线程中执行，应尽快返回；需要网络访问的任务要设置超时
+ * 周期性任务在执行结束时重新 schedule 自己
+ */
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    using Task = std::function<void(void)>;
+
+    static const int DEFAULT_TICK_MS = 50;
+    static const size_t DEFAULT_SLOT_COUNT = 512;
+
+private:
+    struct Timer {
+        TimerId id;
+        uint64_t rounds;
+        Task task;
+    };
+
+    const int tickMs;
+    std::vector<std::vector<Timer>> slots;
+    size_t cursor = 0;
+    TimerId nextId = 1;
+    std::unordered_map<TimerId, size_t> timerSlot;  // 未到期任务所在的格
+
+    std::mutex timerMutex; // 保护 以上成员
+    std::condition_variable stopCond;
+    bool isStop = false;
+    std::thread* tickThreadP = nullptr;
+
+public:
+    explicit TimerWheel(int pTickMs = DEFAULT_TICK_MS, size_t slotCount = DEFAULT_SLOT_COUNT);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // delayMs 后执行一次 task，第一次调用时启动定时器线程
+    TimerId schedule(int delayMs, Task task);
+
+    // 任务未执行时取消，返回是否取消成功
+    bool cancel(TimerId id);
+
+    // 丢弃未执行的任务并等待定时器线程退出，正在执行的任务会执行完
+    void stop(void);
+
+    // 未到期的任务数
+    size_t pendingCount(void);
+
+private:
+    void tickFromThread(void);
+};
+
+/*
+ * 指数退避：第 n 次失败后等待 [d/2, d]，d = min(baseMs * 2^n, maxMs)
+ * 随机抖动避免大量站点同时重试（例如查询站点重启后同时重新注册）
+ */
+class RetryBackoff {
+    int baseMs;
+    int maxMs;
+    int attempt = 0;
+
+public:
+    RetryBackoff(int pBaseMs, int pMaxMs) : baseMs(pBaseMs), maxMs(pMaxMs) {}
+
+    int nextDelayMs(void);
+
+    void reset(void) {
+        attempt = 0;
+    }
+
+    int getAttempt(void) const {
+        return attempt;
+    }
+};
+
+// value 上下浮动 ratio（如 0.1 为 ±10%）后的随机值
+int jitterMs(int value, double ratio);
+
+}
+
+#endif /* LIB_TIMER_WHEEL_H_ */